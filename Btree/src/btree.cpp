@@ -7,6 +7,7 @@
 
 #include "btree.h"
 #include "filescan.h"
+#include "key_search.h"
 #include "exceptions/bad_index_info_exception.h"
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/bad_scanrange_exception.h"
@@ -15,6 +16,12 @@
 #include "exceptions/index_scan_completed_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/end_of_file_exception.h"
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+#include <queue>
+#include <thread>
+#include <type_traits>
 
 
 //#define DEBUG
@@ -22,6 +29,25 @@
 namespace badgerdb
 {
 
+// -----------------------------------------------------------------------------
+// sameIncludedColumns:
+// whether the meta page of an index file lists exactly these included columns
+// -----------------------------------------------------------------------------
+
+static bool sameIncludedColumns(const IndexMetaInfo &metaInfo, const std::vector<IncludedColumn> &columns)
+{
+	if (metaInfo.includedColumnCount != (int) columns.size()) {
+		return false;
+	}
+	for (size_t i = 0; i < columns.size(); i++) {
+		if (metaInfo.includedColumns[i].byteOffset != columns[i].byteOffset
+				|| metaInfo.includedColumns[i].size != columns[i].size) {
+			return false;
+		}
+	}
+	return true;
+}
+
 // -----------------------------------------------------------------------------
 // BTreeIndex::BTreeIndex -- Constructor
 // -----------------------------------------------------------------------------
@@ -30,19 +56,44 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
 		std::string & outIndexName,
 		BufMgr *bufMgrIn,
 		const int attrByteOffset,
-		const Datatype attrType)
+		const Datatype attrType,
+		const double fillFactor,
+		const int runSize,
+		const std::vector<IncludedColumn> & includedColumns)
+	: includedColumns(includedColumns), scanCursor(this)
 {
 	this -> bufMgr = bufMgrIn;//initialize Buffer Manager to Buffer Manager Instance
 	this -> attrByteOffset = attrByteOffset;//initialize the byte offset
 	this -> attributeType = attrType;//set the attribute type
 	this -> nodeOccupancy = INTARRAYNONLEAFSIZE;//initialize the occupancy of nonleaf 
 	this -> leafOccupancy = INTARRAYLEAFSIZE;//initialize the occupancy of leaves
+	this -> underflowThreshold = UNDERFLOW_THRESHOLD;//rebalance nodes only once they are mostly empty
+	this -> lookupCacheCapacity = 0;//lookups are not cached until asked for
+	this -> innerNodesResident = false;//inner nodes go through the buffer pool like any page until asked for
+	this -> swizzling = false;//every node is looked up in the buffer hash table until asked for
+	this -> concurrent = false;//one thread at a time until asked for
+	this -> subtreeCounts = false;//set from the meta page of an existing file
+	this -> activeOperations = 0;
+	this -> statisticsChanged = false;
+	this -> appendSplitFraction = APPEND_SPLIT_FRACTION;//splits of the right-most leaf leave it mostly full
+	this -> scanReadahead = SCAN_READAHEAD_LEAVES;//ascending scans read the next leaves in the background
+	this -> shapeVersion = 0;
+	this -> rightmostVersion = 0;
+	this -> rightmostLeafPageNo = Page::INVALID_NUMBER;
+	this -> includedBytes = 0;
+	for (const IncludedColumn & column : includedColumns) {
+		this -> includedBytes += column.size;
+	}
+	if ((int) includedColumns.size() > MAX_INCLUDED_COLUMNS || includedBytes > MAX_INCLUDED_BYTES) {
+		throw BadIndexInfoException(relationName);
+	}
 
 	//constructing name using code in page 3	
 	std::ostringstream idxStr;
 	idxStr << relationName << "." << attrByteOffset;
 	outIndexName = idxStr.str();//outIndexName is the name of output index file
 
+	bool rebuild = false;
 	try{
         //open the index file while it exists
         file = new BlobFile(outIndexName, false);
@@ -53,815 +104,3272 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
         * throws  BadIndexInfoException 
         * If the index file already exists for the corresponding attribute, but values in 
         * metapage(relationName, attribute byte offset, attribute type etc.)*/
-        if(relationName != metaPageInfo->relationName
+        bool mismatch = relationName != metaPageInfo->relationName
             || attributeType != metaPageInfo->attrType
-            || attrByteOffset != metaPageInfo->attrByteOffset){
+            || attrByteOffset != metaPageInfo->attrByteOffset
+            || (metaPageInfo->nodeFormatVersion == NODE_FORMAT_VERSION && !sameIncludedColumns(*metaPageInfo, includedColumns));
+        if(mismatch){
+            //the file is closed again, so that it can still be removed or opened with the right parameters
+            bufMgr -> unPinPage(file, 1, false);
+            bufMgr -> flushFile(file);
+            delete file;
             throw BadIndexInfoException(relationName);
         }
+        headerPageNum = 1;//the meta page is always the first page
         rootPageNum = metaPageInfo -> rootPageNo;//set the rootPageNum
+        this -> metaPageInfo = *metaPageInfo;
         this -> bufMgr -> unPinPage(file, 1, false);//unpin page
 
+        //files written by older code are brought up to the current node format once
+        int version = this -> metaPageInfo.nodeFormatVersion;
+        if (version < NODE_FORMAT_VERSION) {
+            if (attributeType == INTEGER && version < 2 && includedColumns.empty()) {
+                //nodes without a header are streamed into a new file
+                upgradeNodeFormat(rootPageNum);
+            } else {
+                //the non-leaf nodes of every older version have no room for record counts, so the index is built again
+                bufMgr -> flushFile(file);
+                delete file;
+                File::remove(outIndexName);
+                rebuild = true;
+            }
+        }
+        if (!rebuild) {
+            subtreeCounts = (this -> metaPageInfo.subtreeCounts != 0);
+            if (this -> metaPageInfo.statisticsKept) {
+                //the meta page holds the height, so opening the index reads no other page
+                height = this -> metaPageInfo.statistics.height;
+            } else {
+                //the root knows its own level, which gives the height of the tree
+                Page* rootPage;
+                bufMgr -> readPage(file, rootPageNum, rootPage);
+                height = reinterpret_cast<NodeHeader*>(rootPage) -> level + 1;
+                bufMgr -> unPinPage(file, rootPageNum, false);
+                //files written before the statistics were kept get them once
+                refreshStatistics();
+            }
+        }
+
     }catch(FileNotFoundException e){
+		rebuild = true;
+	}
+	if (rebuild) {
+		createIndex(relationName, outIndexName, fillFactor, runSize);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::createIndex
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::createIndex(const std::string & relationName, const std::string & outIndexName,
+		const double fillFactor, const int runSize)
+{
     	//Copy the information of the relationName, attributeByteOffset and attrType into the metaPageInfo
+		memset((void *) &metaPageInfo, 0, sizeof(IndexMetaInfo));
 		relationName.copy(metaPageInfo.relationName, 20, 0);
   		metaPageInfo.attrByteOffset = attrByteOffset;
-  		metaPageInfo.attrType = attrType;
+  		metaPageInfo.attrType = attributeType;
+  		metaPageInfo.nodeFormatVersion = NODE_FORMAT_VERSION;
+		metaPageInfo.includedColumnCount = includedColumns.size();
+		std::copy(includedColumns.begin(), includedColumns.end(), metaPageInfo.includedColumns);
 		//create new index file while it didnt exists
   		file = new BlobFile(outIndexName, true);
-		//create and allocate a new leaf node(as root node) using private helping method
-  		allocateLeafNode(metaPageInfo.rootPageNo);
-		height = 1;
-  		bufMgr->unPinPage(file, metaPageInfo.rootPageNo, true);
-
-  		FileScan fileScan(relationName, bufMgr);
-  		try {
-    		RecordId recordId;
-    		while (true) {
-      			fileScan.scanNext(recordId);
-      			std::string recordStr = fileScan.getRecord();
-      			const char *record = recordStr.c_str();
-      			int key = *((int *)(record + attrByteOffset));
-      			insertEntry(&key, recordId);
-    		}
-  		} catch (EndOfFileException e) {}
-  }
+		//the meta page is always the first page of the index file
+		Page *metaPage;
+		bufMgr->allocPage(file, headerPageNum, metaPage);
+		bufMgr->unPinPage(file, headerPageNum, true);
+
+		//build the tree from the sorted tuples of the relation instead of inserting them one at a time
+		switch (attributeType) {
+		case INTEGER:
+			bulkLoad<int>(relationName, fillFactor, runSize);
+			break;
+		case DOUBLE:
+			bulkLoad<double>(relationName, fillFactor, runSize);
+			break;
+		case STRING:
+			bulkLoad<StringKey>(relationName, fillFactor, runSize);
+			break;
+		}
+
+		//the root is known only once the tree is built, so the meta page is filled in last
+		metaPageInfo.rootPageNo = rootPageNum;
+		bufMgr->readPage(file, headerPageNum, metaPage);
+		memcpy((void *) metaPage, &metaPageInfo, sizeof(IndexMetaInfo));
+		bufMgr->unPinPage(file, headerPageNum, true);
+}
+
+// -----------------------------------------------------------------------------
+// keyAt:
+// reads a key of type T from the attribute or search value pointed to by value
+// -----------------------------------------------------------------------------
+
+template <class T>
+static inline T keyAt(const void *value)
+{
+	T key;
+	memcpy((void *) &key, value, sizeof(T));
+	return key;
 }
+
+template <>
+inline StringKey keyAt<StringKey>(const void *value)
+{
+	//strncpy zero fills past the end of a shorter string
+	StringKey key;
+	strncpy(key.data, (const char *) value, STRINGSIZE);
+	return key;
+}
+
+// -----------------------------------------------------------------------------
+// keyBytes:
+// the bytes of a key, under which lookup remembers it
+// -----------------------------------------------------------------------------
+
+template <class T>
+static inline std::string keyBytes(const T &key)
+{
+	return std::string((const char *) &key, sizeof(T));
+}
+
+template <>
+inline std::string keyBytes<double>(const double &key)
+{
+	//-0.0 and 0.0 are the same key
+	const double value = (key == 0) ? 0.0 : key;
+	return std::string((const char *) &value, sizeof(double));
+}
+
 /**
    * Allocate a non leaf node in the buffer
    *
    * @param pageID the page id for the node
    * @return pointer of new non leaf node
    */
-LeafNodeInt *BTreeIndex::allocateLeafNode(PageId &pageID) {
-	LeafNodeInt *newNode;
-	 *newNode = {{},{},0};
-  	bufMgr->allocPage(file, pageID, (Page *&)newNode);
-    	// (LeafNodeInt *)allocateNonLeafNode(pageID);
-  	return &newNode;
+template <class T>
+NonLeafNode<T> *BTreeIndex::allocateNonLeafNode(PageId &pageID, const int level) {
+	NonLeafNode<T> *newNode;
+	shapeVersion++;
+	bufMgr->allocPage(file, pageID, (Page *&)newNode);
+	memset((void *) newNode, 0, Page::SIZE);
+	newNode->header.version = NODE_FORMAT_VERSION;
+	newNode->header.kind = NON_LEAF_NODE;
+	newNode->header.level = level;
+	countLevelPages(level, 1);
+	return newNode;
+}
+
+/**
+   * Allocate a leaf node in the buffer
+   *
+   * @param pageID the page id for the node
+   * @return pointer of new leaf node
+   */
+template <class T>
+LeafNode<T> *BTreeIndex::allocateLeafNode(PageId &pageID) {
+	LeafNode<T> *newNode;
+	shapeVersion++;
+	bufMgr->allocPage(file, pageID, (Page *&)newNode);
+	memset((void *) newNode, 0, Page::SIZE);
+	newNode->header.version = NODE_FORMAT_VERSION;
+	newNode->header.kind = LEAF_NODE;
+	newNode->format(includedBytes);
+	countLevelPages(0, 1);
+	return newNode;
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::~BTreeIndex -- destructor
+// BTreeIndex::copyIncluded
 // -----------------------------------------------------------------------------
 
-BTreeIndex::~BTreeIndex()
+void BTreeIndex::copyIncluded(const char *record, char *included) const
 {
-	bufMgr->flushFile(file);
-    file->~File();
+	for (const IncludedColumn & column : includedColumns) {
+		memcpy(included, record + column.byteOffset, column.size);
+		included += column.size;
+	}
 }
 
-const void BTreeIndex::moveRecordIndex(RecordId recordIdArray[],int size,int index){
-	RecordId lastRecord = recordIdArray[index];
-	RecordId currentRecord;
-	for(int i = index+1; i < size; i++){
-		currentRecord = recordIdArray[i];
-		recordIdArray[i] = lastRecord;
-		lastRecord = currentRecord;
-	}			
-}
-
-const void BTreeIndex::moveRecordIndex_1(RecordId recordIdArray[],int &size,int &index){
-	RecordId lastRecord = recordIdArray[index];
-	RecordId currentRecord;
-	for(int i = index+1; i < size; i++){
-		currentRecord = recordIdArray[i];
-		recordIdArray[i] = lastRecord;
-		lastRecord = currentRecord;
-	}			
-}
-
-
-const void BTreeIndex::moveRecordIndex_2(RecordId recordIdArray[],int &size,int index){
-	RecordId lastRecord = recordIdArray[index];
-	RecordId currentRecord;
-	for(int i = index+1; i < size; i++){
-		currentRecord = recordIdArray[i];
-		recordIdArray[i] = lastRecord;
-		lastRecord = currentRecord;
-	}			
-
-}
-// -----------------------------------------------------------------------------
-// checkOccupancy:
-// checks whether keyArray is full 
-// ------------------------------------------------------------------------------
-const int BTreeIndex::checkOccupancy(int keyArray[],int size,int isLeaf,PageId children[],RecordId records[INTARRAYLEAFSIZE]){
-	if(isLeaf == 1){
-		if(keyArray[size - 1] == 0){
-			if(keyArray[size - 2] == 0){
-				// Case:  {... ,0,0}
-				return 0;
-			}else{
-				//Case: {...,1,0} where 1 is standin for some positive number
-				if(keyArray[size - 2] > 0){
-					return 0;
-				}else{
-					// int temp = 0;
-					if(records[size+1].page_number == 0){
-						//Case: keys = {..., -1, 0}, records = {..., 1, 0}
-						return 0;
-					}else{
-						//Case: keys = {..., -1,0},  records = {..., 1, 1}
-						return 1;
-					}
-				}
-			}
-		}else{
-			//Case {..,1}
-			return 1;
-		}
-	}else{
-		if(keyArray[size - 1] == 0){
-			if(keyArray[size - 2] == 0){
-				// Case:  {... ,0,0}
-				return 0;
-			}else{
-				if(keyArray[size - 2] > 0){
-					//Case: {...,1,0}
-					return 0;
-				}else{
-					if(children[size+1] == 0){
-						//Case: keys = {...,-1,0}, childArray = {..., 0}
-						return 0;
-					}else{
-						//Case: keys = {...,-1,0}, childArray = {...,1}
-						return 1;
-					}
-				}
-			}
-		}else{
-			//Case: {...,1}
-			return 1;
-		}		
-	}
-}
-
-// ------------------------------------------------------------------------------
-// findIndex:
-// returns index at which we should go to next
-// ------------------------------------------------------------------------------
-const int BTreeIndex::findIndex(int keyArray[],int size,int key,RecordId currentRecordArray[],int isLeaf){
-	for(int i = 0; i < size; i++){
-		//Case: The first key from key array that is greater than the key inserted
-		if(keyArray[i] == 0 && keyArray[i+1] == 0){
-			//Take care of an edge case
-			if(isLeaf){ 
-				if(currentRecordArray[i].page_number == 0){
-		 			return i;
-				}else{
-					return i+1;
-				}
-			}else{
-				return i;
+// -----------------------------------------------------------------------------
+// BTreeIndex::writePostingList
+// -----------------------------------------------------------------------------
+
+RecordId BTreeIndex::writePostingList(const std::vector<RecordId> & rids, const std::vector<char> & included)
+{
+	//pages are filled one after the other and linked as they are allocated
+	PageId headPageNo = Page::INVALID_NUMBER;
+	PageId previousPageNo = Page::INVALID_NUMBER;
+	PostingPage *previous = NULL;
+	size_t written = 0;
+	while (written < rids.size()) {
+		PageId pageNo;
+		PostingPage *posting;
+		bufMgr->allocPage(file, pageNo, (Page *&) posting);
+		memset((void *) posting, 0, Page::SIZE);
+		posting->header.version = NODE_FORMAT_VERSION;
+		posting->header.kind = POSTING_NODE;
+		posting->includedBytes = includedBytes;
+		written += posting->encode(rids.data() + written, included.data() + written * includedBytes, rids.size() - written);
+		if (previous == NULL) {
+			headPageNo = pageNo;
+			posting->totalCount = rids.size();
+		} else {
+			previous->nextPageNo = pageNo;
+			bufMgr->unPinPage(file, previousPageNo, true);
+		}
+		previous = posting;
+		previousPageNo = pageNo;
+	}
+	bufMgr->unPinPage(file, previousPageNo, true);
+	return postingListRef(headPageNo);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::readPostingList
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::readPostingList(const PageId headPageNo, std::vector<RecordId> & rids, std::vector<char> * included)
+{
+	rids.clear();
+	if (included != NULL) {
+		included->clear();
+	}
+	PageId pageNo = headPageNo;
+	while (pageNo != Page::INVALID_NUMBER) {
+		Page *page;
+		bufMgr->readPage(file, pageNo, page);
+		PostingPage *posting = (PostingPage *) page;
+		posting->decode(rids, included);
+		PageId nextPageNo = posting->nextPageNo;
+		bufMgr->unPinPage(file, pageNo, false);
+		pageNo = nextPageNo;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::addToPostingList
+// -----------------------------------------------------------------------------
+
+bool BTreeIndex::addToPostingList(const PageId headPageNo, const RecordId rid, const char *included)
+{
+	//The record id belongs on the first page that ends at or after it, or else on the last page
+	std::vector<RecordId> rids;
+	std::vector<char> columns;
+	PageId pageNo = headPageNo;
+	Page *page;
+	PostingPage *posting;
+	while (true) {
+		bufMgr->readPage(file, pageNo, page);
+		posting = (PostingPage *) page;
+		rids.clear();
+		columns.clear();
+		posting->decode(rids, &columns);
+		if (posting->nextPageNo == Page::INVALID_NUMBER || !(rids.back() < rid)) {
+			break;
+		}
+		PageId nextPageNo = posting->nextPageNo;
+		bufMgr->unPinPage(file, pageNo, false);
+		pageNo = nextPageNo;
+	}
+
+	std::vector<RecordId>::iterator position = std::lower_bound(rids.begin(), rids.end(), rid);
+	if (position != rids.end() && *position == rid) {
+		bufMgr->unPinPage(file, pageNo, false);
+		return false;
+	}
+	bool appended = (position == rids.end() && posting->nextPageNo == Page::INVALID_NUMBER);
+	columns.insert(columns.begin() + (position - rids.begin()) * includedBytes, included, included + includedBytes);
+	rids.insert(position, rid);
+	size_t written = posting->encode(rids.data(), columns.data(), rids.size());
+	if (written < rids.size()) {
+		//Case: the page overflows. Record ids added after the end of the list leave it full and start a new
+		//last page, anywhere else the upper half moves to a new page so that both halves have room to grow
+		if (!appended) {
+			written = posting->encode(rids.data(), columns.data(), rids.size() / 2);
+		}
+		PageId newPageNo;
+		PostingPage *newPosting;
+		bufMgr->allocPage(file, newPageNo, (Page *&) newPosting);
+		memset((void *) newPosting, 0, Page::SIZE);
+		newPosting->header.version = NODE_FORMAT_VERSION;
+		newPosting->header.kind = POSTING_NODE;
+		newPosting->includedBytes = includedBytes;
+		newPosting->encode(rids.data() + written, columns.data() + written * includedBytes, rids.size() - written);
+		newPosting->nextPageNo = posting->nextPageNo;
+		posting->nextPageNo = newPageNo;
+		bufMgr->unPinPage(file, newPageNo, true);
+	}
+
+	//the first page keeps the size of the whole list
+	if (pageNo != headPageNo) {
+		bufMgr->unPinPage(file, pageNo, true);
+		pageNo = headPageNo;
+		bufMgr->readPage(file, pageNo, page);
+		posting = (PostingPage *) page;
+	}
+	posting->totalCount++;
+	bufMgr->unPinPage(file, pageNo, true);
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::removeFromPostingList
+// -----------------------------------------------------------------------------
+
+bool BTreeIndex::removeFromPostingList(const PageId headPageNo, const RecordId rid, int & remaining)
+{
+	std::vector<RecordId> rids;
+	std::vector<char> columns;
+	PageId previousPageNo = Page::INVALID_NUMBER;
+	PageId pageNo = headPageNo;
+	Page *page;
+	PostingPage *posting;
+	while (true) {
+		bufMgr->readPage(file, pageNo, page);
+		posting = (PostingPage *) page;
+		rids.clear();
+		columns.clear();
+		posting->decode(rids, &columns);
+		if (posting->nextPageNo == Page::INVALID_NUMBER || !(rids.back() < rid)) {
+			break;
+		}
+		previousPageNo = pageNo;
+		pageNo = posting->nextPageNo;
+		bufMgr->unPinPage(file, previousPageNo, false);
+	}
+
+	std::vector<RecordId>::iterator position = std::lower_bound(rids.begin(), rids.end(), rid);
+	if (position == rids.end() || *position != rid) {
+		bufMgr->unPinPage(file, pageNo, false);
+		return false;
+	}
+	std::vector<char>::iterator columnsStart = columns.begin() + (position - rids.begin()) * includedBytes;
+	columns.erase(columnsStart, columnsStart + includedBytes);
+	rids.erase(position);
+
+	if (!rids.empty()) {
+		//Case: fewer record ids always fit back on the page
+		posting->encode(rids.data(), columns.data(), rids.size());
+	} else if (pageNo != headPageNo) {
+		//Case: an emptied page after the first is unlinked and disposed of
+		PageId nextPageNo = posting->nextPageNo;
+		bufMgr->unPinPage(file, pageNo, false);
+		disposeNode(pageNo);
+		bufMgr->readPage(file, previousPageNo, page);
+		pageNo = previousPageNo;
+		posting = (PostingPage *) page;
+		posting->nextPageNo = nextPageNo;
+	} else if (posting->nextPageNo != Page::INVALID_NUMBER) {
+		//Case: an emptied first page takes over the contents of the second one, so the leaf entry stays valid
+		PageId nextPageNo = posting->nextPageNo;
+		Page *nextPage;
+		bufMgr->readPage(file, nextPageNo, nextPage);
+		PostingPage *next = (PostingPage *) nextPage;
+		int totalCount = posting->totalCount;
+		memcpy((void *) posting, (void *) next, Page::SIZE);
+		posting->totalCount = totalCount;
+		bufMgr->unPinPage(file, nextPageNo, false);
+		disposeNode(nextPageNo);
+	} else {
+		posting->encode(rids.data(), columns.data(), 0);
+	}
+
+	if (pageNo != headPageNo) {
+		bufMgr->unPinPage(file, pageNo, true);
+		pageNo = headPageNo;
+		bufMgr->readPage(file, pageNo, page);
+		posting = (PostingPage *) page;
+	}
+	remaining = --posting->totalCount;
+	bufMgr->unPinPage(file, pageNo, true);
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::freePostingList
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::freePostingList(const PageId headPageNo)
+{
+	PageId pageNo = headPageNo;
+	while (pageNo != Page::INVALID_NUMBER) {
+		Page *page;
+		bufMgr->readPage(file, pageNo, page);
+		PageId nextPageNo = ((PostingPage *) page)->nextPageNo;
+		bufMgr->unPinPage(file, pageNo, false);
+		disposeNode(pageNo);
+		pageNo = nextPageNo;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// RunReader:
+// reads back a sorted run that was spilled to disk by the bulk loader
+// -----------------------------------------------------------------------------
+
+template <class T>
+class RunReader {
+ public:
+	/**
+	 * Number of key-rid pairs, each followed by includedBytes of included columns, stored on each page of a spilled run.
+	 */
+	static int pairsPerPage(const int includedBytes) {
+		return Page::SIZE / (sizeof(RIDKeyPair<T>) + includedBytes);
+	}
+
+	RunReader(const std::string & runName, const int size, const int includedBytes)
+		: file(runName, false), remaining(size), includedBytes(includedBytes), perPage(pairsPerPage(includedBytes)),
+		  position(perPage), pageNo(0) {}
+
+	/**
+	 * Advance to the next pair of the run.
+	 * @return false once the run is exhausted
+	 */
+	bool next() {
+		if (remaining == 0) {
+			return false;
+		}
+		if (position == perPage) {
+			//the run was written as consecutive pages starting at page 1
+			page = file.readPage(++pageNo);
+			position = 0;
+		}
+		//pairs followed by included columns are not aligned, so they are copied out
+		const char *record = reinterpret_cast<const char *>(&page) + position++ * (sizeof(RIDKeyPair<T>) + includedBytes);
+		memcpy((void *) &current, record, sizeof(RIDKeyPair<T>));
+		currentIncluded = record + sizeof(RIDKeyPair<T>);
+		remaining--;
+		return true;
+	}
+
+	RIDKeyPair<T> current;
+
+	/**
+	 * Included columns of current, valid until next is called.
+	 */
+	const char *currentIncluded;
+
+ private:
+	BlobFile file;
+	Page page;
+	int remaining;
+	int includedBytes;
+	int perPage;
+	int position;
+	PageId pageNo;
+};
+
+// -----------------------------------------------------------------------------
+// storeKey:
+// writes a key of type T as the statistics keep it, the way keyAt reads it back
+// -----------------------------------------------------------------------------
+
+template <class T>
+static inline void storeKey(char *bytes, const T &key)
+{
+	memcpy(bytes, (const void *) &key, sizeof(T));
+}
+
+// -----------------------------------------------------------------------------
+// HistogramBuilder:
+// draws the equi-depth buckets of the statistics from keys handed over in order, along with the number of records of
+// each, before the number of records is known
+// -----------------------------------------------------------------------------
+
+template <class T>
+class HistogramBuilder {
+ public:
+	HistogramBuilder() : records(0), step(1) {}
+
+	/**
+	 * Add the records of the next key, which is greater than the previous ones.
+	 */
+	void add(const T &key, const std::uint32_t count) {
+		if (records == 0) {
+			minKey = key;
+		}
+		maxKey = key;
+		//a sample is taken at the key that reaches each multiple of step records
+		std::uint64_t mark = (records / step + 1) * step;
+		records += count;
+		if (records < mark) {
+			return;
+		}
+		samples.push_back(std::make_pair(key, records));
+		//with too many samples every other one goes, and they are taken half as often from then on
+		if (samples.size() > MAXSAMPLES) {
+			for (size_t i = 1; i < samples.size(); i += 2) {
+				samples[i / 2] = samples[i];
 			}
-		}else if(key > keyArray[i]){
-			if(isLeaf){
-				if(currentRecordArray[i].page_number == 0){
-					return i;
-				}else{
-					continue;
-				}
-			}else{
-				return i;
+			samples.resize(samples.size() / 2);
+			step *= 2;
+		}
+	}
+
+	/**
+	 * Set the records, smallest and largest key and buckets of stats from the keys added.
+	 */
+	void finish(IndexStatistics &stats) const {
+		stats.entryCount = records;
+		stats.drawnEntryCount = records;
+		stats.bucketCount = 0;
+		memset(stats.bucketBounds, 0, sizeof(stats.bucketBounds));
+		memset(stats.bucketCounts, 0, sizeof(stats.bucketCounts));
+		if (records == 0) {
+			return;
+		}
+		storeKey(stats.minKey, minKey);
+		storeKey(stats.maxKey, maxKey);
+		std::vector<std::pair<T, std::uint64_t> > points(samples);
+		if (points.empty() || points.back().second < records) {
+			points.push_back(std::make_pair(maxKey, records));
+		}
+		//each bucket ends at the first sample reaching its share of the records; a key with more records than a share
+		//fills a bucket by itself, and the buckets it would have spilled into are left out
+		std::uint64_t below = 0;
+		size_t next = 0;
+		for (int b = 1; b <= HISTOGRAM_BUCKETS; b++) {
+			std::uint64_t share = (records * b + HISTOGRAM_BUCKETS - 1) / HISTOGRAM_BUCKETS;
+			while (points[next].second < share) {
+				next++;
 			}
-		}else if(key == keyArray[i]){
-			throw duplicateKeyException();
-		}else{
-			// Assuming we are i serting an array with actual size + 1  
-			if((i+1) == size){
-				return size;
+			if (points[next].second == below) {
+				continue;
 			}
+			storeKey(stats.bucketBounds[stats.bucketCount], points[next].first);
+			stats.bucketCounts[stats.bucketCount++] = points[next].second - below;
+			below = points[next].second;
 		}
 	}
-	return 0;
+
+ private:
+	/**
+	 * Most samples kept, several per bucket so that the bucket ends fall close to their shares.
+	 */
+	static const size_t MAXSAMPLES = 8 * HISTOGRAM_BUCKETS;
+
+	std::uint64_t records;
+	std::uint64_t step;
+	T minKey;
+	T maxKey;
+
+	/**
+	 * Keys that reached a multiple of step records, with the number of records up to and including them.
+	 */
+	std::vector<std::pair<T, std::uint64_t> > samples;
+};
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::sortRun
+// -----------------------------------------------------------------------------
+
+template <class T>
+void BTreeIndex::sortRun(std::vector<RIDKeyPair<T> > & run, std::vector<char> & included)
+{
+	if (includedBytes == 0) {
+		std::sort(run.begin(), run.end());
+		return;
+	}
+	//the pairs are sorted through their positions, so that the included columns can follow them
+	std::vector<size_t> order(run.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return run[a] < run[b]; });
+	std::vector<RIDKeyPair<T> > sortedRun(run.size());
+	std::vector<char> sortedIncluded(included.size());
+	for (size_t i = 0; i < order.size(); i++) {
+		sortedRun[i] = run[order[i]];
+		std::copy_n(included.begin() + order[i] * includedBytes, includedBytes, sortedIncluded.begin() + i * includedBytes);
+	}
+	run.swap(sortedRun);
+	included.swap(sortedIncluded);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::spillRun
+// -----------------------------------------------------------------------------
+
+template <class T>
+void BTreeIndex::spillRun(const std::vector<RIDKeyPair<T> > & run, const std::vector<char> & included, const std::string & runName)
+{
+	const size_t pairsPerPage = RunReader<T>::pairsPerPage(includedBytes);
+	const size_t recordSize = sizeof(RIDKeyPair<T>) + includedBytes;
+	BlobFile runFile(runName, true);
+	for (size_t first = 0; first < run.size(); first += pairsPerPage) {
+		size_t count = std::min(run.size() - first, pairsPerPage);
+		PageId pageNo;
+		Page page = runFile.allocatePage(pageNo);
+		char *records = reinterpret_cast<char *>(&page);
+		for (size_t i = 0; i < count; i++) {
+			memcpy(records + i * recordSize, (const void *) &run[first + i], sizeof(RIDKeyPair<T>));
+			std::copy_n(included.begin() + (first + i) * includedBytes, includedBytes, records + i * recordSize + sizeof(RIDKeyPair<T>));
+		}
+		runFile.writePage(pageNo, page);
+	}
 }
-// ------------------------------------------------------------------------------
-// moveKeyIndex:
-// We are moving the key array over assuming we have checked occupancy
-// ------------------------------------------------------------------------------
-const void BTreeIndex::moveKeyIndex(int keyArray[],int size,int index){
-	int lastKey = keyArray[index];
-	int currentKey = 0;	
-	for(int i = index+1; i < size-1; i++){
-		currentKey = keyArray[i];
-		keyArray[i] = lastKey;
-		lastKey = currentKey;
-	}		
-}
-
-
-const void BTreeIndex::insertMovePage(PageId tempPage[],PageId childPageId_1,PageId childPageId_2,int size){
-	int index = -1;
-
-	//We assume that childPageId_1 is already present in tempPage	
-	for(int i = 0; i < size; i++){
-		if(tempPage[i] == childPageId_1){
-			index = i; 
-		}	
-	}
-
-	//these are for moving the the ids over
-	PageId lastID = tempPage[index + 1];
-	PageId currentID = 0;
-
-
-	for(int i = index + 1; i < size + 1; i++){
-		currentID = tempPage[i];
-		tempPage[i] = lastID;
-		lastID = currentID;
-	}
-
-	//We finally insert new key into the function
-	tempPage[index + 1] = childPageId_2;
-}
-
-const void BTreeIndex::correctHeight(){
-	// Page *tempPage = 0; 
-	// Page *&newPage = tempPage;
-	// BufMgr->readPage(file,rootPageNum,newPage);
-	// NonLeafNode *currentNode = (NonLeafNode *) newPage;
-	Queue queueList = Queue(&rootPageNum);
-	
-	// int isLeaf = 0;
-	int tempValue = 0;
-	for(int i = 0; i < height - 1; i++){
-		tempValue = (int) pow((INTARRAYNONLEAFSIZE + 1),i+1);
-		PageId currentArray[tempValue] = {};
-		int j = 0;
-		while(!queueList.isEmpty()){
-			PageId current = *((PageId *) queueList.pop());
-			Page *tempPage = 0;
-			Page *&newPage = tempPage;
-			bufMgr->readPage(file,current,newPage);
-			NonLeafNodeInt *currentNode = (NonLeafNodeInt *) newPage;
-			for(int k = j * (INTARRAYNONLEAFSIZE + 1); k < (j + 1) * INTARRAYNONLEAFSIZE; k++){
-				currentArray[k] = currentNode->keyArray[k - (j * (INTARRAYNONLEAFSIZE + 1))];
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::bulkLoad
+// -----------------------------------------------------------------------------
+
+template <class T>
+void BTreeIndex::bulkLoad(const std::string & relationName, const double fillFactor, const int runSize)
+{
+	//Part 1: We collect the pairs of the relation, sorting and spilling every full run
+	std::vector<RIDKeyPair<T> > run;
+	std::vector<char> runIncluded;
+	std::vector<std::string> runNames;
+	std::vector<int> runSizes;
+	{
+		FileScan fileScan(relationName, bufMgr);
+		try {
+			RecordId recordId;
+			while (true) {
+				fileScan.scanNext(recordId);
+				std::string recordStr = fileScan.getRecord();
+				const char *record = recordStr.c_str();
+				RIDKeyPair<T> pair;
+				pair.set(recordId, keyAt<T>(record + attrByteOffset));
+				run.push_back(pair);
+				runIncluded.resize(run.size() * includedBytes);
+				copyIncluded(record, runIncluded.data() + (run.size() - 1) * includedBytes);
+				if ((int) run.size() == runSize) {
+					sortRun<T>(run, runIncluded);
+					std::ostringstream runName;
+					runName << file->filename() << ".run" << runNames.size();
+					runNames.push_back(runName.str());
+					runSizes.push_back(run.size());
+					spillRun<T>(run, runIncluded, runNames.back());
+					run.clear();
+					runIncluded.clear();
+				}
 			}
-			if(i != 0){
-				currentNode->level++;
+		} catch (EndOfFileException e) {}
+	}
+	sortRun<T>(run, runIncluded);
+
+	//Part 2: We hand the pairs over in key order, straight from memory or through a merge of the runs
+	if (runNames.empty()) {
+		//Case: everything fit in memory
+		size_t next = 0;
+		buildFromSorted<T>([&](RIDKeyPair<T> & pair, char *included) {
+			if (next == run.size()) {
+				return false;
 			}
+			std::copy_n(runIncluded.begin() + next * includedBytes, includedBytes, included);
+			pair = run[next++];
+			return true;
+		}, fillFactor);
+		return;
+	}
+
+	//Case: the last run is spilled as well and all runs are merged with a heap of run heads
+	std::ostringstream runName;
+	runName << file->filename() << ".run" << runNames.size();
+	runNames.push_back(runName.str());
+	runSizes.push_back(run.size());
+	spillRun<T>(run, runIncluded, runNames.back());
+	std::vector<RIDKeyPair<T> >().swap(run);
+	std::vector<char>().swap(runIncluded);
+
+	std::vector<RunReader<T> *> readers;
+	typedef std::pair<RIDKeyPair<T>, size_t> RunHead;
+	auto headGreater = [](const RunHead & a, const RunHead & b) { return b.first < a.first; };
+	std::priority_queue<RunHead, std::vector<RunHead>, decltype(headGreater)> heads(headGreater);
+	for (size_t i = 0; i < runNames.size(); i++) {
+		readers.push_back(new RunReader<T>(runNames[i], runSizes[i], includedBytes));
+		if (readers[i]->next()) {
+			heads.push(RunHead(readers[i]->current, i));
 		}
-		for(int k = 0; k < pow((INTARRAYNONLEAFSIZE + 1),i+1); k++){
-			queueList.pushNode(&currentArray[k]);
+	}
+	buildFromSorted<T>([&](RIDKeyPair<T> & pair, char *included) {
+		if (heads.empty()) {
+			return false;
+		}
+		RunHead head = heads.top();
+		heads.pop();
+		pair = head.first;
+		//each run has a single head in the heap, so its reader is still on that pair
+		std::copy_n(readers[head.second]->currentIncluded, includedBytes, included);
+		if (readers[head.second]->next()) {
+			heads.push(RunHead(readers[head.second]->current, head.second));
 		}
+		return true;
+	}, fillFactor);
+	for (size_t i = 0; i < runNames.size(); i++) {
+		delete readers[i];
+		File::remove(runNames[i]);
 	}
 }
 
-const int BTreeIndex::split_1(NonLeafNodeInt *&childNode,int isLeaf, PageId &newID,PageId &currentId,int &keyValue, RecordId rid,PageId& childPageId_1,PageId& childPageId_2){
-	try{
-		if(isLeaf){
-			//The case that inserted node is a leaf node
-			LeafNodeInt * childNode_1 = (LeafNodeInt *) childNode;
-			int size = INTARRAYLEAFSIZE;
-			
-			// Temp arrrays that will be eventually split
-			int tempKeyArray[INTARRAYLEAFSIZE+1] = {};
-			RecordId tempRecord[INTARRAYLEAFSIZE+1] = {};
-
-			//Placement the new values into a temporay array that is larger than the node keya array size 
-			for(int i = 0; i < size; i++){
-			
-				tempKeyArray[i] = childNode_1->keyArray[i];
-				tempRecord[i] = childNode_1->ridArray[i];
-			}
-			//Then we can use the find index function to help find the index where to insert the key
-			int index = findIndex(tempKeyArray,size, keyValue,tempRecord,1);		
-			
-
-			//Now we are going to move the key and or the record over 
-			moveKeyIndex(tempKeyArray,size + 1,index);
-			moveRecordIndex(tempRecord,size + 1,index);
-
-			//We then set the value of the temp arrays to the value because we moved everything over
-			tempRecord[index] = rid;
-			tempKeyArray[index] = keyValue;
-
-			//Now we can calculate the split index
-			//example: {5,8,10,12,15,17}
-			//size = 5, spIndex = (5+1)/2 + (5 + 1)%2 = 3
-			// tempKeyArray[spIndex] = 12
-			// resulting key arrays:
-			// child_key_1 = {5,8,10}, child_key_2 = {12,15,17}
-			
-			//Part 1: We look at the left side of the split 
-			int spIndex = (size + 1)/2 + (size + 1)%2;
-			// RecordId recordIdArray_1[size] = {};
-			// int keyArray_1[size] = {}; 
-			LeafNodeInt leafNode_1 = {{},{}, newID};
-			for(int i = 0; i < spIndex; i++){
-				leafNode_1.ridArray[i] = tempRecord[i];
-				leafNode_1.keyArray[i] =  tempKeyArray[i];
+// -----------------------------------------------------------------------------
+// BTreeIndex::buildFromSorted
+// -----------------------------------------------------------------------------
+
+template <class T>
+void BTreeIndex::buildFromSorted(const std::function<bool (RIDKeyPair<T> &, char *)> & nextPair, const double fillFactor)
+{
+	//Part 1: We write the leaves from left to right, remembering the separator in front of each one
+	std::vector<PageKeyPair<T> > children;
+	LeafNode<T> *leaf = NULL;
+	PageId leafPageNo = 0;
+	RIDKeyPair<T> pair;
+	T lastKey = T();
+	std::vector<RecordId> rids;
+	std::vector<char> included;
+	std::vector<char> pairIncluded(includedBytes);
+	//the statistics are gathered along the way, the nodes counted as they are allocated
+	memset((void *) &metaPageInfo.statistics, 0, sizeof(IndexStatistics));
+	HistogramBuilder<T> histogram;
+	bool more = nextPair(pair, pairIncluded.data());
+	while (more) {
+		//the record ids of a key arrive one after the other and go into the leaf as a single entry
+		T key = pair.key;
+		rids.clear();
+		included.clear();
+		do {
+			rids.push_back(pair.rid);
+			included.insert(included.end(), pairIncluded.begin(), pairIncluded.end());
+			more = nextPair(pair, pairIncluded.data());
+		} while (more && pair.key == key);
+		histogram.add(key, rids.size());
+		RecordId rid = (rids.size() == 1) ? rids[0] : writePostingList(rids, included);
+
+		//an entry pointing to a posting list does not use its included columns, the list holds those of every record
+		if (leaf == NULL || !leaf->append(key, rid, included.data(), fillFactor)) {
+			PageId newPageNo;
+			LeafNode<T> *newLeaf = allocateLeafNode<T>(newPageNo);
+			PageKeyPair<T> child;
+			child.set(newPageNo, (leaf == NULL) ? key : shortestSeparator(lastKey, key));
+			children.push_back(child);
+			if (leaf != NULL) {
+				leaf->rightSibPageNo = newPageNo;
+				newLeaf->leftSibPageNo = leafPageNo;
+				bufMgr->unPinPage(file, leafPageNo, true);
 			}
+			leaf = newLeaf;
+			leafPageNo = newPageNo;
+			//an empty leaf always takes its first entry
+			leaf->append(key, rid, included.data(), fillFactor);
+		}
+		lastKey = key;
+	}
+
+	//Edge Case: an empty relation still gets an (empty) leaf as its root
+	if (leaf == NULL) {
+		leaf = allocateLeafNode<T>(leafPageNo);
+		PageKeyPair<T> child;
+		child.set(leafPageNo, T());
+		children.push_back(child);
+	}
+	bufMgr->unPinPage(file, leafPageNo, true);
 
+	//Part 2: We stack non leaf levels on top until a single node, the root, is left
+	height = 1;
+	while (children.size() > 1) {
+		buildNonLeafLevel<T>(children, height, fillFactor);
+		height++;
+	}
+	rootPageNum = children[0].pageNo;
+	metaPageInfo.statistics.height = height;
+	histogram.finish(metaPageInfo.statistics);
+	metaPageInfo.statisticsKept = 1;
+	statisticsChanged = true;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::buildNonLeafLevel
+// -----------------------------------------------------------------------------
 
-			//Part 2: We look at the right side of the split
-			
-			LeafNodeInt leafNode_2 = {{},{},childNode_1->rightSibPageNo};
-			for(int i = spIndex; i < size + 1; i++){
-				leafNode_2.ridArray[i - spIndex] = tempRecord[i];
-				leafNode_2.keyArray[i - spIndex] = tempKeyArray[i];
+template <class T>
+void BTreeIndex::buildNonLeafLevel(std::vector<PageKeyPair<T> > & children, const int level, const double fillFactor)
+{
+	std::vector<PageKeyPair<T> > parents;
+	size_t next = 0;
+	while (next < children.size()) {
+		PageId pageNo;
+		NonLeafNode<T> *node = allocateNonLeafNode<T>(pageNo, level);
+		node->reset(children[next].pageNo);
+		PageKeyPair<T> parent;
+		parent.set(pageNo, children[next].key);
+		parents.push_back(parent);
+		next++;
+
+		//the separator in front of each child goes into the node along with it
+		while (next < children.size() && node->append(children[next].key, children[next].pageNo, fillFactor)) {
+			next++;
+		}
+		//A node is never left with a single child at the end of the level
+		if (children.size() - next == 1) {
+			if (node->append(children[next].key, children[next].pageNo, 1.0)) {
+				next++;
+			} else {
+				node->popBack();
+				next--;
 			}
+		}
+		bufMgr->unPinPage(file, pageNo, true);
+	}
+	children.swap(parents);
+}
+
+// -----------------------------------------------------------------------------
+// Version 1 node layouts, only read when an old index file is upgraded
+// -----------------------------------------------------------------------------
+
+static const int INTARRAYLEAFSIZE_V1 = ( Page::SIZE - sizeof( PageId ) ) / ( sizeof( int ) + sizeof( RecordId ) );
+static const int INTARRAYNONLEAFSIZE_V1 = ( Page::SIZE - sizeof( int ) - sizeof( PageId ) ) / ( sizeof( int ) + sizeof( PageId ) );
 
+struct NonLeafNodeIntV1{
+	int level;		//1 just above the leaves, 0 otherwise
+	int keyArray[ INTARRAYNONLEAFSIZE_V1 ];
+	PageId pageNoArray[ INTARRAYNONLEAFSIZE_V1 + 1 ];
+};
 
-			//Creation of the new leaf nodes 
-			// Design Choice: The right side will be associated with current ID so that there is no need to reasign the
-			// a leaf that is not currently found here
-			
-			Page *newPage_1 = 0; 
-			Page *tempPage_1 = 0;
-			Page *&newPage_2 = tempPage_1;
-			bufMgr->allocPage(file,newID,newPage_2);
-			
-			// PageId temp_test = newID;
+struct LeafNodeIntV1{
+	int keyArray[ INTARRAYLEAFSIZE_V1 ];
+	RecordId ridArray[ INTARRAYLEAFSIZE_V1 ];	//a slot is empty when its page number is 0
+	PageId rightSibPageNo;
+};
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::upgradeNodeFormat
+// -----------------------------------------------------------------------------
 
+void BTreeIndex::upgradeNodeFormat(const PageId oldRootPageNo)
+{
+	File *oldFile = file;
+	const std::string fileName = oldFile->filename();
+	const std::string newFileName = fileName + ".upgrade";
+
+	//Version 1 nodes do not record their kind. The root starts as page 2 and is moved only when it
+	//is split or built above leaves, so page 2 as the root means the root is the only leaf.
+	//Below that, the level of a non leaf is 1 when its children are leaves.
+	PageId leafPageNo = oldRootPageNo;
+	bool aboveLeaves = (oldRootPageNo == 2);
+	while (!aboveLeaves) {
+		Page *page;
+		bufMgr->readPage(oldFile, leafPageNo, page);
+		NonLeafNodeIntV1 *node = reinterpret_cast<NonLeafNodeIntV1 *>(page);
+		aboveLeaves = (node->level == 1);
+		PageId childPageNo = node->pageNoArray[0];
+		bufMgr->unPinPage(oldFile, leafPageNo, false);
+		leafPageNo = childPageNo;
+	}
 
+	//The new tree goes to a file of its own, with the meta page first like any other index file
+	try {
+		File::remove(newFileName);
+	} catch (FileNotFoundException e) {}
+	file = new BlobFile(newFileName, true);
+	Page *metaPage;
+	bufMgr->allocPage(file, headerPageNum, metaPage);
+	bufMgr->unPinPage(file, headerPageNum, true);
+
+	//The old leaf chain is already in key order, so it is streamed straight into the new leaves, without included columns
+	Page *leafPage = NULL;
+	int next = 0;
+	buildFromSorted<int>([&](RIDKeyPair<int> & pair, char *included) {
+		while (true) {
+			if (leafPage == NULL) {
+				if (leafPageNo == 0) {
+					return false;
+				}
+				bufMgr->readPage(oldFile, leafPageNo, leafPage);
+				next = 0;
+			}
+			LeafNodeIntV1 *leaf = reinterpret_cast<LeafNodeIntV1 *>(leafPage);
+			if (next < INTARRAYLEAFSIZE_V1 && leaf->ridArray[next].page_number != 0) {
+				pair.set(leaf->ridArray[next], leaf->keyArray[next]);
+				next++;
+				return true;
+			}
+			PageId siblingPageNo = leaf->rightSibPageNo;
+			bufMgr->unPinPage(oldFile, leafPageNo, false);
+			leafPage = NULL;
+			leafPageNo = siblingPageNo;
+		}
+	}, BULKLOAD_FILL_FACTOR);
+
+	metaPageInfo.rootPageNo = rootPageNum;
+	metaPageInfo.nodeFormatVersion = NODE_FORMAT_VERSION;
+	metaPageInfo.subtreeCounts = 0;
+	metaPageInfo.includedColumnCount = 0;
+	bufMgr->readPage(file, headerPageNum, metaPage);
+	memcpy((void *) metaPage, &metaPageInfo, sizeof(IndexMetaInfo));
+	bufMgr->unPinPage(file, headerPageNum, true);
+
+	//Swap the new file in for the old one
+	bufMgr->flushFile(oldFile);
+	bufMgr->flushFile(file);
+	delete oldFile;
+	delete file;
+	File::remove(fileName);
+	std::rename(newFileName.c_str(), fileName.c_str());
+	file = new BlobFile(fileName, false);
+}
 
-			
-			newPage_1 = (Page *) &leafNode_1;
-			newPage_2 = (Page *) &leafNode_2;
-			
-			//The keys then are writen to the file
-			PageId tempPage = newID;
-			PageId tempPageID = currentId;
-			file->writePage(tempPage,*newPage_1);
-			file->writePage(tempPageID,*newPage_2);
+// -----------------------------------------------------------------------------
+// BTreeIndex::setLeftSibling
+// -----------------------------------------------------------------------------
 
-			//This is the key that got split up
-			return tempKeyArray[spIndex];		
-		}else{
-			//Case when we have a non-leaf node split
+template <class T>
+void BTreeIndex::setLeftSibling(const PageId pageNo, const PageId leftPageNo)
+{
+	//readers of the neighbour must see it change like any other node touched by the split or merge
+	latchNode(pageNo);
+	Page *page;
+	bufMgr->readPage(file, pageNo, page);
+	reinterpret_cast<LeafNode<T> *>(page)->leftSibPageNo = leftPageNo;
+	bufMgr->unPinPage(file, pageNo, true);
+}
 
+// -----------------------------------------------------------------------------
+// BTreeIndex::~BTreeIndex -- destructor
+// -----------------------------------------------------------------------------
 
-			NonLeafNodeInt * childNode_1 = (NonLeafNodeInt *) childNode;
+BTreeIndex::~BTreeIndex()
+{
+	//the leaf of an unfinished scan would keep the file from being flushed
+	if (scanCursor.isScanning()) {
+		scanCursor.endScan();
+	}
+	setInnerNodesResident(false);
+	setSwizzling(false);
+	setConcurrent(false);
+	writeStatistics();
+	bufMgr->flushFile(file);
+    file->~File();
+}
 
-			//We establish the two temp arrays that will be split between the two nodes
-			int tempKeyArray[INTARRAYNONLEAFSIZE + 1] = {};
-			PageId tempPage[INTARRAYNONLEAFSIZE + 2] = {};
+// -----------------------------------------------------------------------------
+// BTreeIndex::setInnerNodesResident
+// -----------------------------------------------------------------------------
 
-			//A transfer of keys from the orign
-			for(int i = 0; i < INTARRAYNONLEAFSIZE; i++){
-				tempKeyArray[i] = childNode_1->keyArray[i];	
-				tempPage[i] = childNode_1->pageNoArray[i];
+void BTreeIndex::setInnerNodesResident(const bool resident)
+{
+	if (resident && !innerNodesResident) {
+		innerNodesResident = true;
+		if (height == 1) {
+			return;
+		}
+		switch (attributeType) {
+		case INTEGER:
+			loadResidentNodes<int>(rootPageNum);
+			break;
+		case DOUBLE:
+			loadResidentNodes<double>(rootPageNum);
+			break;
+		case STRING:
+			loadResidentNodes<StringKey>(rootPageNum);
+			break;
+		}
+	} else if (!resident && innerNodesResident) {
+		innerNodesResident = false;
+		for (PageId pageNo = 0; pageNo < residentNodes.size(); pageNo++) {
+			if (residentNodes[pageNo] != nullptr) {
+				residentNodes[pageNo] = nullptr;
+				bufMgr->unPinPage(file, pageNo, false);
 			}
+		}
+		residentNodes.clear();
+	}
+}
 
+template <class T>
+void BTreeIndex::loadResidentNodes(const PageId pageNo)
+{
+	//reading a non leaf node is enough to keep it
+	NonLeafNode<T> *node = (NonLeafNode<T> *) readNode(pageNo);
+	if (node->header.level > 1) {
+		for (int i = 0; i <= node->header.keyCount; i++) {
+			loadResidentNodes<T>(node->childAt(i));
+		}
+	}
+	releaseNode(pageNo, false);
+}
 
-			// Adding the last pageID to temporary page array
-			tempPage[INTARRAYNONLEAFSIZE] = childNode_1->pageNoArray[INTARRAYNONLEAFSIZE];
+// -----------------------------------------------------------------------------
+// BTreeIndex::readNode
+// -----------------------------------------------------------------------------
 
-			// We find the index where the split should occur and move it
-			int index = findIndex(tempKeyArray,INTARRAYNONLEAFSIZE,keyValue,{},0);
-			moveKeyIndex(tempKeyArray,INTARRAYNONLEAFSIZE,index);
-			
+Page *BTreeIndex::readNode(const PageId pageNo)
+{
+	if (pageNo < residentNodes.size() && residentNodes[pageNo] != nullptr) {
+		return residentNodes[pageNo];
+	}
+	if (pageNo < swizzledFrames.size() && swizzledFrames[pageNo] != NO_FRAME) {
+		return bufMgr->pinFrame(swizzledFrames[pageNo]);
+	}
+	Page *page;
+	bufMgr->readPage(file, pageNo, page);
+	NodeHeader *header = (NodeHeader *) page;
+	if (innerNodesResident && header->kind == NON_LEAF_NODE) {
+		//the pin taken here is never given back while the node stays resident
+		if (pageNo >= residentNodes.size()) {
+			residentNodes.resize(pageNo + 1, nullptr);
+		}
+		residentNodes[pageNo] = page;
+	} else if (swizzling) {
+		//the buffer pool tells forgetFrame when the page leaves its frame
+		if (pageNo >= swizzledFrames.size()) {
+			swizzledFrames.resize(pageNo + 1, NO_FRAME);
+		}
+		swizzledFrames[pageNo] = bufMgr->frameOf(page);
+	}
+	return page;
+}
 
+void BTreeIndex::releaseNode(const PageId pageNo, const bool dirty)
+{
+	if (pageNo < residentNodes.size() && residentNodes[pageNo] != nullptr) {
+		if (dirty) {
+			//the buffer pool only learns about changes when a page is unpinned
+			FrameId frameNo = bufMgr->frameOf(residentNodes[pageNo]);
+			bufMgr->pinFrame(frameNo);
+			bufMgr->unPinFrame(frameNo, true);
+		}
+		return;
+	}
+	if (pageNo < swizzledFrames.size() && swizzledFrames[pageNo] != NO_FRAME) {
+		bufMgr->unPinFrame(swizzledFrames[pageNo], dirty);
+		return;
+	}
+	bufMgr->unPinPage(file, pageNo, dirty);
+}
 
-			//This is making sure the pageid is moving over and we are inserting the new one
-			insertMovePage(tempPage,childPageId_1,childPageId_2,INTARRAYNONLEAFSIZE + 1);
-			
+const FrameId BTreeIndex::NO_FRAME;
 
-			//We calculate the index for the split 
-			int spIndex = INTARRAYNONLEAFSIZE/2 + INTARRAYNONLEAFSIZE%2;
+// -----------------------------------------------------------------------------
+// BTreeIndex::setSwizzling
+// -----------------------------------------------------------------------------
 
+void BTreeIndex::setSwizzling(const bool swizzle)
+{
+	if (swizzle && !swizzling) {
+		bufMgr->setEvictionHandler(file, [this](const PageId pageNo) { forgetFrame(pageNo); });
+	} else if (!swizzle && swizzling) {
+		bufMgr->setEvictionHandler(file, std::function<void (const PageId)>());
+		swizzledFrames.clear();
+	}
+	swizzling = swizzle;
+}
 
-			
-			NonLeafNodeInt childNode_1_1 = {{},{},childPageId_1};
-			NonLeafNodeInt childNode_2 = {{},{},childPageId_2};
-																	 
-			//Part 1: We split the left
-			for(int i = 0; i < spIndex; i++){
-				childNode_1_1.keyArray[i] = tempKeyArray[i];
-				childNode_1_1.pageNoArray[i] = tempPage[i];
-			}
-			childNode_1_1.pageNoArray[spIndex] = tempPage[spIndex];
-			
-			
-
-			//We split the right
-			for(int i = spIndex + 1; i < INTARRAYNONLEAFSIZE; i++){
-				childNode_2.keyArray[i-(spIndex + 1)] = tempKeyArray[i];
-				childNode_2.pageNoArray[i - (spIndex + 1)] = tempPage[i];
-			}
-			childNode_2.pageNoArray[INTARRAYNONLEAFSIZE - spIndex + 1] = tempPage[INTARRAYNONLEAFSIZE];
-			
-			//Writing your pages
-			Page *tempPage_2 = 0;
-			Page *&newPage_1 = tempPage_2;
-			bufMgr->allocPage(file,newID,newPage_1);
-			//for consistency the currentId is associated with the left side of the split while the newID is associated with the right side of the split
-			newPage_1 = (Page *) &childNode_1_1;	
-			PageId tempPageId = currentId;	
-			file->writePage(tempPageId,*newPage_1);
-			newPage_1 = (Page *) &childNode_2;
-			PageId tempId_2 = newID;
-			file->writePage(tempId_2,*newPage_1);
-
-			//We return the key
-			return tempKeyArray[spIndex];		
-		}
-	} catch(duplicateKeyException e){
-		throw duplicateKeyException();
-	}
-}
-
-const int BTreeIndex::split(void *childNode,int isLeaf, PageId &newID,PageId currentId,int keyValue, RecordId rid,PageId childPageId_1,PageId childPageId_2){
-	// this->file;
-	try{
-		if(isLeaf){
-			//The case that inserted node is a leaf node
-			LeafNodeInt * childNode_1 = (LeafNodeInt *) childNode;
-			int size = INTARRAYLEAFSIZE;
-			
-			// Temp arrrays that will be eventually split
-			int tempKeyArray[INTARRAYLEAFSIZE+1] = {};
-			RecordId tempRecord[INTARRAYLEAFSIZE+1] = {};
-
-			//Placement the new values into a temporay array that is larger than the node keya array size 
-			for(int i = 0; i < size; i++){
-			
-				tempKeyArray[i] = childNode_1->keyArray[i];
-				tempRecord[i] = childNode_1->ridArray[i];
-			}
-			//Then we can use the find index function to help find the index where to insert the key
-			int index = findIndex(tempKeyArray,size, keyValue,tempRecord,1);		
-			
-
-			//Now we are going to move the key and or the record over 
-			moveKeyIndex(tempKeyArray,size + 1,index);
-			moveRecordIndex(tempRecord,size + 1,index);
-
-			//We then set the value of the temp arrays to the value because we moved everything over
-			tempRecord[index] = rid;
-			tempKeyArray[index] = keyValue;
-
-			//Now we can calculate the split index
-			//example: {5,8,10,12,15,17}
-			//size = 5, spIndex = (5+1)/2 + (5 + 1)%2 = 3
-			// tempKeyArray[spIndex] = 12
-			// resulting key arrays:
-			// child_key_1 = {5,8,10}, child_key_2 = {12,15,17}
-			
-			//Part 1: We look at the left side of the split 
-			int spIndex = (size + 1)/2 + (size + 1)%2;
-			// RecordId recordIdArray_1[size] = {};
-			// int keyArray_1[size] = {}; 
-			LeafNodeInt leafNode_1 = {{},{}, newID};
-			for(int i = 0; i < spIndex; i++){
-				leafNode_1.ridArray[i] = tempRecord[i];
-				leafNode_1.keyArray[i] =  tempKeyArray[i];
-			}
+void BTreeIndex::forgetFrame(const PageId pageNo)
+{
+	if (pageNo < swizzledFrames.size()) {
+		swizzledFrames[pageNo] = NO_FRAME;
+	}
+}
+
+void BTreeIndex::disposeNode(const PageId pageNo)
+{
+	shapeVersion++;
+	if (concurrent) {
+		//another operation may be on its way to the page
+		retiredPages.push_back(pageNo);
+		return;
+	}
+	if (pageNo < residentNodes.size() && residentNodes[pageNo] != nullptr) {
+		residentNodes[pageNo] = nullptr;
+		bufMgr->unPinPage(file, pageNo, false);
+	}
+	bufMgr->disposePage(file, pageNo);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::splitLeaf
+// -----------------------------------------------------------------------------
+template <class T>
+PageKeyPair<T> BTreeIndex::splitLeaf(LeafNode<T> *leaf, const PageId leafPageNo, const int index, const T key, const RecordId rid,
+		const char *included, const bool rightmost)
+{
+	// Temp arrrays that hold the full leaf plus the new entry
+	int count = leaf->header.keyCount;
+	std::vector<T> tempKeyArray(count + 1);
+	std::vector<RecordId> tempRecord(count + 1);
+	std::vector<char> tempIncluded((count + 1) * includedBytes);
+	for (int i = 0, j = 0; j <= count; j++) {
+		if (j == index) {
+			tempKeyArray[j] = key;
+			tempRecord[j] = rid;
+			std::copy_n(included, includedBytes, tempIncluded.begin() + j * includedBytes);
+		} else {
+			tempKeyArray[j] = leaf->keyAt(i);
+			tempRecord[j] = leaf->ridAt(i);
+			std::copy_n(leaf->includedAt(i), includedBytes, tempIncluded.begin() + j * includedBytes);
+			i++;
+		}
+	}
+
+	//example: {5,8,10,12,15,17}, spIndex = 3
+	// left = {5,8,10} stays in place, right = {12,15,17} moves to the new page and 12 goes up
+	int spIndex = (count + 1) / 2;
+	if (rightmost && index == count) {
+		//keys arriving in increasing order would leave every leaf half empty, so the left one keeps most of them
+		spIndex = std::max(1, std::min(count, (int) ((count + 1) * appendSplitFraction)));
+		if (!leaf->fits(tempKeyArray.data(), spIndex) || !leaf->fits(tempKeyArray.data() + spIndex, count + 1 - spIndex)) {
+			//the new key may need wider INTEGER offsets, so the larger side may not fit and the leaf is halved instead
+			spIndex = (count + 1) / 2;
+		}
+	}
+	PageId newPageNo;
+	LeafNode<T> *newLeaf = allocateLeafNode<T>(newPageNo);
+	newLeaf->load(tempKeyArray.data() + spIndex, tempRecord.data() + spIndex, tempIncluded.data() + spIndex * includedBytes,
+			count + 1 - spIndex);
+	newLeaf->rightSibPageNo = leaf->rightSibPageNo;
+
+	newLeaf->leftSibPageNo = leafPageNo;
+	if (newLeaf->rightSibPageNo != Page::INVALID_NUMBER) {
+		setLeftSibling<T>(newLeaf->rightSibPageNo, newPageNo);
+	}
+
+	leaf->load(tempKeyArray.data(), tempRecord.data(), tempIncluded.data(), spIndex);
+	leaf->rightSibPageNo = newPageNo;
+	bufMgr->unPinPage(file, newPageNo, true);
+
+	PageKeyPair<T> pushUp;
+	pushUp.set(newPageNo, shortestSeparator(tempKeyArray[spIndex - 1], tempKeyArray[spIndex]));
+	return pushUp;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::splitNonLeaf
+// -----------------------------------------------------------------------------
+template <class T>
+PageKeyPair<T> BTreeIndex::splitNonLeaf(NonLeafNode<T> *node, const int index, const PageKeyPair<T> entry, const std::uint32_t entryCount,
+		const bool rightmost)
+{
+	// Temp arrays that hold the full node plus the new separator and child
+	int count = node->header.keyCount;
+	std::vector<T> tempKeyArray(count + 1);
+	std::vector<PageId> tempPage(count + 2);
+	std::vector<std::uint32_t> tempCount(count + 2);
+	tempPage[0] = node->childAt(0);
+	tempCount[0] = node->countAt(0);
+	for (int i = 0, j = 0; j <= count; j++) {
+		if (j == index) {
+			tempKeyArray[j] = entry.key;
+			tempPage[j + 1] = entry.pageNo;
+			tempCount[j + 1] = entryCount;
+		} else {
+			tempKeyArray[j] = node->keyAt(i);
+			tempPage[j + 1] = node->childAt(i + 1);
+			tempCount[j + 1] = node->countAt(i + 1);
+			i++;
+		}
+	}
+
+	//The middle key moves up: the left keeps spIndex keys, the right gets the rest after the middle one
+	int spIndex = (count + 1) / 2;
+	if (rightmost && index == count) {
+		spIndex = std::max(1, std::min(count - 1, (int) (count * appendSplitFraction)));
+	}
+	PageId newPageNo;
+	NonLeafNode<T> *newNode = allocateNonLeafNode<T>(newPageNo, node->header.level);
+	newNode->load(tempKeyArray.data() + spIndex + 1, tempPage.data() + spIndex + 1, tempCount.data() + spIndex + 1, count - spIndex);
+
+	node->load(tempKeyArray.data(), tempPage.data(), tempCount.data(), spIndex);
+	bufMgr->unPinPage(file, newPageNo, true);
+
+	PageKeyPair<T> pushUp;
+	pushUp.set(newPageNo, tempKeyArray[spIndex]);
+	return pushUp;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::growRoot
+// -----------------------------------------------------------------------------
+template <class T>
+void BTreeIndex::growRoot(const PageKeyPair<T> entry)
+{
+	/**
+	// example:        | 7 |
+	//                /     \
+	//	  	 | 3 | 5 |       | 7 | 10 | 20 |
+	*/
+	PageId newRootNum;
+	NonLeafNode<T> *newRoot = allocateNonLeafNode<T>(newRootNum, height);
+	PageId children[2] = {rootPageNum, entry.pageNo};
+	std::uint32_t counts[2] = {0, 0};
+	if (subtreeCounts) {
+		counts[0] = subtreeRecords<T>(rootPageNum);
+		counts[1] = subtreeRecords<T>(entry.pageNo);
+	}
+	newRoot->load(&entry.key, children, counts, 1);
+	bufMgr->unPinPage(file, newRootNum, true);
+
+	//We then maintain some externals
+	recordRoot(newRootNum, height + 1);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::recordRoot
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::recordRoot(const PageId pageNo, const int newHeight)
+{
+	latchNode(headerPageNum);
+	//optimistic readers load both within the meta page latch, which orders them
+	rootPageNum.store(pageNo, std::memory_order_release);
+	height.store(newHeight, std::memory_order_release);
+	Page *metaPage;
+	bufMgr->readPage(file, headerPageNum, metaPage);
+	IndexMetaInfo *metaInfo = reinterpret_cast<IndexMetaInfo *>(metaPage);
+	metaInfo->rootPageNo = rootPageNum;
+	metaPageInfo.rootPageNo = rootPageNum;
+	//the height only changes along with the root
+	metaInfo->statistics.height = height;
+	metaPageInfo.statistics.height = height;
+	bufMgr->unPinPage(file, headerPageNum, true);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::insertEntry
+// -----------------------------------------------------------------------------
+
+const void BTreeIndex::insertEntry(const void *key, const RecordId rid, const void *record)
+{
+	//the included columns are copied out of the record once, the tree only moves them around
+	if (includedBytes > 0 && record == nullptr) {
+		throw BadIndexInfoException(file->filename());
+	}
+	char included[MAX_INCLUDED_BYTES];
+	copyIncluded((const char *) record, included);
+
+	//The key type is picked once here, everything below works on typed nodes
+	switch (attributeType) {
+	case INTEGER:
+		if (concurrent ? insertConcurrent<int>(keyAt<int>(key), rid, included)
+				: insertKey<int>(keyAt<int>(key), rid, included)) {
+			countEntry<int>(keyAt<int>(key), 1);
+		}
+		break;
+	case DOUBLE:
+		if (concurrent ? insertConcurrent<double>(keyAt<double>(key), rid, included)
+				: insertKey<double>(keyAt<double>(key), rid, included)) {
+			countEntry<double>(keyAt<double>(key), 1);
+		}
+		break;
+	case STRING:
+		if (concurrent ? insertConcurrent<StringKey>(keyAt<StringKey>(key), rid, included)
+				: insertKey<StringKey>(keyAt<StringKey>(key), rid, included)) {
+			countEntry<StringKey>(keyAt<StringKey>(key), 1);
+		}
+		break;
+	}
+	redrawStaleHistogram();
+}
+
+// -----------------------------------------------------------------------------
+// pairPostingList:
+// record ids and included columns of a new posting list for two records of the same key
+// -----------------------------------------------------------------------------
+
+static void pairPostingList(const RecordId existing, const char *existingIncluded, const RecordId rid, const char *included,
+		const int includedBytes, std::vector<RecordId> &rids, std::vector<char> &columns)
+{
+	rids = {existing, rid};
+	columns.assign(existingIncluded, existingIncluded + includedBytes);
+	columns.insert(columns.end(), included, included + includedBytes);
+	//posting lists are kept in record id order
+	if (rid < existing) {
+		std::swap(rids[0], rids[1]);
+		std::rotate(columns.begin(), columns.begin() + includedBytes, columns.end());
+	}
+}
+
+template <class T>
+bool BTreeIndex::insertKey(const T keyValue, const RecordId rid, const char *included)
+{
+	if (!lookupCache.empty()) {
+		forgetLookup(keyBytes(keyValue));
+	}
+
+	// The non leaf nodes visited on the way down and the child taken in each, so that splits can be pushed back up
+	std::vector<PageId> path;
+	std::vector<int> childIndex;
+	PageId currentId = rootPageNum;
+	bool rightmost = true;
+	if (!concurrent && rightmostLeafPageNo != Page::INVALID_NUMBER && rightmostVersion == shapeVersion
+			&& pastRightmost<T>(keyValue)) {
+		//Case: the key goes after every key of the index, the path to the right-most leaf is known already
+		path = rightmostPath;
+		childIndex = rightmostChildIndex;
+		currentId = rightmostLeafPageNo;
+	} else {
+		for (int i = 1; i < height; i++) {
+			NonLeafNode<T> *node = (NonLeafNode<T> *) readNode(currentId);
+			//keys equal to a separator live in the child on its right
+			int position = node->upperBound(keyValue);
+			rightmost = rightmost && position == node->header.keyCount;
+			path.push_back(currentId);
+			childIndex.push_back(position);
+			PageId nextId = node->childAt(position);
+			releaseNode(currentId, false);
+			currentId = nextId;
+		}
+		if (rightmost && !concurrent) {
+			rightmostPath = path;
+			rightmostChildIndex = childIndex;
+			rightmostLeafPageNo = currentId;
+			rightmostVersion = shapeVersion;
+		}
+	}
+
+	latchNode(currentId);
+	LeafNode<T> *leaf = (LeafNode<T> *) readNode(currentId);
+	int index = leaf->lowerBound(keyValue);
+	if (index < leaf->header.keyCount && leaf->keyAt(index) == keyValue) {
+		//Case: the key is already indexed, the record id joins its posting list
+		RecordId existing = leaf->ridAt(index);
+		bool added = false;
+		bool dirty = false;
+		if (isPostingList(existing)) {
+			added = addToPostingList(existing.page_number, rid, included);
+		} else if (existing != rid) {
+			std::vector<RecordId> rids;
+			std::vector<char> columns;
+			pairPostingList(existing, leaf->includedAt(index), rid, included, includedBytes, rids, columns);
+			leaf->setRidAt(index, writePostingList(rids, columns));
+			added = true;
+			dirty = true;
+		}
+		releaseNode(currentId, dirty);
+		if (added) {
+			addToCounts<T>(path, childIndex, 1);
+		}
+		return added;
+	}
+
+	if (leaf->insertAt(index, keyValue, rid, included)) {
+		//Case: the leaf had room for the entry
+		releaseNode(currentId, true);
+		addToCounts<T>(path, childIndex, 1);
+		return true;
+	}
+
+	//Case: the leaf is full, split it and push the new separator up as far as needed
+	PageKeyPair<T> pushUp = splitLeaf<T>(leaf, currentId, index, keyValue, rid, included, rightmost);
+	releaseNode(currentId, true);
+	//the parent counted the split node, new record included, as one child; the part that moved is taken off it
+	std::uint32_t pushUpCount = subtreeCounts ? subtreeRecords<T>(pushUp.pageNo) : 0;
+	while (!path.empty()) {
+		PageId parentId = path.back();
+		int position = childIndex.back();
+		path.pop_back();
+		childIndex.pop_back();
+		latchNode(parentId);
+		NonLeafNode<T> *parent = (NonLeafNode<T> *) readNode(parentId);
+		parent->setCountAt(position, parent->countAt(position) + 1 - pushUpCount);
+		if (parent->insertAt(position, pushUp.key, pushUp.pageNo, pushUpCount)) {
+			releaseNode(parentId, true);
+			addToCounts<T>(path, childIndex, 1);
+			return true;
+		}
+		pushUp = splitNonLeaf<T>(parent, position, pushUp, pushUpCount, rightmost);
+		releaseNode(parentId, true);
+		pushUpCount = subtreeCounts ? subtreeRecords<T>(pushUp.pageNo) : 0;
+	}
+
+	//Case: the root itself was split
+	growRoot<T>(pushUp);
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::pastRightmost
+// -----------------------------------------------------------------------------
+
+template <class T>
+bool BTreeIndex::pastRightmost(const T keyValue)
+{
+	LeafNode<T> *leaf = (LeafNode<T> *) readNode(rightmostLeafPageNo);
+	const int count = leaf->header.keyCount;
+	//an empty leaf gives no bound to compare with
+	bool past = count > 0 && leaf->keyAt(count - 1) < keyValue;
+	releaseNode(rightmostLeafPageNo, false);
+	return past;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::setAppendSplitFraction
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::setAppendSplitFraction(const double fraction)
+{
+	appendSplitFraction = fraction;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::setScanReadahead
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::setScanReadahead(const int leaves)
+{
+	scanReadahead = std::max(0, leaves);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::insertBatch
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::insertBatch(const void *keys, const RecordId *rids, const size_t n, const void *const *records)
+{
+	if (includedBytes > 0 && records == nullptr) {
+		throw BadIndexInfoException(file->filename());
+	}
+	switch (attributeType) {
+	case INTEGER:
+		insertBatchKeys<int>((const char *) keys, sizeof(int), rids, n, records);
+		break;
+	case DOUBLE:
+		insertBatchKeys<double>((const char *) keys, sizeof(double), rids, n, records);
+		break;
+	case STRING:
+		insertBatchKeys<StringKey>((const char *) keys, STRINGSIZE, rids, n, records);
+		break;
+	}
+	redrawStaleHistogram();
+}
+
+template <class T>
+void BTreeIndex::insertBatchKeys(const char *keys, const size_t stride, const RecordId *rids, const size_t n,
+		const void *const *records)
+{
+	std::vector<char> included(n * includedBytes);
+	for (size_t i = 0; includedBytes > 0 && i < n; i++) {
+		copyIncluded((const char *) records[i], included.data() + i * includedBytes);
+	}
+	if (concurrent) {
+		//other writers may split any leaf between two entries, so each one finds its own way down
+		for (size_t i = 0; i < n; i++) {
+			if (insertConcurrent<T>(keyAt<T>(keys + i * stride), rids[i], included.data() + i * includedBytes)) {
+				countEntry<T>(keyAt<T>(keys + i * stride), 1);
+			}
+		}
+		return;
+	}
+
+	//each entry remembers where its record id and included columns are
+	std::vector<std::pair<T, size_t> > entries(n);
+	for (size_t i = 0; i < n; i++) {
+		entries[i] = std::make_pair(keyAt<T>(keys + i * stride), i);
+	}
+	std::sort(entries.begin(), entries.end(), [rids](const std::pair<T, size_t> & a, const std::pair<T, size_t> & b) {
+		return a.first < b.first || (a.first == b.first && rids[a.second] < rids[b.second]);
+	});
+
+	const std::pair<T, size_t> *next = entries.data();
+	const std::pair<T, size_t> *end = entries.data() + n;
+	while (next != end) {
+		//one descent for the first entry finds its leaf, and the closest separator on its right bounds the entries
+		//that go to the same leaf
+		std::vector<PageId> path;
+		std::vector<int> childIndex;
+		PageId currentId = rootPageNum;
+		bool bounded = false;
+		T fence = next->first;
+		for (int i = 1; i < height; i++) {
+			NonLeafNode<T> *node = (NonLeafNode<T> *) readNode(currentId);
+			int position = node->upperBound(next->first);
+			if (position < node->header.keyCount) {
+				fence = node->keyAt(position);
+				bounded = true;
+			}
+			path.push_back(currentId);
+			childIndex.push_back(position);
+			PageId nextId = node->childAt(position);
+			releaseNode(currentId, false);
+			currentId = nextId;
+		}
+		const std::pair<T, size_t> *last = next + 1;
+		while (last != end && (!bounded || last->first < fence)) {
+			last++;
+		}
+		mergeIntoLeaf<T>(currentId, path, childIndex, next, last, rids, included.data());
+		next = last;
+	}
+}
+
+template <class T>
+void BTreeIndex::mergeIntoLeaf(const PageId leafPageNo, std::vector<PageId> & path, std::vector<int> & childIndex,
+		const std::pair<T, size_t> *begin, const std::pair<T, size_t> *end, const RecordId *rids, const char *included)
+{
+	LeafNode<T> *leaf = (LeafNode<T> *) readNode(leafPageNo);
+	const int count = leaf->header.keyCount;
+	std::vector<T> keys;
+	std::vector<RecordId> leafRids;
+	std::vector<char> columns;
+	keys.reserve(count + (end - begin));
+	leafRids.reserve(count + (end - begin));
+	auto push = [&](const T & key, const RecordId rid, const char *entryIncluded) {
+		keys.push_back(key);
+		leafRids.push_back(rid);
+		columns.insert(columns.end(), entryIncluded, entryIncluded + includedBytes);
+	};
+
+	//the entries of the leaf and of the batch are merged in one pass
+	int added = 0;
+	int i = 0;
+	const std::pair<T, size_t> *entry = begin;
+	while (entry != end || i < count) {
+		if (entry == end || (i < count && leaf->keyAt(i) < entry->first)) {
+			push(leaf->keyAt(i), leaf->ridAt(i), leaf->includedAt(i));
+			i++;
+			continue;
+		}
+		//the records of the batch with the key of entry, without repeats
+		const T key = entry->first;
+		std::vector<RecordId> group;
+		std::vector<char> groupColumns;
+		for (; entry != end && entry->first == key; entry++) {
+			const RecordId rid = rids[entry->second];
+			if (group.empty() || group.back() != rid) {
+				group.push_back(rid);
+				groupColumns.insert(groupColumns.end(), included + entry->second * includedBytes,
+						included + (entry->second + 1) * includedBytes);
+			}
+		}
+		if (!lookupCache.empty()) {
+			forgetLookup(keyBytes(key));
+		}
+
+		const int addedBefore = added;
+		if (i < count && leaf->keyAt(i) == key) {
+			//Case: the key is already indexed, the records of the batch join its posting list
+			RecordId existing = leaf->ridAt(i);
+			if (isPostingList(existing)) {
+				for (size_t g = 0; g < group.size(); g++) {
+					added += addToPostingList(existing.page_number, group[g], groupColumns.data() + g * includedBytes);
+				}
+			} else {
+				size_t position = std::lower_bound(group.begin(), group.end(), existing) - group.begin();
+				if (position == group.size() || group[position] != existing) {
+					group.insert(group.begin() + position, existing);
+					groupColumns.insert(groupColumns.begin() + position * includedBytes, leaf->includedAt(i),
+							leaf->includedAt(i) + includedBytes);
+				}
+				if (group.size() > 1) {
+					added += group.size() - 1;
+					existing = writePostingList(group, groupColumns);
+				}
+			}
+			push(key, existing, leaf->includedAt(i));
+			i++;
+		} else {
+			//Case: a new key, with a posting list of its own if the batch has several records for it
+			added += group.size();
+			push(key, (group.size() == 1) ? group[0] : writePostingList(group, groupColumns), groupColumns.data());
+		}
+		countEntry<T>(key, added - addedBefore);
+	}
+
+	const int merged = keys.size();
+	if (leaf->fits(keys.data(), merged)) {
+		//Case: the leaf holds everything
+		leaf->load(keys.data(), leafRids.data(), columns.data(), merged);
+		releaseNode(leafPageNo, true);
+		addToCounts<T>(path, childIndex, added);
+		return;
+	}
+
+	//Case: the entries are shared out evenly over as few leaves as hold them, the first being the leaf itself
+	int pieces = 2;
+	auto pieceStart = [&](const int j) { return (int) ((long) merged * j / pieces); };
+	auto piecesFit = [&]() {
+		for (int j = 0; j < pieces; j++) {
+			if (!leaf->fits(keys.data() + pieceStart(j), pieceStart(j + 1) - pieceStart(j))) {
+				return false;
+			}
+		}
+		return true;
+	};
+	while (!piecesFit()) {
+		pieces++;
+	}
+
+	const PageId rightSibPageNo = leaf->rightSibPageNo;
+	std::vector<PageKeyPair<T> > pushUp;
+	leaf->load(keys.data(), leafRids.data(), columns.data(), pieceStart(1));
+	LeafNode<T> *previous = leaf;
+	PageId previousPageNo = leafPageNo;
+	for (int j = 1; j < pieces; j++) {
+		const int start = pieceStart(j);
+		PageId newPageNo;
+		LeafNode<T> *newLeaf = allocateLeafNode<T>(newPageNo);
+		newLeaf->load(keys.data() + start, leafRids.data() + start, columns.data() + start * includedBytes, pieceStart(j + 1) - start);
+		newLeaf->leftSibPageNo = previousPageNo;
+		previous->rightSibPageNo = newPageNo;
+		if (previous != leaf) {
+			bufMgr->unPinPage(file, previousPageNo, true);
+		}
+		PageKeyPair<T> separator;
+		separator.set(newPageNo, shortestSeparator(keys[start - 1], keys[start]));
+		pushUp.push_back(separator);
+		previous = newLeaf;
+		previousPageNo = newPageNo;
+	}
+	previous->rightSibPageNo = rightSibPageNo;
+	bufMgr->unPinPage(file, previousPageNo, true);
+	releaseNode(leafPageNo, true);
+	if (rightSibPageNo != Page::INVALID_NUMBER) {
+		setLeftSibling<T>(rightSibPageNo, previousPageNo);
+	}
+
+	std::vector<std::uint32_t> pushUpCounts;
+	for (const PageKeyPair<T> & separator : pushUp) {
+		pushUpCounts.push_back(subtreeCounts ? subtreeRecords<T>(separator.pageNo) : 0);
+	}
+	insertChildren<T>(path, childIndex, pushUp, pushUpCounts, added);
+}
+
+template <class T>
+void BTreeIndex::insertChildren(std::vector<PageId> & path, std::vector<int> & childIndex, std::vector<PageKeyPair<T> > entries,
+		std::vector<std::uint32_t> entryCounts, const int added)
+{
+	std::vector<T> keys;
+	std::vector<PageId> children;
+	std::vector<std::uint32_t> counts;
+	while (!path.empty()) {
+		PageId parentId = path.back();
+		int position = childIndex.back();
+		path.pop_back();
+		childIndex.pop_back();
+		latchNode(parentId);
+		NonLeafNode<T> *parent = (NonLeafNode<T> *) readNode(parentId);
+
+		//the new children go right after the one they were split off, which gives up the records they took
+		const int count = parent->header.keyCount;
+		keys.clear();
+		children.clear();
+		counts.clear();
+		for (int i = 0; i <= count; i++) {
+			if (i < count) {
+				keys.push_back(parent->keyAt(i));
+			}
+			children.push_back(parent->childAt(i));
+			counts.push_back(parent->countAt(i));
+		}
+		counts[position] += added - std::accumulate(entryCounts.begin(), entryCounts.end(), 0u);
+		for (size_t e = 0; e < entries.size(); e++) {
+			keys.insert(keys.begin() + position + e, entries[e].key);
+			children.insert(children.begin() + position + 1 + e, entries[e].pageNo);
+			counts.insert(counts.begin() + position + 1 + e, entryCounts[e]);
+		}
+		distributeNonLeaf<T>(parent, keys, children, counts, entries, entryCounts);
+		releaseNode(parentId, true);
+		if (entries.empty()) {
+			addToCounts<T>(path, childIndex, added);
+			return;
+		}
+	}
+
+	//Case: the root itself was split; new roots go on top until one holds the whole level below it
+	while (!entries.empty()) {
+		keys.clear();
+		children.assign(1, rootPageNum);
+		counts.assign(1, subtreeCounts ? subtreeRecords<T>(rootPageNum) : 0);
+		for (size_t e = 0; e < entries.size(); e++) {
+			keys.push_back(entries[e].key);
+			children.push_back(entries[e].pageNo);
+			counts.push_back(entryCounts[e]);
+		}
+		PageId newRootNum;
+		NonLeafNode<T> *newRoot = allocateNonLeafNode<T>(newRootNum, height);
+		distributeNonLeaf<T>(newRoot, keys, children, counts, entries, entryCounts);
+		bufMgr->unPinPage(file, newRootNum, true);
+		recordRoot(newRootNum, height + 1);
+	}
+}
+
+template <class T>
+void BTreeIndex::distributeNonLeaf(NonLeafNode<T> *node, const std::vector<T> & keys, const std::vector<PageId> & children,
+		const std::vector<std::uint32_t> & counts, std::vector<PageKeyPair<T> > & pushUp, std::vector<std::uint32_t> & pushUpCounts)
+{
+	pushUp.clear();
+	pushUpCounts.clear();
+	const int total = keys.size();
+	if (NonLeafNode<T>::fits(keys.data(), total)) {
+		node->load(keys.data(), children.data(), counts.data(), total);
+		return;
+	}
+
+	//with pieces nodes, pieces - 1 keys move up between them and the others are shared out evenly
+	int pieces = 2;
+	auto pieceStart = [&](const int j) { return j + (int) ((long) (total - pieces + 1) * j / pieces); };
+	auto pieceKeys = [&](const int j) { return pieceStart(j + 1) - 1 - pieceStart(j); };
+	auto piecesFit = [&]() {
+		for (int j = 0; j < pieces; j++) {
+			if (pieceKeys(j) < 1 || !NonLeafNode<T>::fits(keys.data() + pieceStart(j), pieceKeys(j))) {
+				return false;
+			}
+		}
+		return true;
+	};
+	while (!piecesFit()) {
+		pieces++;
+	}
+
+	node->load(keys.data(), children.data(), counts.data(), pieceKeys(0));
+	for (int j = 1; j < pieces; j++) {
+		const int start = pieceStart(j);
+		PageId newPageNo;
+		NonLeafNode<T> *newNode = allocateNonLeafNode<T>(newPageNo, node->header.level);
+		newNode->load(keys.data() + start, children.data() + start, counts.data() + start, pieceKeys(j));
+		bufMgr->unPinPage(file, newPageNo, true);
+		PageKeyPair<T> separator;
+		separator.set(newPageNo, keys[start - 1]);
+		pushUp.push_back(separator);
+		pushUpCounts.push_back(std::accumulate(counts.begin() + start, counts.begin() + start + pieceKeys(j) + 1, 0u));
+	}
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::deleteEntry
+// -----------------------------------------------------------------------------
+
+const void BTreeIndex::deleteEntry(const void *key, const RecordId rid)
+{
+	switch (attributeType) {
+	case INTEGER:
+		if (concurrent) {
+			deleteConcurrent<int>(keyAt<int>(key), rid);
+		} else {
+			deleteKey<int>(keyAt<int>(key), rid);
+		}
+		countEntry<int>(keyAt<int>(key), -1);
+		break;
+	case DOUBLE:
+		if (concurrent) {
+			deleteConcurrent<double>(keyAt<double>(key), rid);
+		} else {
+			deleteKey<double>(keyAt<double>(key), rid);
+		}
+		countEntry<double>(keyAt<double>(key), -1);
+		break;
+	case STRING:
+		if (concurrent) {
+			deleteConcurrent<StringKey>(keyAt<StringKey>(key), rid);
+		} else {
+			deleteKey<StringKey>(keyAt<StringKey>(key), rid);
+		}
+		countEntry<StringKey>(keyAt<StringKey>(key), -1);
+		break;
+	}
+	redrawStaleHistogram();
+}
+
+void BTreeIndex::setUnderflowThreshold(const double threshold)
+{
+	underflowThreshold = threshold;
+}
+
+template <class T>
+void BTreeIndex::deleteKey(const T keyValue, const RecordId rid)
+{
+	if (!lookupCache.empty()) {
+		forgetLookup(keyBytes(keyValue));
+	}
+
+	// The non leaf nodes visited on the way down and the child taken in each, so that underflows can be pushed back up
+	std::vector<PageId> path;
+	std::vector<int> childIndex;
+	PageId currentId = rootPageNum;
+	for (int i = 1; i < height; i++) {
+		NonLeafNode<T> *node = (NonLeafNode<T> *) readNode(currentId);
+		//the entry is wherever insertEntry put it
+		int position = node->upperBound(keyValue);
+		path.push_back(currentId);
+		childIndex.push_back(position);
+		PageId nextId = node->childAt(position);
+		releaseNode(currentId, false);
+		currentId = nextId;
+	}
+
+	latchNode(currentId);
+	LeafNode<T> *leaf = (LeafNode<T> *) readNode(currentId);
+	int index = leaf->lowerBound(keyValue);
+	if (index == leaf->header.keyCount || leaf->keyAt(index) != keyValue) {
+		releaseNode(currentId, false);
+		throw NoSuchKeyFoundException();
+	}
+	RecordId existing = leaf->ridAt(index);
+	if (isPostingList(existing)) {
+		//Case: the key stays, only its posting list shrinks
+		int remaining;
+		if (!removeFromPostingList(existing.page_number, rid, remaining)) {
+			releaseNode(currentId, false);
+			throw NoSuchKeyFoundException();
+		}
+		bool dirty = false;
+		if (remaining == 1) {
+			//a single record id goes back into the leaf entry, with its included columns
+			std::vector<RecordId> rids;
+			std::vector<char> columns;
+			readPostingList(existing.page_number, rids, &columns);
+			freePostingList(existing.page_number);
+			leaf->setRidAt(index, rids[0]);
+			leaf->setIncludedAt(index, columns.data());
+			dirty = true;
+		}
+		releaseNode(currentId, dirty);
+		addToCounts<T>(path, childIndex, -1);
+		return;
+	}
+	if (existing != rid) {
+		releaseNode(currentId, false);
+		throw NoSuchKeyFoundException();
+	}
+	leaf->removeAt(index);
+	//a root leaf has no sibling to rebalance with, and may be left empty
+	bool underfull = !path.empty() && (leaf->header.keyCount == 0 || leaf->occupancy() < underflowThreshold);
+	releaseNode(currentId, true);
+	//counts are settled before any rebalancing, which only moves records between children
+	addToCounts<T>(path, childIndex, -1);
+
+	//Merging two nodes takes a key out of their parent, which may leave the parent underfull in turn
+	bool leafLevel = true;
+	while (underfull) {
+		PageId parentId = path.back();
+		path.pop_back();
+		int position = childIndex.back();
+		childIndex.pop_back();
+		latchNode(parentId);
+		NonLeafNode<T> *parent = (NonLeafNode<T> *) readNode(parentId);
+		bool merged = leafLevel ? rebalanceLeaves<T>(parent, position) : rebalanceNonLeaves<T>(parent, position);
+		leafLevel = false;
+		if (path.empty() && parent->header.keyCount == 0) {
+			//Case: the root lost its last key, its only child takes its place
+			PageId onlyChild = parent->childAt(0);
+			releaseNode(parentId, true);
+			shrinkRoot(onlyChild);
+			return;
+		}
+		underfull = merged && !path.empty()
+				&& (parent->header.keyCount == 0 || parent->occupancy() < underflowThreshold);
+		releaseNode(parentId, true);
+	}
+}
+
+template <class T>
+bool BTreeIndex::rebalanceLeaves(NonLeafNode<T> *parent, const int position)
+{
+	//A parent left with a single child by an earlier rebalance that could not move anything has nothing to pair
+	if (parent->header.keyCount == 0) {
+		return false;
+	}
+	//Pair the leaf with its right sibling, or with its left one if it is the last child
+	int leftIndex = (position < parent->header.keyCount) ? position : position - 1;
+	PageId leftId = parent->childAt(leftIndex);
+	PageId rightId = parent->childAt(leftIndex + 1);
+	Page *leftPage;
+	Page *rightPage;
+	latchNode(leftId);
+	latchNode(rightId);
+	bufMgr->readPage(file, leftId, leftPage);
+	bufMgr->readPage(file, rightId, rightPage);
+	LeafNode<T> *left = (LeafNode<T> *) leftPage;
+	LeafNode<T> *right = (LeafNode<T> *) rightPage;
+
+	int leftCount = left->header.keyCount;
+	int count = leftCount + right->header.keyCount;
+	std::vector<T> keys(count);
+	std::vector<RecordId> rids(count);
+	std::vector<char> included(count * includedBytes);
+	for (int i = 0; i < count; i++) {
+		keys[i] = (i < leftCount) ? left->keyAt(i) : right->keyAt(i - leftCount);
+		rids[i] = (i < leftCount) ? left->ridAt(i) : right->ridAt(i - leftCount);
+		std::copy_n((i < leftCount) ? left->includedAt(i) : right->includedAt(i - leftCount), includedBytes,
+				included.begin() + i * includedBytes);
+	}
+
+	if (left->fits(keys.data(), count)) {
+		//Case: both fit in the left leaf, the right one is unlinked and given back to the file
+		left->load(keys.data(), rids.data(), included.data(), count);
+		left->rightSibPageNo = right->rightSibPageNo;
+		if (left->rightSibPageNo != Page::INVALID_NUMBER) {
+			setLeftSibling<T>(left->rightSibPageNo, leftId);
+		}
+		parent->setCountAt(leftIndex, parent->countAt(leftIndex) + parent->countAt(leftIndex + 1));
+		parent->removeAt(leftIndex);
+		bufMgr->unPinPage(file, leftId, true);
+		bufMgr->unPinPage(file, rightId, false);
+		disposeNode(rightId);
+		countLevelPages(0, -1);
+		return true;
+	}
+
+	//Case: share the entries out evenly. Long STRING keys may keep one half from fitting, then nothing moves
+	int middle = count / 2;
+	bool moved = left->fits(keys.data(), middle) && right->fits(keys.data() + middle, count - middle)
+			&& parent->replaceKeyAt(leftIndex, shortestSeparator(keys[middle - 1], keys[middle]));
+	if (moved) {
+		left->load(keys.data(), rids.data(), included.data(), middle);
+		right->load(keys.data() + middle, rids.data() + middle, included.data() + middle * includedBytes, count - middle);
+		if (subtreeCounts) {
+			//only the records of one half are counted, posting lists have to be opened for it
+			std::uint32_t total = parent->countAt(leftIndex) + parent->countAt(leftIndex + 1);
+			std::uint32_t leftTotal = 0;
+			for (int i = 0; i < middle; i++) {
+				leftTotal += entryRecords(rids[i]);
+			}
+			parent->setCountAt(leftIndex, leftTotal);
+			parent->setCountAt(leftIndex + 1, total - leftTotal);
+		}
+	}
+	bufMgr->unPinPage(file, leftId, moved);
+	bufMgr->unPinPage(file, rightId, moved);
+	return false;
+}
+
+template <class T>
+bool BTreeIndex::rebalanceNonLeaves(NonLeafNode<T> *parent, const int position)
+{
+	if (parent->header.keyCount == 0) {
+		return false;
+	}
+	int leftIndex = (position < parent->header.keyCount) ? position : position - 1;
+	PageId leftId = parent->childAt(leftIndex);
+	PageId rightId = parent->childAt(leftIndex + 1);
+	latchNode(leftId);
+	latchNode(rightId);
+	NonLeafNode<T> *left = (NonLeafNode<T> *) readNode(leftId);
+	NonLeafNode<T> *right = (NonLeafNode<T> *) readNode(rightId);
+
+	//The separator between the two comes down between their keys
+	int leftCount = left->header.keyCount;
+	int rightCount = right->header.keyCount;
+	int count = leftCount + 1 + rightCount;
+	std::vector<T> keys(count);
+	std::vector<PageId> children(count + 1);
+	std::vector<std::uint32_t> counts(count + 1);
+	for (int i = 0; i < leftCount; i++) {
+		keys[i] = left->keyAt(i);
+		children[i] = left->childAt(i);
+		counts[i] = left->countAt(i);
+	}
+	keys[leftCount] = parent->keyAt(leftIndex);
+	children[leftCount] = left->childAt(leftCount);
+	counts[leftCount] = left->countAt(leftCount);
+	for (int i = 0; i < rightCount; i++) {
+		keys[leftCount + 1 + i] = right->keyAt(i);
+		children[leftCount + 1 + i] = right->childAt(i);
+		counts[leftCount + 1 + i] = right->countAt(i);
+	}
+	children[count] = right->childAt(rightCount);
+	counts[count] = right->countAt(rightCount);
+
+	if (NonLeafNode<T>::fits(keys.data(), count)) {
+		//Case: both fit in the left node
+		left->load(keys.data(), children.data(), counts.data(), count);
+		parent->setCountAt(leftIndex, parent->countAt(leftIndex) + parent->countAt(leftIndex + 1));
+		parent->removeAt(leftIndex);
+		countLevelPages(left->header.level, -1);
+		releaseNode(leftId, true);
+		releaseNode(rightId, false);
+		disposeNode(rightId);
+		return true;
+	}
+
+	//Case: share the keys out evenly, the middle one goes up to the parent
+	int middle = count / 2;
+	bool moved = NonLeafNode<T>::fits(keys.data(), middle)
+			&& NonLeafNode<T>::fits(keys.data() + middle + 1, count - middle - 1)
+			&& parent->replaceKeyAt(leftIndex, keys[middle]);
+	if (moved) {
+		left->load(keys.data(), children.data(), counts.data(), middle);
+		right->load(keys.data() + middle + 1, children.data() + middle + 1, counts.data() + middle + 1, count - middle - 1);
+		std::uint32_t total = parent->countAt(leftIndex) + parent->countAt(leftIndex + 1);
+		std::uint32_t leftTotal = std::accumulate(counts.begin(), counts.begin() + middle + 1, (std::uint32_t) 0);
+		parent->setCountAt(leftIndex, leftTotal);
+		parent->setCountAt(leftIndex + 1, total - leftTotal);
+	}
+	releaseNode(leftId, moved);
+	releaseNode(rightId, moved);
+	return false;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::shrinkRoot
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::shrinkRoot(const PageId newRootPageNo)
+{
+	latchNode(headerPageNum);
+	disposeNode(rootPageNum);
+	countLevelPages(height - 1, -1);
+	recordRoot(newRootPageNo, height - 1);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::compact
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::compact(const double fillFactor)
+{
+	//the scan may hold one of the leaves that are about to move
+	if (scanCursor.isScanning()) {
+		scanCursor.endScan();
+	}
+	std::unique_lock<std::mutex> guard(structureMutex, std::defer_lock);
+	if (concurrent) {
+		//splits and merges wait until every leaf has moved
+		activeOperations++;
+		guard.lock();
+	}
+	std::vector<PageId> replaced;
+	try {
+		if (height > 1) {
+			switch (attributeType) {
+			case INTEGER:
+				compactSubtree<int>(rootPageNum, fillFactor, replaced);
+				break;
+			case DOUBLE:
+				compactSubtree<double>(rootPageNum, fillFactor, replaced);
+				break;
+			case STRING:
+				compactSubtree<StringKey>(rootPageNum, fillFactor, replaced);
+				break;
+			}
+		}
+	} catch (...) {
+		if (concurrent) {
+			finishStructureChange();
+			activeOperations--;
+		}
+		throw;
+	}
+
+	//given back from the highest page down, so that the file hands out the lowest of them first
+	std::sort(replaced.begin(), replaced.end(), std::greater<PageId>());
+	for (PageId pageNo : replaced) {
+		disposeNode(pageNo);
+		countLevelPages(0, -1);
+	}
+	if (concurrent) {
+		finishStructureChange();
+		activeOperations--;
+	}
+}
+
+template <class T>
+void BTreeIndex::compactSubtree(const PageId pageNo, const double fillFactor, std::vector<PageId> & replaced)
+{
+	NonLeafNode<T> *node = (NonLeafNode<T> *) readNode(pageNo);
+	if (node->header.level == 1) {
+		releaseNode(pageNo, false);
+		compactLeaves<T>(pageNo, fillFactor, replaced);
+		return;
+	}
+	//only this writer changes non leaf nodes, so the children read here stay where they are
+	std::vector<PageId> children;
+	for (int i = 0; i <= node->header.keyCount; i++) {
+		children.push_back(node->childAt(i));
+	}
+	releaseNode(pageNo, false);
+	for (PageId child : children) {
+		compactSubtree<T>(child, fillFactor, replaced);
+	}
+}
+
+template <class T>
+void BTreeIndex::compactLeaves(const PageId parentPageNo, const double fillFactor, std::vector<PageId> & replaced)
+{
+	//Part 1: the entries of every leaf under the parent, latched so that inserts into them wait for the move
+	latchNode(parentPageNo);
+	NonLeafNode<T> *parent = (NonLeafNode<T> *) readNode(parentPageNo);
+	const int children = parent->header.keyCount + 1;
+	std::vector<PageId> oldLeaves(children);
+	std::vector<T> keys;
+	std::vector<RecordId> rids;
+	std::vector<char> columns;
+	PageId leftSibPageNo = Page::INVALID_NUMBER;
+	PageId rightSibPageNo = Page::INVALID_NUMBER;
+	for (int i = 0; i < children; i++) {
+		oldLeaves[i] = parent->childAt(i);
+		latchNode(oldLeaves[i]);
+		LeafNode<T> *leaf = (LeafNode<T> *) readNode(oldLeaves[i]);
+		for (int j = 0; j < leaf->header.keyCount; j++) {
+			keys.push_back(leaf->keyAt(j));
+			rids.push_back(leaf->ridAt(j));
+			columns.insert(columns.end(), leaf->includedAt(j), leaf->includedAt(j) + includedBytes);
+		}
+		if (i == 0) {
+			leftSibPageNo = leaf->leftSibPageNo;
+		}
+		rightSibPageNo = leaf->rightSibPageNo;
+		releaseNode(oldLeaves[i], false);
+	}
+
+	//Part 2: where each new leaf starts, trying the leaves out on a scratch leaf
+	std::unique_ptr<LeafNode<T> > scratch(new LeafNode<T>());
+	std::vector<int> starts;
+	std::vector<T> separators;
+	bool fits = false;
+	for (double fill : {fillFactor, 1.0}) {
+		starts.assign(1, 0);
+		separators.clear();
+		scratch->format(includedBytes);
+		for (size_t i = 0; i < keys.size(); i++) {
+			if (!scratch->append(keys[i], rids[i], columns.data() + i * includedBytes, fill)) {
+				starts.push_back(i);
+				separators.push_back(shortestSeparator(keys[i - 1], keys[i]));
+				scratch->format(includedBytes);
+				scratch->append(keys[i], rids[i], columns.data() + i * includedBytes, fill);
+			}
+		}
+		starts.push_back(keys.size());
+		if ((fits = NonLeafNode<T>::fits(separators.data(), separators.size()))) {
+			break;
+		}
+	}
+	if (!fits) {
+		//Case: the parent cannot take the leaves even when they are full, they stay as they are
+		releaseNode(parentPageNo, false);
+		if (concurrent) {
+			finishStructureChange();
+		}
+		return;
+	}
+
+	//Part 3: the new leaves, linked to each other and to the leaves on either side
+	const int pieces = starts.size() - 1;
+	std::vector<PageId> newLeaves(pieces);
+	std::vector<std::uint32_t> counts(pieces, 0);
+	LeafNode<T> *previous = NULL;
+	for (int j = 0; j < pieces; j++) {
+		LeafNode<T> *leaf = allocateLeafNode<T>(newLeaves[j]);
+		leaf->load(keys.data() + starts[j], rids.data() + starts[j], columns.data() + starts[j] * includedBytes,
+				starts[j + 1] - starts[j]);
+		for (int i = starts[j]; subtreeCounts && i < starts[j + 1]; i++) {
+			counts[j] += entryRecords(rids[i]);
+		}
+		leaf->leftSibPageNo = (j == 0) ? leftSibPageNo : newLeaves[j - 1];
+		leaf->rightSibPageNo = rightSibPageNo;
+		if (previous != NULL) {
+			previous->rightSibPageNo = newLeaves[j];
+			bufMgr->unPinPage(file, newLeaves[j - 1], true);
+		}
+		previous = leaf;
+	}
+	bufMgr->unPinPage(file, newLeaves[pieces - 1], true);
+	if (leftSibPageNo != Page::INVALID_NUMBER) {
+		latchNode(leftSibPageNo);
+		LeafNode<T> *left = (LeafNode<T> *) readNode(leftSibPageNo);
+		left->rightSibPageNo = newLeaves[0];
+		releaseNode(leftSibPageNo, true);
+	}
+	if (rightSibPageNo != Page::INVALID_NUMBER) {
+		setLeftSibling<T>(rightSibPageNo, newLeaves[pieces - 1]);
+	}
+
+	//the parent covers the same keys as before, so nothing above it changes
+	parent->load(separators.data(), newLeaves.data(), counts.data(), pieces - 1);
+	releaseNode(parentPageNo, true);
+	replaced.insert(replaced.end(), oldLeaves.begin(), oldLeaves.end());
+	if (concurrent) {
+		finishStructureChange();
+	}
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::lookup
+// -----------------------------------------------------------------------------
+
+bool BTreeIndex::lookup(const void *key, RecordId &outRid)
+{
+	switch (attributeType) {
+	case INTEGER:
+		return lookupKey<int>(keyAt<int>(key), outRid);
+	case DOUBLE:
+		return lookupKey<double>(keyAt<double>(key), outRid);
+	case STRING:
+		return lookupKey<StringKey>(keyAt<StringKey>(key), outRid);
+	}
+	return false;
+}
+
+template <class T>
+bool BTreeIndex::lookupKey(const T keyValue, RecordId &outRid)
+{
+	if (concurrent) {
+		activeOperations++;
+		Attempt attempt;
+		while ((attempt = lookupOptimistic<T>(keyValue, outRid)) == RETRY) {
+		}
+		activeOperations--;
+		return attempt == SUCCEEDED;
+	}
+
+	std::string cacheKey;
+	if (lookupCacheCapacity > 0) {
+		cacheKey = keyBytes(keyValue);
+		auto cached = lookupCache.find(cacheKey);
+		if (cached != lookupCache.end()) {
+			//Case: a recent lookup of the key is still valid
+			lookupCacheOrder.splice(lookupCacheOrder.begin(), lookupCacheOrder, cached->second.second);
+			outRid = cached->second.first;
+			return true;
+		}
+	}
+
+	PageId currentId = rootPageNum;
+	Page *currentPage;
+	for (int i = 1; i < height; i++) {
+		NonLeafNode<T> *node = (NonLeafNode<T> *) readNode(currentId);
+		//the entry is wherever insertEntry put it
+		PageId nextId = node->childAt(node->upperBound(keyValue));
+		releaseNode(currentId, false);
+		currentId = nextId;
+	}
+
+	LeafNode<T> *leaf = (LeafNode<T> *) readNode(currentId);
+	int index = leaf->lowerBound(keyValue);
+	bool found = index < leaf->header.keyCount && leaf->keyAt(index) == keyValue;
+	RecordId rid;
+	if (found) {
+		rid = leaf->ridAt(index);
+	}
+	releaseNode(currentId, false);
+	if (!found) {
+		return false;
+	}
+
+	if (isPostingList(rid)) {
+		//posting lists are sorted, so the first page starts with the smallest record id
+		PageId headPageNo = rid.page_number;
+		bufMgr->readPage(file, headPageNo, currentPage);
+		rid = ((PostingPage *) currentPage)->first();
+		bufMgr->unPinPage(file, headPageNo, false);
+	}
+	if (lookupCacheCapacity > 0) {
+		rememberLookup(cacheKey, rid);
+	}
+	outRid = rid;
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::lookupMany
+// -----------------------------------------------------------------------------
+
+size_t BTreeIndex::lookupMany(const void *keys, const size_t n, RecordId *out, bool *found)
+{
+	switch (attributeType) {
+	case INTEGER:
+		return lookupManyKeys<int>((const char *) keys, sizeof(int), n, out, found);
+	case DOUBLE:
+		return lookupManyKeys<double>((const char *) keys, sizeof(double), n, out, found);
+	case STRING:
+		return lookupManyKeys<StringKey>((const char *) keys, STRINGSIZE, n, out, found);
+	}
+	return 0;
+}
+
+template <class T>
+size_t BTreeIndex::lookupManyKeys(const char *keys, const size_t stride, const size_t n, RecordId *out, bool *found)
+{
+	//each probe remembers where its answer goes
+	std::vector<std::pair<T, size_t> > probes(n);
+	for (size_t i = 0; i < n; i++) {
+		probes[i] = std::make_pair(keyAt<T>(keys + i * stride), i);
+		found[i] = false;
+	}
+	std::sort(probes.begin(), probes.end());
+	return probeSubtree<T>(rootPageNum, probes.data(), probes.data() + n, out, found);
+}
+
+template <class T>
+size_t BTreeIndex::probeSubtree(const PageId pageNo, const std::pair<T, size_t> *begin, const std::pair<T, size_t> *end,
+		RecordId *out, bool *found)
+{
+	Page *page = readNode(pageNo);
+	size_t hits = 0;
+
+	if (((NodeHeader *) page)->level == 0) {
+		//Case: a leaf answers all of its probes
+		LeafNode<T> *leaf = (LeafNode<T> *) page;
+		for (const std::pair<T, size_t> *probe = begin; probe != end; probe++) {
+			int index = leaf->lowerBound(probe->first);
+			if (index == leaf->header.keyCount || leaf->keyAt(index) != probe->first) {
+				continue;
+			}
+			RecordId rid = leaf->ridAt(index);
+			if (isPostingList(rid)) {
+				PageId headPageNo = rid.page_number;
+				Page *headPage;
+				bufMgr->readPage(file, headPageNo, headPage);
+				rid = ((PostingPage *) headPage)->first();
+				bufMgr->unPinPage(file, headPageNo, false);
+			}
+			out[probe->second] = rid;
+			found[probe->second] = true;
+			hits++;
+		}
+		bufMgr->unPinPage(file, pageNo, false);
+		return hits;
+	}
+
+	//Case: the probes are split into runs going to the same child; the node is let go before descending
+	NonLeafNode<T> *node = (NonLeafNode<T> *) page;
+	std::vector<PageId> children;
+	std::vector<const std::pair<T, size_t> *> runStarts;
+	for (const std::pair<T, size_t> *probe = begin; probe != end; ) {
+		int position = node->upperBound(probe->first);
+		children.push_back(node->childAt(position));
+		runStarts.push_back(probe);
+		probe++;
+		if (position == node->header.keyCount) {
+			probe = end;
+		} else {
+			//keys equal to the separator belong to the child on its right
+			const T separator = node->keyAt(position);
+			while (probe != end && probe->first < separator) {
+				probe++;
+			}
+		}
+	}
+	runStarts.push_back(end);
+	releaseNode(pageNo, false);
+
+	for (size_t i = 0; i < children.size(); i++) {
+		hits += probeSubtree<T>(children[i], runStarts[i], runStarts[i + 1], out, found);
+	}
+	return hits;
+}
+
+void BTreeIndex::setLookupCacheSize(const size_t entries)
+{
+	lookupCacheCapacity = entries;
+	while (lookupCache.size() > lookupCacheCapacity) {
+		forgetLookup(lookupCacheOrder.back());
+	}
+}
+
+void BTreeIndex::rememberLookup(const std::string & cacheKey, const RecordId rid)
+{
+	if (lookupCache.size() == lookupCacheCapacity) {
+		forgetLookup(lookupCacheOrder.back());
+	}
+	lookupCacheOrder.push_front(cacheKey);
+	lookupCache[cacheKey] = std::make_pair(rid, lookupCacheOrder.begin());
+}
+
+void BTreeIndex::forgetLookup(const std::string & cacheKey)
+{
+	auto cached = lookupCache.find(cacheKey);
+	if (cached != lookupCache.end()) {
+		lookupCacheOrder.erase(cached->second.second);
+		lookupCache.erase(cached);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::entryRecords, subtreeRecords, addToCounts and countSubtree
+// -----------------------------------------------------------------------------
+
+std::uint32_t BTreeIndex::entryRecords(const RecordId rid)
+{
+	if (!isPostingList(rid)) {
+		return 1;
+	}
+	//the first page of a posting list knows the length of the whole list
+	Page *page;
+	bufMgr->readPage(file, rid.page_number, page);
+	std::uint32_t records = ((PostingPage *) page)->totalCount;
+	bufMgr->unPinPage(file, rid.page_number, false);
+	return records;
+}
+
+template <class T>
+std::uint32_t BTreeIndex::subtreeRecords(const PageId pageNo)
+{
+	Page *page = readNode(pageNo);
+	std::uint32_t records = 0;
+	if (reinterpret_cast<NodeHeader *>(page)->level == 0) {
+		LeafNode<T> *leaf = (LeafNode<T> *) page;
+		for (int i = 0; i < leaf->header.keyCount; i++) {
+			records += entryRecords(leaf->ridAt(i));
+		}
+	} else {
+		NonLeafNode<T> *node = (NonLeafNode<T> *) page;
+		for (int i = 0; i <= node->header.keyCount; i++) {
+			records += node->countAt(i);
+		}
+	}
+	releaseNode(pageNo, false);
+	return records;
+}
+
+template <class T>
+void BTreeIndex::addToCounts(const std::vector<PageId> & path, const std::vector<int> & childIndex, const int delta)
+{
+	if (!subtreeCounts) {
+		return;
+	}
+	for (size_t i = 0; i < path.size(); i++) {
+		latchNode(path[i]);
+		NonLeafNode<T> *node = (NonLeafNode<T> *) readNode(path[i]);
+		node->setCountAt(childIndex[i], node->countAt(childIndex[i]) + delta);
+		releaseNode(path[i], true);
+	}
+}
+
+template <class T>
+std::uint32_t BTreeIndex::countSubtree(const PageId pageNo)
+{
+	NonLeafNode<T> *node = (NonLeafNode<T> *) readNode(pageNo);
+	if (node->header.level == 0) {
+		releaseNode(pageNo, false);
+		return subtreeRecords<T>(pageNo);
+	}
+	std::uint32_t records = 0;
+	for (int i = 0; i <= node->header.keyCount; i++) {
+		std::uint32_t childRecords = countSubtree<T>(node->childAt(i));
+		node->setCountAt(i, childRecords);
+		records += childRecords;
+	}
+	releaseNode(pageNo, true);
+	return records;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::setSubtreeCounts
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::setSubtreeCounts(const bool enable)
+{
+	if (enable && !subtreeCounts) {
+		//counts left behind while they were off are all taken again
+		switch (attributeType) {
+		case INTEGER:
+			countSubtree<int>(rootPageNum);
+			break;
+		case DOUBLE:
+			countSubtree<double>(rootPageNum);
+			break;
+		case STRING:
+			countSubtree<StringKey>(rootPageNum);
+			break;
+		}
+	}
+	subtreeCounts = enable;
+	metaPageInfo.subtreeCounts = enable;
+	Page *metaPage;
+	bufMgr->readPage(file, headerPageNum, metaPage);
+	reinterpret_cast<IndexMetaInfo *>(metaPage)->subtreeCounts = enable;
+	bufMgr->unPinPage(file, headerPageNum, true);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::countBelow
+// -----------------------------------------------------------------------------
+
+template <class T>
+size_t BTreeIndex::countBelow(const T key, const bool inclusive)
+{
+	size_t below = 0;
+	PageId pageNo = rootPageNum;
+	if (!subtreeCounts) {
+		//every leaf up to the key is read, starting from the left-most one
+		for (int i = 1; i < height; i++) {
+			NonLeafNode<T> *node = (NonLeafNode<T> *) readNode(pageNo);
+			PageId childPageNo = node->childAt(0);
+			releaseNode(pageNo, false);
+			pageNo = childPageNo;
+		}
+		while (pageNo != Page::INVALID_NUMBER) {
+			LeafNode<T> *leaf = (LeafNode<T> *) readNode(pageNo);
+			int position = inclusive ? leaf->upperBound(key) : leaf->lowerBound(key);
+			for (int i = 0; i < position; i++) {
+				below += entryRecords(leaf->ridAt(i));
+			}
+			PageId siblingPageNo = (position < leaf->header.keyCount) ? Page::INVALID_NUMBER : leaf->rightSibPageNo;
+			releaseNode(pageNo, false);
+			pageNo = siblingPageNo;
+		}
+		return below;
+	}
+
+	//Every child left of the one taken holds only smaller keys, and every child right of it only greater ones
+	std::uint32_t leafRecords = 0;
+	for (int i = 1; i < height; i++) {
+		NonLeafNode<T> *node = (NonLeafNode<T> *) readNode(pageNo);
+		int position = inclusive ? node->upperBound(key) : node->lowerBound(key);
+		for (int j = 0; j < position; j++) {
+			below += node->countAt(j);
+		}
+		leafRecords = node->countAt(position);
+		PageId childPageNo = node->childAt(position);
+		releaseNode(pageNo, false);
+		pageNo = childPageNo;
+	}
+
+	//Posting lists have to be opened to be counted, so the shorter side of the key is counted in the leaf
+	LeafNode<T> *leaf = (LeafNode<T> *) readNode(pageNo);
+	int count = leaf->header.keyCount;
+	int position = inclusive ? leaf->upperBound(key) : leaf->lowerBound(key);
+	if (height > 1 && position > count / 2) {
+		below += leafRecords;
+		for (int i = position; i < count; i++) {
+			below -= entryRecords(leaf->ridAt(i));
+		}
+	} else {
+		for (int i = 0; i < position; i++) {
+			below += entryRecords(leaf->ridAt(i));
+		}
+	}
+	releaseNode(pageNo, false);
+	return below;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::countRange and rankOf
+// -----------------------------------------------------------------------------
+
+size_t BTreeIndex::countRange(const void* lowValParm, const Operator lowOpParm, const void* highValParm, const Operator highOpParm)
+{
+	if (!((lowOpParm == GT or lowOpParm == GTE) and (highOpParm == LT or highOpParm == LTE))) {
+		throw BadOpcodesException();
+	}
+	if (!subtreeCounts) {
+		//without the counts the records of the range are scanned, a batch at a time
+		IndexScanCursor cursor(this);
+		try {
+			cursor.startScan(lowValParm, lowOpParm, highValParm, highOpParm);
+		} catch (NoSuchKeyFoundException e) {
+			return 0;
+		}
+		std::vector<RecordId> batch(1024);
+		size_t records = 0;
+		size_t fetched;
+		while ((fetched = cursor.scanNextBatch(batch.data(), batch.size())) > 0) {
+			records += fetched;
+		}
+		cursor.endScan();
+		return records;
+	}
+
+	//writers keeping counts all hold structureMutex, so the counts cannot change between the two descents
+	std::unique_lock<std::mutex> guard(structureMutex, std::defer_lock);
+	if (concurrent) {
+		guard.lock();
+	}
+	switch (attributeType) {
+	case INTEGER:
+		return countRangeKey<int>(keyAt<int>(lowValParm), lowOpParm, keyAt<int>(highValParm), highOpParm);
+	case DOUBLE:
+		return countRangeKey<double>(keyAt<double>(lowValParm), lowOpParm, keyAt<double>(highValParm), highOpParm);
+	case STRING:
+		return countRangeKey<StringKey>(keyAt<StringKey>(lowValParm), lowOpParm, keyAt<StringKey>(highValParm), highOpParm);
+	}
+	return 0;
+}
+
+template <class T>
+size_t BTreeIndex::countRangeKey(const T lowVal, const Operator lowOp, const T highVal, const Operator highOp)
+{
+	if (highVal < lowVal) {
+		throw BadScanrangeException();
+	}
+	size_t upToHigh = countBelow<T>(highVal, highOp == LTE);
+	size_t belowLow = countBelow<T>(lowVal, lowOp == GT);
+	//(k, k) is empty, though more records are below k than up to it
+	return (upToHigh > belowLow) ? upToHigh - belowLow : 0;
+}
+
+size_t BTreeIndex::rankOf(const void* key)
+{
+	std::unique_lock<std::mutex> guard(structureMutex, std::defer_lock);
+	if (concurrent && subtreeCounts) {
+		guard.lock();
+	}
+	switch (attributeType) {
+	case INTEGER:
+		return countBelow<int>(keyAt<int>(key), false);
+	case DOUBLE:
+		return countBelow<double>(keyAt<double>(key), false);
+	case STRING:
+		return countBelow<StringKey>(keyAt<StringKey>(key), false);
+	}
+	return 0;
+}
+
+// -----------------------------------------------------------------------------
+// bucketShare:
+// share of the records of a histogram bucket that a range covers, the keys of the bucket going from from, left out if
+// fromExcluded, up to to and being spread evenly in between
+// -----------------------------------------------------------------------------
+
+//Distance between neighbouring keys: INTEGER keys cover a unit each, the others none
+template <class T>
+static inline double keyGap() { return 0; }
+template <>
+inline double keyGap<int>() { return 1; }
+
+//Characters two keys share at their start, which tell nothing apart within a bucket
+template <class T>
+static inline int commonPrefix(const T &a, const T &b) { return 0; }
+template <>
+inline int commonPrefix<StringKey>(const StringKey &a, const StringKey &b)
+{
+	int length = 0;
+	while (length < STRINGSIZE && a.data[length] == b.data[length]) {
+		length++;
+	}
+	return length;
+}
+
+//Where a key lies on a line of numbers; a string is read as a fraction, from its characters after skip on
+template <class T>
+static inline double keyPosition(const T &key, const int skip) { return (double) key; }
+template <>
+inline double keyPosition<StringKey>(const StringKey &key, const int skip)
+{
+	double position = 0;
+	double scale = 1;
+	for (int i = skip; i < std::min(skip + 8, STRINGSIZE); i++) {
+		scale /= 256;
+		position += (unsigned char) key.data[i] * scale;
+	}
+	return position;
+}
+
+template <class T>
+static double bucketShare(const T &from, const T &to, const bool fromExcluded, const T &low, const Operator lowOp,
+		const T &high, const Operator highOp)
+{
+	if (high < from || to < low) {
+		return 0;
+	}
+	if (!(from < to)) {
+		//a bucket of a single key is in the range or out of it as a whole
+		bool aboveLow = (lowOp == GTE) ? !(to < low) : low < to;
+		bool belowHigh = (highOp == LTE) ? !(high < to) : to < high;
+		return (aboveLow && belowHigh) ? 1 : 0;
+	}
+	//the bounds of the range within the bucket share the start of its keys, so only the characters after it count
+	const int skip = commonPrefix(from, to);
+	const double gap = keyGap<T>();
+	double bucketLow = keyPosition(from, skip) + (fromExcluded ? gap : 0);
+	double bucketHigh = keyPosition(to, skip) + gap;
+	double rangeLow = (low < from) ? bucketLow : keyPosition(low, skip) + (lowOp == GT ? gap : 0);
+	double rangeHigh = (to < high) ? bucketHigh : keyPosition(high, skip) + (highOp == LTE ? gap : 0);
+	if (bucketHigh <= bucketLow) {
+		return 1;
+	}
+	double covered = std::min(rangeHigh, bucketHigh) - std::max(rangeLow, bucketLow);
+	return std::max(0.0, std::min(1.0, covered / (bucketHigh - bucketLow)));
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::countLevelPages, countEntry and redrawStaleHistogram
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::countLevelPages(const int level, const int change)
+{
+	//nodes are only added and taken away by writers holding structureMutex
+	if (level < MAX_TREE_LEVELS) {
+		metaPageInfo.statistics.levelPages[level] += change;
+	}
+	statisticsChanged = true;
+}
+
+template <class T>
+void BTreeIndex::countEntry(const T keyValue, const int change)
+{
+	if (change == 0) {
+		return;
+	}
+	std::unique_lock<std::mutex> guard(statisticsMutex, std::defer_lock);
+	if (concurrent) {
+		guard.lock();
+	}
+	IndexStatistics &stats = metaPageInfo.statistics;
+	if (change > 0) {
+		if (stats.entryCount == 0 || keyValue < keyAt<T>(stats.minKey)) {
+			storeKey(stats.minKey, keyValue);
+		}
+		if (stats.entryCount == 0 || keyAt<T>(stats.maxKey) < keyValue) {
+			storeKey(stats.maxKey, keyValue);
+		}
+	}
+	stats.entryCount += change;
+	if (stats.bucketCount > 0) {
+		//the first bucket whose bound is not under the key, or the last one for keys past every bound
+		int low = 0;
+		int high = stats.bucketCount - 1;
+		while (low < high) {
+			int middle = (low + high) / 2;
+			if (keyAt<T>(stats.bucketBounds[middle]) < keyValue) {
+				low = middle + 1;
+			} else {
+				high = middle;
+			}
+		}
+		if (change > 0 || stats.bucketCounts[low] > 0) {
+			stats.bucketCounts[low] += change;
+		}
+	}
+	statisticsChanged = true;
+}
+
+void BTreeIndex::redrawStaleHistogram()
+{
+	const IndexStatistics &stats = metaPageInfo.statistics;
+	//an index that was about empty is drawn again once it holds a few records a bucket
+	std::uint64_t drawn = std::max<std::uint64_t>(stats.drawnEntryCount, HISTOGRAM_BUCKETS);
+	if (!concurrent && (stats.entryCount >= 2 * drawn || 2 * stats.entryCount < stats.drawnEntryCount)) {
+		refreshStatistics();
+	}
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::getStatistics, refreshStatistics and writeStatistics
+// -----------------------------------------------------------------------------
+
+IndexStatistics BTreeIndex::getStatistics()
+{
+	//the node counts change under structureMutex and the rest under statisticsMutex
+	std::unique_lock<std::mutex> structureGuard(structureMutex, std::defer_lock);
+	std::unique_lock<std::mutex> guard(statisticsMutex, std::defer_lock);
+	if (concurrent) {
+		structureGuard.lock();
+		guard.lock();
+	}
+	return metaPageInfo.statistics;
+}
+
+void BTreeIndex::refreshStatistics()
+{
+	switch (attributeType) {
+	case INTEGER:
+		refreshStatisticsKey<int>();
+		break;
+	case DOUBLE:
+		refreshStatisticsKey<double>();
+		break;
+	case STRING:
+		refreshStatisticsKey<StringKey>();
+		break;
+	}
+}
+
+template <class T>
+void BTreeIndex::refreshStatisticsKey()
+{
+	std::uint32_t levelPages[MAX_TREE_LEVELS] = {};
+	HistogramBuilder<T> histogram;
+	gatherStatistics<T>(rootPageNum, levelPages, [&histogram](const T & key, const std::uint32_t records) {
+		histogram.add(key, records);
+	});
+	std::unique_lock<std::mutex> guard(statisticsMutex, std::defer_lock);
+	if (concurrent) {
+		guard.lock();
+	}
+	IndexStatistics &stats = metaPageInfo.statistics;
+	stats.height = height;
+	std::copy_n(levelPages, MAX_TREE_LEVELS, stats.levelPages);
+	histogram.finish(stats);
+	metaPageInfo.statisticsKept = 1;
+	statisticsChanged = true;
+}
+
+template <class T>
+void BTreeIndex::gatherStatistics(const PageId pageNo, std::uint32_t *levelPages,
+		const std::function<void (const T &, const std::uint32_t)> & visit)
+{
+	Page *page = readNode(pageNo);
+	const int level = reinterpret_cast<NodeHeader *>(page)->level;
+	if (level < MAX_TREE_LEVELS) {
+		levelPages[level]++;
+	}
+	if (level == 0) {
+		LeafNode<T> *leaf = (LeafNode<T> *) page;
+		for (int i = 0; i < leaf->header.keyCount; i++) {
+			visit(leaf->keyAt(i), entryRecords(leaf->ridAt(i)));
+		}
+	} else {
+		NonLeafNode<T> *node = (NonLeafNode<T> *) page;
+		for (int i = 0; i <= node->header.keyCount; i++) {
+			gatherStatistics<T>(node->childAt(i), levelPages, visit);
+		}
+	}
+	releaseNode(pageNo, false);
+}
+
+void BTreeIndex::writeStatistics()
+{
+	if (!statisticsChanged) {
+		return;
+	}
+	Page *metaPage;
+	bufMgr->readPage(file, headerPageNum, metaPage);
+	IndexMetaInfo *metaInfo = reinterpret_cast<IndexMetaInfo *>(metaPage);
+	metaInfo->statisticsKept = metaPageInfo.statisticsKept;
+	metaInfo->statistics = metaPageInfo.statistics;
+	bufMgr->unPinPage(file, headerPageNum, true);
+	statisticsChanged = false;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::estimateRange and preferIndexScan
+// -----------------------------------------------------------------------------
+
+double BTreeIndex::estimateRange(const void* lowValParm, const Operator lowOpParm, const void* highValParm, const Operator highOpParm)
+{
+	if (!((lowOpParm == GT or lowOpParm == GTE) and (highOpParm == LT or highOpParm == LTE))) {
+		throw BadOpcodesException();
+	}
+	switch (attributeType) {
+	case INTEGER:
+		return estimateRangeKey<int>(keyAt<int>(lowValParm), lowOpParm, keyAt<int>(highValParm), highOpParm);
+	case DOUBLE:
+		return estimateRangeKey<double>(keyAt<double>(lowValParm), lowOpParm, keyAt<double>(highValParm), highOpParm);
+	case STRING:
+		return estimateRangeKey<StringKey>(keyAt<StringKey>(lowValParm), lowOpParm, keyAt<StringKey>(highValParm), highOpParm);
+	}
+	return 0;
+}
+
+template <class T>
+double BTreeIndex::estimateRangeKey(const T lowVal, const Operator lowOp, const T highVal, const Operator highOp)
+{
+	if (highVal < lowVal) {
+		throw BadScanrangeException();
+	}
+	std::unique_lock<std::mutex> guard(statisticsMutex, std::defer_lock);
+	if (concurrent) {
+		guard.lock();
+	}
+	const IndexStatistics &stats = metaPageInfo.statistics;
+	if (stats.entryCount == 0) {
+		return 0;
+	}
+	//without buckets the records are taken to be spread from the smallest key to the largest
+	const int buckets = std::max(1, stats.bucketCount);
+	double records = 0;
+	T lower = keyAt<T>(stats.minKey);
+	for (int b = 0; b < buckets; b++) {
+		//the last bucket reaches the largest key, which inserts may have taken past its bound
+		T upper = (b == buckets - 1) ? keyAt<T>(stats.maxKey) : keyAt<T>(stats.bucketBounds[b]);
+		if (upper < lower) {
+			upper = lower;
+		}
+		double bucketRecords = (stats.bucketCount == 0) ? stats.entryCount : stats.bucketCounts[b];
+		records += bucketRecords * bucketShare<T>(lower, upper, b > 0, lowVal, lowOp, highVal, highOp);
+		lower = upper;
+	}
+	return records;
+}
+
+bool BTreeIndex::preferIndexScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp,
+		const std::uint32_t relationPages)
+{
+	double matches = estimateRange(lowVal, lowOp, highVal, highOp);
+	IndexStatistics stats = getStatistics();
+	//the matches are taken to fill leaves as full as the leaves are on average
+	double leafRecords = (stats.levelPages[0] > 0) ? (double) stats.entryCount / stats.levelPages[0] : 1;
+	double leaves = std::max(1.0, std::ceil(matches / std::max(1.0, leafRecords)));
+	double indexPages = (stats.height - 1) + leaves + matches;
+	return indexPages < relationPages;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::fetchRange
+// -----------------------------------------------------------------------------
+
+size_t BTreeIndex::fetchRange(const void* lowValParm, const Operator lowOpParm, const void* highValParm, const Operator highOpParm,
+		std::vector<RecordId>& outRids, std::vector<std::string>& outRecords)
+{
+	//the record ids of the whole range are collected first, a batch at a time
+	std::vector<RecordId> rids;
+	{
+		IndexScanCursor cursor(this);
+		try {
+			cursor.startScan(lowValParm, lowOpParm, highValParm, highOpParm);
+		} catch (NoSuchKeyFoundException e) {
+			return 0;
+		}
+		std::vector<RecordId> batch(1024);
+		size_t fetched;
+		while ((fetched = cursor.scanNextBatch(batch.data(), batch.size())) > 0) {
+			rids.insert(rids.end(), batch.begin(), batch.begin() + fetched);
+		}
+		cursor.endScan();
+	}
+
+	//in page order every page of the relation holding a match is pinned once, and the pages are read front to back
+	std::sort(rids.begin(), rids.end(), [](const RecordId & a, const RecordId & b) {
+		return a.page_number < b.page_number || (a.page_number == b.page_number && a.slot_number < b.slot_number);
+	});
+	PageFile relation(std::string(metaPageInfo.relationName, strnlen(metaPageInfo.relationName, sizeof(metaPageInfo.relationName))), false);
+	outRids.reserve(outRids.size() + rids.size());
+	outRecords.reserve(outRecords.size() + rids.size());
+	size_t i = 0;
+	while (i < rids.size()) {
+		const PageId pageNo = rids[i].page_number;
+		Page* page;
+		bufMgr->readPage(&relation, pageNo, page);
+		for (; i < rids.size() && rids[i].page_number == pageNo; i++) {
+			outRids.push_back(rids[i]);
+			outRecords.push_back(page->getRecord(rids[i]));
+		}
+		bufMgr->unPinPage(&relation, pageNo, false);
+	}
+	//the frames of this handle on the relation must not outlive it
+	bufMgr->flushFile(&relation);
+	return rids.size();
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::setConcurrent
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::setConcurrent(const bool enable)
+{
+	if (enable && !concurrent) {
+		setLookupCacheSize(0);
+		setInnerNodesResident(false);
+		setSwizzling(false);
+		if (!latches) {
+			latches.reset(new std::atomic<std::uint64_t>[LATCH_STRIPES]());
+		}
+	} else if (!enable && concurrent) {
+		concurrent = false;
+		for (PageId pageNo : retiredPages) {
+			disposeNode(pageNo);
+		}
+		retiredPages.clear();
+	}
+	concurrent = enable;
+}
 
+// -----------------------------------------------------------------------------
+// Version latches
+// -----------------------------------------------------------------------------
 
-			//Part 2: We look at the right side of the split
-			
-			LeafNodeInt leafNode_2 = {{},{},childNode_1->rightSibPageNo};
-			for(int i = spIndex; i < size + 1; i++){
-				leafNode_2.ridArray[i - spIndex] = tempRecord[i];
-				leafNode_2.keyArray[i - spIndex] = tempKeyArray[i];
-			}
+std::uint64_t BTreeIndex::awaitLatch(const PageId pageNo) const
+{
+	const std::atomic<std::uint64_t> &latch = latches[pageNo % LATCH_STRIPES];
+	std::uint64_t version = latch.load(std::memory_order_acquire);
+	while (version & 1) {
+		std::this_thread::yield();
+		version = latch.load(std::memory_order_acquire);
+	}
+	return version;
+}
 
+bool BTreeIndex::checkLatch(const PageId pageNo, const std::uint64_t version) const
+{
+	//the reads of the node have to be done before the version is read again
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return latches[pageNo % LATCH_STRIPES].load(std::memory_order_relaxed) == version;
+}
 
-			//Creation of the new leaf nodes 
-			// Design Choice: The right side will be associated with current ID so that there is no need to reasign the
-			// a leaf that is not currently found here
-			
-			Page *newPage_1 = 0; 
-			Page *tempPage_1 = 0;
-			Page *&newPage_2 = tempPage_1;
-			bufMgr->allocPage(file,newID,newPage_2);
-			
-			// PageId temp_test = nfewID;
+bool BTreeIndex::tryLatch(const PageId pageNo, const std::uint64_t version)
+{
+	std::uint64_t expected = version;
+	return latches[pageNo % LATCH_STRIPES].compare_exchange_strong(expected, version + 1, std::memory_order_acquire);
+}
 
+void BTreeIndex::unlatch(const PageId pageNo)
+{
+	latches[pageNo % LATCH_STRIPES].fetch_add(1, std::memory_order_release);
+}
 
+void BTreeIndex::latchNode(const PageId pageNo)
+{
+	if (!concurrent) {
+		return;
+	}
+	//nodes sharing a counter are latched once
+	int stripe = pageNo % LATCH_STRIPES;
+	if (std::find(heldLatches.begin(), heldLatches.end(), stripe) != heldLatches.end()) {
+		return;
+	}
+	while (!tryLatch(pageNo, awaitLatch(pageNo))) {
+	}
+	heldLatches.push_back(stripe);
+}
 
-			
-			newPage_1 = (Page *) &leafNode_1;
-			newPage_2 = (Page *) &leafNode_2;
-			
-			//The keys then are writen to the file
-			PageId tempPage = newID;
-			PageId tempPageID = currentId;
-			file->writePage(tempPage,*newPage_1);
-			file->writePage(tempPageID,*newPage_2);
+void BTreeIndex::finishStructureChange()
+{
+	for (int stripe : heldLatches) {
+		latches[stripe].fetch_add(1, std::memory_order_release);
+	}
+	heldLatches.clear();
+	//pages unlinked by this and earlier writers cannot be reached by operations that start from now on
+	if (activeOperations.load() == 1) {
+		for (PageId pageNo : retiredPages) {
+			bufMgr->disposePage(file, pageNo);
+		}
+		retiredPages.clear();
+	}
+}
 
-			//This is the key that got split up
-			return tempKeyArray[spIndex];		
-		}else{
-			//Case when we have a non-leaf node split
+// -----------------------------------------------------------------------------
+// copiedLeaf:
+// whether an optimistic reader copies a leaf of keys of type T and checks its version before decoding it
+// -----------------------------------------------------------------------------
 
+template <class T>
+static constexpr bool copiedLeaf()
+{
+	//STRING leaves find keys through their slots and INTEGER leaves find record ids through capacity and bitWidth,
+	//which a torn read can pair with a keyCount they do not belong to
+	return std::is_same<T, StringKey>::value || std::is_same<T, int>::value;
+}
 
-			NonLeafNodeInt * childNode_1 = (NonLeafNodeInt *) childNode;
+// -----------------------------------------------------------------------------
+// BTreeIndex::descendOptimistic
+// -----------------------------------------------------------------------------
 
-			//We establish the two temp arrays that will be split between the two nodes
-			int tempKeyArray[INTARRAYNONLEAFSIZE + 1] = {};
-			PageId tempPage[INTARRAYNONLEAFSIZE + 2] = {};
+template <class T>
+bool BTreeIndex::descendOptimistic(const T keyValue, PageId &leafPageNo, std::uint64_t &leafVersion)
+{
+	//the meta page latch covers the root page number and the height
+	std::uint64_t metaVersion = awaitLatch(headerPageNum);
+	PageId currentId = rootPageNum.load(std::memory_order_relaxed);
+	int levels = height.load(std::memory_order_relaxed);
+	std::uint64_t version = awaitLatch(currentId);
+	if (!checkLatch(headerPageNum, metaVersion)) {
+		return false;
+	}
 
-			//A transfer of keys from the orign
-			for(int i = 0; i < INTARRAYNONLEAFSIZE; i++){
-				tempKeyArray[i] = childNode_1->keyArray[i];	
-				tempPage[i] = childNode_1->pageNoArray[i];
+	//torn STRING nodes could send their accessors outside the page, so they are copied and checked first
+	alignas(NonLeafNode<T>) char copy[std::is_same<T, StringKey>::value ? Page::SIZE : 1];
+	for (int i = 1; i < levels; i++) {
+		Page *page;
+		bufMgr->readPage(file, currentId, page);
+		const NonLeafNode<T> *node = (const NonLeafNode<T> *) page;
+		if (std::is_same<T, StringKey>::value) {
+			memcpy(copy, (void *) page, sizeof(copy));
+			node = (const NonLeafNode<T> *) copy;
+			if (!checkLatch(currentId, version)) {
+				bufMgr->unPinPage(file, currentId, false);
+				return false;
 			}
+		}
+		PageId nextId = node->childAt(node->upperBound(keyValue));
+		bufMgr->unPinPage(file, currentId, false);
+		//the child is only trusted once the node it came from is known not to have changed
+		std::uint64_t nextVersion = awaitLatch(nextId);
+		if (!checkLatch(currentId, version)) {
+			return false;
+		}
+		currentId = nextId;
+		version = nextVersion;
+	}
+	leafPageNo = currentId;
+	leafVersion = version;
+	return true;
+}
 
+// -----------------------------------------------------------------------------
+// BTreeIndex::lookupOptimistic
+// -----------------------------------------------------------------------------
 
-			// Adding the last pageID to temporary page array
-			tempPage[INTARRAYNONLEAFSIZE] = childNode_1->pageNoArray[INTARRAYNONLEAFSIZE];
-
-			// We find the index where the split should occur and move it
-			int index = findIndex(tempKeyArray,INTARRAYNONLEAFSIZE,keyValue,{},0);
-			moveKeyIndex(tempKeyArray,INTARRAYNONLEAFSIZE,index);
-			
-
-
-			//This is making sure the pageid is moving over and we are inserting the new one
-			insertMovePage(tempPage,childPageId_1,childPageId_2,INTARRAYNONLEAFSIZE + 1);
-			
+template <class T>
+BTreeIndex::Attempt BTreeIndex::lookupOptimistic(const T keyValue, RecordId &outRid)
+{
+	PageId leafId;
+	std::uint64_t version;
+	if (!descendOptimistic<T>(keyValue, leafId, version)) {
+		return RETRY;
+	}
 
-			//We calculate the index for the split 
-			int spIndex = INTARRAYNONLEAFSIZE/2 + INTARRAYNONLEAFSIZE%2;
+	Page *page;
+	bufMgr->readPage(file, leafId, page);
+	const LeafNode<T> *leaf = (const LeafNode<T> *) page;
+	alignas(LeafNode<T>) char copy[copiedLeaf<T>() ? Page::SIZE : 1];
+	if (copiedLeaf<T>()) {
+		memcpy(copy, (void *) page, sizeof(copy));
+		leaf = (const LeafNode<T> *) copy;
+		if (!checkLatch(leafId, version)) {
+			bufMgr->unPinPage(file, leafId, false);
+			return RETRY;
+		}
+	}
+	int index = leaf->lowerBound(keyValue);
+	bool found = index < leaf->header.keyCount && leaf->keyAt(index) == keyValue;
+	RecordId rid;
+	if (found) {
+		rid = leaf->ridAt(index);
+	}
+	if (found && isPostingList(rid)) {
+		//writers change posting lists only with the leaf latched
+		PageId headPageNo = rid.page_number;
+		Page *headPage;
+		bufMgr->readPage(file, headPageNo, headPage);
+		rid = ((PostingPage *) headPage)->first();
+		bufMgr->unPinPage(file, headPageNo, false);
+	}
+	bufMgr->unPinPage(file, leafId, false);
+	if (!checkLatch(leafId, version)) {
+		return RETRY;
+	}
+	if (!found) {
+		return FAILED;
+	}
+	outRid = rid;
+	return SUCCEEDED;
+}
 
+// -----------------------------------------------------------------------------
+// BTreeIndex::insertInPlace
+// -----------------------------------------------------------------------------
 
-			
-			NonLeafNodeInt childNode_1_1 = {{},{},childPageId_1};
-			NonLeafNodeInt childNode_2 = {{},{},childPageId_2};
-																	 
-			//Part 1: We split the left
-			for(int i = 0; i < spIndex; i++){
-				childNode_1_1.keyArray[i] = tempKeyArray[i];
-				childNode_1_1.pageNoArray[i] = tempPage[i];
-			}
-			childNode_1_1.pageNoArray[spIndex] = tempPage[spIndex];
-			
-			
-
-			//We split the right
-			for(int i = spIndex + 1; i < INTARRAYNONLEAFSIZE; i++){
-				childNode_2.keyArray[i-(spIndex + 1)] = tempKeyArray[i];
-				childNode_2.pageNoArray[i - (spIndex + 1)] = tempPage[i];
-			}
-			childNode_2.pageNoArray[INTARRAYNONLEAFSIZE - spIndex + 1] = tempPage[INTARRAYNONLEAFSIZE];
-			
-			//Writing your pages
-			Page *tempPage_2 = 0;
-			Page *&newPage_1 = tempPage_2;
-			bufMgr->allocPage(file,newID,newPage_1);
-			//for consistency the currentId is associated with the left side of the split while the newID is associated with the right side of the split
-			newPage_1 = (Page *) &childNode_1_1;	
-			PageId tempPageId = currentId;	
-			file->writePage(tempPageId,*newPage_1);
-			newPage_1 = (Page *) &childNode_2;
-			PageId tempId_2 = newID;
-			file->writePage(tempId_2,*newPage_1);
+template <class T>
+BTreeIndex::Attempt BTreeIndex::insertInPlace(const T keyValue, const RecordId rid, const char *included, bool & added)
+{
+	added = false;
+	PageId leafId;
+	std::uint64_t version;
+	if (!descendOptimistic<T>(keyValue, leafId, version) || !tryLatch(leafId, version)) {
+		return RETRY;
+	}
 
-			//We return the key
-			return tempKeyArray[spIndex];		
+	Page *page;
+	bufMgr->readPage(file, leafId, page);
+	LeafNode<T> *leaf = (LeafNode<T> *) page;
+	int index = leaf->lowerBound(keyValue);
+	Attempt attempt = SUCCEEDED;
+	bool dirty = true;
+	if (index < leaf->header.keyCount && leaf->keyAt(index) == keyValue) {
+		//Case: the key is already indexed, the record id joins its posting list
+		RecordId existing = leaf->ridAt(index);
+		dirty = false;
+		if (isPostingList(existing)) {
+			added = addToPostingList(existing.page_number, rid, included);
+		} else if (existing != rid) {
+			std::vector<RecordId> rids;
+			std::vector<char> columns;
+			pairPostingList(existing, leaf->includedAt(index), rid, included, includedBytes, rids, columns);
+			leaf->setRidAt(index, writePostingList(rids, columns));
+			added = true;
+			dirty = true;
 		}
-	} catch(duplicateKeyException e){
-		throw duplicateKeyException();
+	} else if (!leaf->insertAt(index, keyValue, rid, included)) {
+		//Case: the leaf is full and nothing was changed
+		attempt = FAILED;
+		dirty = false;
+	} else {
+		added = true;
 	}
+	bufMgr->unPinPage(file, leafId, dirty);
+	unlatch(leafId);
+	return attempt;
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::insertEntry
+// BTreeIndex::insertConcurrent and deleteConcurrent
 // -----------------------------------------------------------------------------
 
-const void BTreeIndex::insertEntry(const void *key, const RecordId rid) 
-{
-	// The try catch is for a duplicate key instance.  
-	// It is easier than having some condition checking
-	try{		
-		Page* rootPage = NULL;
-		this->bufMgr->readPage(file,rootPageNum,rootPage);
-		int * keyValue = (int *) key;
-
-		if(this->height == 1){
-			//Edge Case: When root node is leafNode 
-			//
-
-			struct LeafNodeInt *rootNode = (LeafNodeInt *) rootPage;
-
-			if(checkOccupancy(rootNode->keyArray,INTARRAYLEAFSIZE,1,NULL,rootNode->ridArray)){
-				/**
-				// Case: When Root Node is full
-				// example: | 3 | 5 | 10 | 20 | 
-				//		   /    |	|	 |	   \
-				//		  *		*   *	 *      *
-				*/
-				PageId tempID = 0;
-				PageId &newID = tempID;
-				// We are spliting down the array
-				// However we are encapsulating this in a helper function to increase reusabilty
-				int key = split(rootNode,1,newID,this->rootPageNum,*keyValue,rid,0,{});
-				// in the example 7 wfas inserted and is the key that gets pushed up
-				// We just need to allocate it as a root node 
-				/**
-				// example:        | 7 |
-				//                /     \
-				//	  	 | 3 | 5 |       | 7 | 10 | 20 |
-				*/
-
-
-				//We create a new root node.
-				// int newRootKeys[INTARRAYNONLEAFSIZE] = {key};
-
-				
-				NonLeafNodeInt newRootNode = {1,{key},{this->rootPageNum,newID}};
-				
-				//We write the new page to memory
-				Page *tempPage = 0;			
-				Page *&newPage = tempPage; 
-				PageId tempRootNum = 0;
-				PageId &newRootNum = tempRootNum; 
-				this->bufMgr->allocPage(file,newRootNum,newPage);
-				newPage = (Page *) &newRootNode;
-				PageId tempValue = tempRootNum;
-				this->file->writePage(tempValue,*newPage);
-				
-				//We then maintain some externals
-				this->rootPageNum = newRootNum;
-				this->height++;
-				//A level corrective measure
-				correctHeight();
-			}else{
-				// We simply insert the new key and the new rid 
-				// Starting with finding the index were we need to add
-				int index = findIndex(rootNode->keyArray, INTARRAYLEAFSIZE, *(keyValue),rootNode->ridArray,1);
-				/**
-				// Case: When the index is the right most key slot in the array
-				// example: key_to_insert = 20
-				//        | 11 | 12 | 13 | 15| * |
-				//       /     |	|    |   |    \
-				//      *	   *    *    *   *     *
-				*/
-				if(index == INTARRAYLEAFSIZE-1){
-					rootNode->keyArray[index] = *keyValue;
-					rootNode->ridArray[index] = rid;
-				}else{
-					//Case: When the index is in the middle somewhere
-					
-					//We move the values over at these points
-					moveKeyIndex(rootNode->keyArray,INTARRAYLEAFSIZE,index);
-					moveRecordIndex(rootNode->ridArray,INTARRAYLEAFSIZE,index);
-				
-					//We set the values
-					rootNode->keyArray[index] = *keyValue;
-					rootNode->ridArray[index] = rid;
-
-
-				}
-			}
-		}else { 
-			//Case: This is the more generic case when the root node is not a leaf node
-			NonLeafNodeInt *rootNode = (NonLeafNodeInt *) rootPage;		
-			
-			// The stacks are to help us keep track of the nodes that have been visited already
-			// Simulating recursion but more memory efficient
-			Stack depthListNode(rootNode);
-			Stack depthListID(&rootPageNum);
-			//These serve as place holders in our loop
-			PageId tempID = 0;
-			PageId &currentId = tempID;
-			Page *tempPage = 0;
-			Page *&currentPage = tempPage;
-			//We are now iterating down the chain to the leaf node
-			//We Start at one because we alread added the root node to our list
-			
-			for(int i = 1; i < height - 1; i++){
-				//We find the index  This works stil because the child page id array
-				// is one size larger than the key array
-				int index = findIndex(rootNode->keyArray,INTARRAYNONLEAFSIZE,*keyValue,{},0);
-				currentId = rootNode->pageNoArray[index];
-				//Reading of the new Node into memory
-				this->bufMgr->readPage(file,currentId,currentPage);
-				//Casting the new node to a non-leaf node
-				rootNode = (NonLeafNodeInt *) currentPage;
-				//We push this level of itteration on to tree
-				depthListNode.pushNode(rootNode);
-				depthListID.pushNode(&currentId);
-			}
-			
-			//Now we can cast the last one as a leaf node.
-			int index = findIndex(rootNode->keyArray,INTARRAYNONLEAFSIZE,*keyValue,{},0);
-			currentId = rootNode->pageNoArray[index];
-			this->bufMgr->readPage(file,currentId,currentPage);
-			LeafNodeInt * leafNode = (LeafNodeInt *) currentPage;
-		
-			// A check is completed for a the need  to split
-		// }
-			if(checkOccupancy(leafNode->keyArray,INTARRAYLEAFSIZE,1,NULL,leafNode->ridArray))	{
-				PageId tempID = 0;
-				PageId &newID = tempID;
-				//We complete the initial split
-				int currentkey = split(leafNode,1,newID,currentId,*keyValue,rid,0,0);
-
-				//These are the children Ids that may nee to be used in the next split 
-				PageId child_Id_1 = (PageId) currentId;
-				PageId child_Id_2 = (PageId) newID;
-				
-				//We iterate back up the stack to verify 
-				for(int i = 0; i < height; i++){				
-					NonLeafNodeInt *currentNode = (NonLeafNodeInt *) depthListNode.peek();
-					PageId *currentId = (PageId *) depthListID.peek();
-					if(checkOccupancy(currentNode->keyArray,INTARRAYNONLEAFSIZE,0,currentNode->pageNoArray,NULL)){
-						if(i + 1 == height){
-							//Case: a non-leaf root node is full and a split is neccesary
-							PageId tempVal = *currentId; 				
-							int *tempkey = &currentkey;
-							PageId* child_Id_1_1 = &child_Id_1;
-							PageId* child_Id_1_2 = &child_Id_2;	
-							currentkey = split_1(currentNode,0,newID, tempVal,*tempkey,{},*child_Id_1_1,*child_Id_1_2);
-
-							//The set up for the new root node
-						
-							NonLeafNodeInt newNode = {1, {currentkey},{*currentId,newID}};
-
-							//Placement of page into memory of the root node
-							Page *tempPage2 = 0;
-							Page *&newPage = tempPage2;
-							PageId tempID = 0;
-							PageId &newID_1 = tempID;
-							this->bufMgr->allocPage(this->file,newID_1,newPage);
-							newPage = (Page *) &newNode;
-							PageId tempID2 = newID_1;
-							this->file->writePage(tempID2,*newPage);
-
-							//Taking care of some externals
-							this->rootPageNum = newID_1;
-							this->height++;
-							correctHeight();
-	 					}else{
-							currentkey = split_1(currentNode,0,newID,*currentId,currentkey,{},child_Id_1,child_Id_2);
-							//We reassign the two child nodes for the next time we go through
-							child_Id_1 = (PageId) newID;
-							child_Id_2 = (PageId) *currentId;
-							//Now we finish with poping the last one off the top.
-							depthListNode.pop();
-							depthListID.pop();
-						}
-					}else{
-						//Case: a non leaf node has room for us to insert the key
-						int index = findIndex(currentNode->keyArray,INTARRAYNONLEAFSIZE,currentkey,{},0);
-						moveKeyIndex(currentNode->keyArray,INTARRAYNONLEAFSIZE,index);
-						
-						//We need to move the pageId children over 1
-						//insertMovePage(currentNode->pageNoArray,currentId,newID,INTARRAYNONLEAFSIZE);
-						insertMovePage(currentNode->pageNoArray,*currentId,newID,INTARRAYNONLEAFSIZE);
-						currentNode->keyArray[index] = currentkey;
-						
-						break;
-					}
-				}
-			}
-		
-			else{
-
-		
-				 	
-				int index = findIndex(leafNode->keyArray,INTARRAYLEAFSIZE,*keyValue,{},0);
-				if(index == (INTARRAYLEAFSIZE - 1)){
-					//insertion on to the right side
-					leafNode->keyArray[index] = *keyValue;
-					leafNode->ridArray[index] = rid;
-				}else{
-					//Now we might need to move the key and record id over to fit it in
-					moveKeyIndex(leafNode->keyArray,INTARRAYLEAFSIZE,index);
-					moveRecordIndex(leafNode->ridArray,INTARRAYLEAFSIZE,index);
-					leafNode->keyArray[index] = *keyValue;
-					leafNode->ridArray[index] = rid;
-				}
-				currentPage = (Page *) leafNode;
-				PageId tempId_3 = (PageId) currentId;
-				this->file->writePage(tempId_3,*currentPage);			
-			}
+template <class T>
+bool BTreeIndex::insertConcurrent(const T keyValue, const RecordId rid, const char *included)
+{
+	activeOperations++;
+	//every insert changes the counts of a counting index all the way up, so it always takes the structure path
+	Attempt attempt = FAILED;
+	bool added = false;
+	while (!subtreeCounts && (attempt = insertInPlace<T>(keyValue, rid, included, added)) == RETRY) {
+	}
+	if (attempt == FAILED) {
+		//Case: the leaf has to split, or counts have to change, the writer goes down again with the structure to itself
+		std::lock_guard<std::mutex> guard(structureMutex);
+		try {
+			added = insertKey<T>(keyValue, rid, included);
+		} catch (...) {
+			finishStructureChange();
+			activeOperations--;
+			throw;
 		}
-// }
-			//Now we need to figure out what we need to do for inserting into array
-		// }
-	} catch(duplicateKeyException &e){
-		// Silence is Golden.
-		// Do nothing		
+		finishStructureChange();
 	}
+	activeOperations--;
+	return added;
+}
 
-		//This will be the boolean for the while loop 
+template <class T>
+void BTreeIndex::deleteConcurrent(const T keyValue, const RecordId rid)
+{
+	activeOperations++;
+	std::lock_guard<std::mutex> guard(structureMutex);
+	try {
+		deleteKey<T>(keyValue, rid);
+	} catch (...) {
+		finishStructureChange();
+		activeOperations--;
+		throw;
+	}
+	finishStructureChange();
+	activeOperations--;
 }
 
     // Helper function to find the page ID of the next level of page, return the  page ID of node in the next level
 
-    const void BTreeIndex::find_next_nonleaf_node(NonLeafNodeInt* curpage, PageId& nextpageID, int key)
+    template <class T>
+    void BTreeIndex::find_next_nonleaf_node(NonLeafNode<T>* curpage, PageId& nextpageID, const T key)
     {
-        int q = nodeOccupancy;
-        //compare the key values in the node with the parameter key, if greater go left
-        while (q > 0 && (curpage->keyArray[q - 1] >= key))
-        {
-            q--;
-        }
-        //if the child page is null, go left
-        while (q >= 0 && (curpage->pageNoArray[q] == 0))
-        {
-            q--;
-        }
+        //the first separator not less than the key; keys equal to it are looked for on its left
+        int q = curpage->lowerBound(key);
         //return the page ID
-        nextpageID = curpage->pageNoArray[q];
+        nextpageID = curpage->childAt(q);
     }
+
+// -----------------------------------------------------------------------------
+// IndexScanCursor::IndexScanCursor -- Constructor
+// -----------------------------------------------------------------------------
+
+IndexScanCursor::IndexScanCursor(BTreeIndex *index)
+	: index(index), scanExecuting(false), nextEntry(0), leafEnd(0), leafStart(0), lastLeaf(true), descending(false),
+	  currentPageNum(Page::INVALID_NUMBER), currentPageData(nullptr), nextPosting(0), readaheadIssued(0),
+	  moreParents(false)
+{
+}
+
+// -----------------------------------------------------------------------------
+// IndexScanCursor::~IndexScanCursor -- destructor
+// -----------------------------------------------------------------------------
+
+IndexScanCursor::~IndexScanCursor()
+{
+	//a cursor dropped in the middle of a scan still lets go of its leaf
+	if (scanExecuting) {
+		endScan();
+	}
+}
+
+bool IndexScanCursor::isScanning() const
+{
+	return scanExecuting;
+}
+
+    // The scan bounds of each key type live in their own members
+
+    template <>
+    int &IndexScanCursor::scanLowVal<int>() { return lowValInt; }
+    template <>
+    int &IndexScanCursor::scanHighVal<int>() { return highValInt; }
+    template <>
+    double &IndexScanCursor::scanLowVal<double>() { return lowValDouble; }
+    template <>
+    double &IndexScanCursor::scanHighVal<double>() { return highValDouble; }
+    template <>
+    StringKey &IndexScanCursor::scanLowVal<StringKey>() { return lowValString; }
+    template <>
+    StringKey &IndexScanCursor::scanHighVal<StringKey>() { return highValString; }
+    template <>
+    int &IndexScanCursor::readaheadFence<int>() { return fenceInt; }
+    template <>
+    double &IndexScanCursor::readaheadFence<double>() { return fenceDouble; }
+    template <>
+    StringKey &IndexScanCursor::readaheadFence<StringKey>() { return fenceString; }
+
     // -----------------------------------------------------------------------------
-    // BTreeIndex::startScan
+    // IndexScanCursor::startScan
     // -----------------------------------------------------------------------------
      /**
          * Begin a filtered scan of the index.  For instance, if the method is called
@@ -878,19 +3386,30 @@ const void BTreeIndex::insertEntry(const void *key, const RecordId rid)
        * @throws  BadScanrangeException If lowVal > highval
          * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
         **/
-    const void BTreeIndex::startScan(const void* lowValParm,
+    const void IndexScanCursor::startScan(const void* lowValParm,
         const Operator lowOpParm,
         const void* highValParm,
         const Operator highOpParm)
     {
-        lowValInt = *((int*)lowValParm);
-        highValInt = *((int*)highValParm);
-        //throws  BadScanrangeException If lowVal > highval
-        if (lowValInt > highValInt) {
-            throw BadScanrangeException();
-        }
+        beginScan(lowValParm, lowOpParm, highValParm, highOpParm, false);
+    }
+
+    const void IndexScanCursor::startReverseScan(const void* lowValParm,
+        const Operator lowOpParm,
+        const void* highValParm,
+        const Operator highOpParm)
+    {
+        beginScan(lowValParm, lowOpParm, highValParm, highOpParm, true);
+    }
+
+    void IndexScanCursor::beginScan(const void* lowValParm,
+        const Operator lowOpParm,
+        const void* highValParm,
+        const Operator highOpParm,
+        const bool descendingParm)
+    {
         //throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
-        if ((lowOpParm == GT or lowOpParm == GTE) and (highOpParm == LT or highOpParm == LTE) == false) {
+        if (!((lowOpParm == GT or lowOpParm == GTE) and (highOpParm == LT or highOpParm == LTE))) {
             throw BadOpcodesException();
         }
         //If another scan is already executing, that needs to be ended here.
@@ -898,87 +3417,231 @@ const void BTreeIndex::insertEntry(const void *key, const RecordId rid)
         {
             endScan();
         }
+        lowOp = lowOpParm;
+        highOp = highOpParm;
+        descending = descendingParm;
+
+        switch (index->attributeType) {
+        case INTEGER:
+            lowValInt = keyAt<int>(lowValParm);
+            highValInt = keyAt<int>(highValParm);
+            descending ? startReverseScanKey<int>() : startScanKey<int>();
+            break;
+        case DOUBLE:
+            lowValDouble = keyAt<double>(lowValParm);
+            highValDouble = keyAt<double>(highValParm);
+            descending ? startReverseScanKey<double>() : startScanKey<double>();
+            break;
+        case STRING:
+            lowValString = keyAt<StringKey>(lowValParm);
+            highValString = keyAt<StringKey>(highValParm);
+            descending ? startReverseScanKey<StringKey>() : startScanKey<StringKey>();
+            break;
+        }
+    }
+
+    template <class T>
+    void IndexScanCursor::startScanKey()
+    {
+        const T lowVal = scanLowVal<T>();
+        const T highVal = scanHighVal<T>();
+        //throws  BadScanrangeException If lowVal > highval
+        if (highVal < lowVal) {
+            throw BadScanrangeException();
+        }
 
+        //the leaves after the first one are listed on the way down, for reading them ahead
+        const bool readahead = index->scanReadahead > 0;
+        upcomingLeaves.clear();
+        readaheadIssued = 0;
+        moreParents = false;
 
         //scanning root page to the buffer pool
-        bufMgr->readPage(file, rootPageNum, currentPageData);
-        currentPageNum = rootPageNum;
+        currentPageData = index->readNode(index->rootPageNum);
+        currentPageNum = index->rootPageNum;
         // in case the root is a non-leaf 
-        if (height != 1) {
-            NonLeafNodeInt* curNode = (NonLeafNodeInt*)currentPageData;
+        if (index->height != 1) {
+            NonLeafNode<T>* curNode = (NonLeafNode<T>*)currentPageData;
             bool check_level = false;
-            //interate till reach the curNode->level =1 
+            //interate till reach the level just above the leaves
             while (!check_level) {
-                curNode = (NonLeafNodeInt*)currentPageData;
+                curNode = (NonLeafNode<T>*)currentPageData;
                 //once found the correct level right above leaf
-                if (curNode->level == 1) {
+                if (curNode->header.level == 1) {
                     check_level = true;
                 }
+                if (readahead) {
+                    int position = curNode->lowerBound(lowVal);
+                    if (check_level) {
+                        listLeaves<T>(curNode, position + 1);
+                    } else if (position < curNode->header.keyCount) {
+                        //the nearest separator on the right of the path bounds the parent that is listed
+                        readaheadFence<T>() = curNode->keyAt(position);
+                        moreParents = true;
+                    }
+                }
                 PageId nextPageID;
                 //fetch the next page Id at the next level
-                find_next_nonleaf_node(curNode, nextPageID, lowValInt);
+                index->find_next_nonleaf_node<T>(curNode, nextPageID, lowVal);
                 //unpin page for current page
-                bufMgr->unPinPage(file, currentPageNum, false);
+                index->releaseNode(currentPageNum, false);
                 currentPageNum = nextPageID;
                 //pin page for this leaf node
-                bufMgr->readPage(file, currentPageNum, currentPageData);
+                currentPageData = index->readNode(currentPageNum);
 
 
             }
         }
 
         //assume, we are at the leaf node
-        int iter = 0;
-        bool is_found = false;
-        while (!is_found) {
-            LeafNodeInt* curNode = (LeafNodeInt*)currentPageData;
-            //check if the node is empty
-            if (curNode->ridArray[iter].page_number == 0) {
-                throw NoSuchKeyFoundException();
-            }
-            //iterate through the node
-            for (int i = 0; i < leafOccupancy; i++) {
-                int key = curNode->keyArray[i];
-                //cases found the key
-                if (is_key_in_range(key, lowValInt, lowOpParm, highValInt, highOpParm)) {
-                    is_found = true;
-                    nextEntry = i;
-                    scanExecuting = true;
-                    break;
-                }
-                else if (!(highOp == LTE and key <= highValInt) && (highOp == LT and key < highValInt)) {
-                    throw NoSuchKeyFoundException();
-                }
-
-                // if did not find any matching key in this leaf, go to its sibling
-                if (i == leafOccupancy - 1) {
-                    //unpin page
-                    bufMgr->unPinPage(file, currentPageNum, false);
-                    //if even did not find the matching one in right leaf
-                    if (curNode->rightSibPageNo == 0)
-                    {
-                        throw NoSuchKeyFoundException();
-                    }
-                    //else
-                    currentPageNum = curNode->rightSibPageNo;
-                    //read the siblin page and pin it
-                    bufMgr->readPage(file, currentPageNum, currentPageData);
-                }
+        LeafNode<T>* curNode = (LeafNode<T>*)currentPageData;
+        int count = curNode->header.keyCount;
+        //first entry satisfying the low bound
+        nextEntry = (lowOp == GTE) ? curNode->lowerBound(lowVal) : curNode->upperBound(lowVal);
+        //the descent goes left on keys equal to a separator, so the entry may be in a right sibling
+        while (nextEntry == count && curNode->rightSibPageNo != Page::INVALID_NUMBER) {
+            index->releaseNode(currentPageNum, false);
+            currentPageNum = curNode->rightSibPageNo;
+            currentPageData = index->readNode(currentPageNum);
+            curNode = (LeafNode<T>*)currentPageData;
+            count = curNode->header.keyCount;
+            nextEntry = (lowOp == GTE) ? curNode->lowerBound(lowVal) : curNode->upperBound(lowVal);
+        }
+        if (highOp == LT) {
+            findLeafEnd<T, LT>();
+        } else {
+            findLeafEnd<T, LTE>();
+        }
+        //keys are sorted, so if the first candidate is past the high value nothing can match
+        if (nextEntry >= leafEnd) {
+            index->releaseNode(currentPageNum, false);
+            throw NoSuchKeyFoundException();
+        }
+        if (readahead) {
+            readAhead<T>();
+        }
+        nextPosting = 0;
+        scanExecuting = true;
+    }
 
+    template <class T>
+    void IndexScanCursor::listLeaves(const NonLeafNode<T>* parent, const int first)
+    {
+        const T& highVal = scanHighVal<T>();
+        for (int i = first; i <= parent->header.keyCount; i++) {
+            //the keys of child i are not less than separator i - 1
+            if (i > 0 && highVal < parent->keyAt(i - 1)) {
+                moreParents = false;
+                return;
             }
+            upcomingLeaves.push_back(parent->childAt(i));
+        }
+    }
 
+    template <class T>
+    void IndexScanCursor::listNextParent()
+    {
+        const T fence = readaheadFence<T>();
+        moreParents = false;
+        if (scanHighVal<T>() < fence) {
+            return;
+        }
+        //keys equal to a separator live on its right, so the parent after the fence is found with upperBound
+        PageId pageNo = index->rootPageNum;
+        NonLeafNode<T>* node = (NonLeafNode<T>*)index->readNode(pageNo);
+        while (node->header.level > 1) {
+            int position = node->upperBound(fence);
+            if (position < node->header.keyCount) {
+                readaheadFence<T>() = node->keyAt(position);
+                moreParents = true;
+            }
+            PageId child = node->childAt(position);
+            index->releaseNode(pageNo, false);
+            pageNo = child;
+            node = (NonLeafNode<T>*)index->readNode(pageNo);
+        }
+        listLeaves<T>(node, node->upperBound(fence));
+        index->releaseNode(pageNo, false);
+    }
 
+    template <class T>
+    void IndexScanCursor::readAhead()
+    {
+        if (lastLeaf) {
+            //the scan ends in this leaf, nothing after it is needed
+            upcomingLeaves.clear();
+            readaheadIssued = 0;
+            moreParents = false;
+            return;
         }
+        //the current leaf is usually at the front; leaves it went past, or one not listed, are dropped with it
+        auto current = std::find(upcomingLeaves.begin(), upcomingLeaves.end(), currentPageNum);
+        if (current != upcomingLeaves.end()) {
+            size_t passed = current - upcomingLeaves.begin() + 1;
+            upcomingLeaves.erase(upcomingLeaves.begin(), current + 1);
+            readaheadIssued -= std::min(readaheadIssued, passed);
+        }
+        const size_t leaves = index->scanReadahead;
+        if (upcomingLeaves.size() < leaves && moreParents) {
+            listNextParent<T>();
+        }
+        //a request the buffer manager refuses is made again from the next leaf
+        while (readaheadIssued < std::min(leaves, upcomingLeaves.size())
+                && index->bufMgr->prefetchPage(index->file, upcomingLeaves[readaheadIssued])) {
+            readaheadIssued++;
+        }
+    }
 
+    template <class T>
+    void IndexScanCursor::startReverseScanKey()
+    {
+        const T lowVal = scanLowVal<T>();
+        const T highVal = scanHighVal<T>();
+        if (highVal < lowVal) {
+            throw BadScanrangeException();
+        }
 
+        //descend towards the last key within the high bound; keys equal to a separator live on its right
+        currentPageNum = index->rootPageNum;
+        currentPageData = index->readNode(currentPageNum);
+        while (((NodeHeader*)currentPageData)->level > 0) {
+            NonLeafNode<T>* curNode = (NonLeafNode<T>*)currentPageData;
+            int position = (highOp == LTE) ? curNode->upperBound(highVal) : curNode->lowerBound(highVal);
+            PageId nextPageID = curNode->childAt(position);
+            index->releaseNode(currentPageNum, false);
+            currentPageNum = nextPageID;
+            currentPageData = index->readNode(currentPageNum);
+        }
 
+        LeafNode<T>* curNode = (LeafNode<T>*)currentPageData;
+        //last entry satisfying the high bound
+        nextEntry = ((highOp == LTE) ? curNode->upperBound(highVal) : curNode->lowerBound(highVal)) - 1;
+        //every key of the leaves on the left is under the high value, but deletes can leave some of them empty
+        while (nextEntry < 0 && curNode->leftSibPageNo != Page::INVALID_NUMBER) {
+            index->releaseNode(currentPageNum, false);
+            currentPageNum = curNode->leftSibPageNo;
+            currentPageData = index->readNode(currentPageNum);
+            curNode = (LeafNode<T>*)currentPageData;
+            nextEntry = curNode->header.keyCount - 1;
+        }
+        if (lowOp == GT) {
+            findLeafStart<T, GT>();
+        } else {
+            findLeafStart<T, GTE>();
+        }
+        if (nextEntry < leafStart) {
+            index->releaseNode(currentPageNum, false);
+            throw NoSuchKeyFoundException();
+        }
+        nextPosting = 0;
+        scanExecuting = true;
     }
 
 
 
 
     // -----------------------------------------------------------------------------
-    // BTreeIndex::scanNext
+    // IndexScanCursor::scanNext
     // -----------------------------------------------------------------------------
       /**
          * Fetch the record id of the next index entry that matches the scan.
@@ -987,74 +3650,310 @@ const void BTreeIndex::insertEntry(const void *key, const RecordId rid)
          * @throws ScanNotInitializedException If no scan has been initialized.
          * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
         **/
-    const void BTreeIndex::scanNext(RecordId& outRid)
+    const void IndexScanCursor::scanNext(RecordId& outRid)
+    {
+        scanNext(outRid, nullptr);
+    }
+
+    const void IndexScanCursor::scanNext(RecordId& outRid, void* included)
     {
         //if the scan not initialized
         if (!scanExecuting) {
             throw ScanNotInitializedException();
         }
-        //set current node to be the current page
-        LeafNodeInt* curNode = (LeafNodeInt*)currentPageData;
-        //if reach the end of node, go to sibling
-        if (curNode->ridArray[nextEntry].page_number == 0 || nextEntry == leafOccupancy) {
-            bufMgr->unPinPage(file, currentPageNum, false);
-            // if reach end of leaf
-            if (curNode->rightSibPageNo == 0)
-            {
+        char* columns = (char*)included;
+        switch (index->attributeType) {
+        case INTEGER:
+            descending ? scanPrevKey<int>(outRid, columns) : scanNextKey<int>(outRid, columns);
+            break;
+        case DOUBLE:
+            descending ? scanPrevKey<double>(outRid, columns) : scanNextKey<double>(outRid, columns);
+            break;
+        case STRING:
+            descending ? scanPrevKey<StringKey>(outRid, columns) : scanNextKey<StringKey>(outRid, columns);
+            break;
+        }
+    }
+
+    template <class T>
+    void IndexScanCursor::scanNextKey(RecordId& outRid, char* included)
+    {
+        //if reach the end of the matching entries of the node, go to sibling; deletes can leave leaves empty along the way
+        while (nextEntry == leafEnd) {
+            bool moved = (highOp == LT) ? nextLeaf<T, LT>() : nextLeaf<T, LTE>();
+            if (!moved) {
                 throw IndexScanCompletedException();
             }
-            PageId siblingPageNum = curNode->rightSibPageNo;
-            //fetch sibling page
-            bufMgr->readPage(file, siblingPageNum, currentPageData);
-            curNode = (LeafNodeInt*)currentPageData;
-            //set the index of next entry to 0
-            nextEntry = 0;
         }
 
-        int key = curNode->keyArray[nextEntry];
-        //check if key is valid
-        if (is_key_in_range(key, lowValInt, lowOp, highValInt, highOp)) {
+        //set current node to be the current page
+        LeafNode<T>* curNode = (LeafNode<T>*)currentPageData;
+        const int includedBytes = index->includedBytes;
+        RecordId rid = curNode->ridAt(nextEntry);
+        if (!isPostingList(rid)) {
             //return the rid of the next entry
-            outRid = curNode->ridArray[nextEntry];
+            outRid = rid;
+            if (included != nullptr) {
+                std::copy_n(curNode->includedAt(nextEntry), includedBytes, included);
+            }
+            nextEntry++;
+            return;
+        }
+        //the whole posting list of a shared key is read when its first record id is asked for
+        if (nextPosting == 0) {
+            index->readPostingList(rid.page_number, scanPostings, &scanPostingIncluded);
+        }
+        if (included != nullptr) {
+            std::copy_n(scanPostingIncluded.begin() + nextPosting * includedBytes, includedBytes, included);
+        }
+        outRid = scanPostings[nextPosting++];
+        if (nextPosting == scanPostings.size()) {
+            nextPosting = 0;
             nextEntry++;
         }
-        else {
-            throw IndexScanCompletedException();
+    }
+
+    template <class T>
+    void IndexScanCursor::scanPrevKey(RecordId& outRid, char* included)
+    {
+        //past the first matching entry of the leaf, go to the left sibling
+        while (nextEntry < leafStart) {
+            bool moved = (lowOp == GT) ? prevLeaf<T, GT>() : prevLeaf<T, GTE>();
+            if (!moved) {
+                throw IndexScanCompletedException();
+            }
+        }
+
+        LeafNode<T>* curNode = (LeafNode<T>*)currentPageData;
+        const int includedBytes = index->includedBytes;
+        RecordId rid = curNode->ridAt(nextEntry);
+        if (!isPostingList(rid)) {
+            outRid = rid;
+            if (included != nullptr) {
+                std::copy_n(curNode->includedAt(nextEntry), includedBytes, included);
+            }
+            nextEntry--;
+            return;
+        }
+        //a shared key hands out its posting list from the back
+        if (nextPosting == 0) {
+            index->readPostingList(rid.page_number, scanPostings, &scanPostingIncluded);
+        }
+        size_t position = scanPostings.size() - 1 - nextPosting++;
+        if (included != nullptr) {
+            std::copy_n(scanPostingIncluded.begin() + position * includedBytes, includedBytes, included);
+        }
+        outRid = scanPostings[position];
+        if (nextPosting == scanPostings.size()) {
+            nextPosting = 0;
+            nextEntry--;
         }
     }
 
-        // Helper function to see whether the key is in the range
+    // -----------------------------------------------------------------------------
+    // IndexScanCursor::scanNextBatch
+    // -----------------------------------------------------------------------------
 
-    const bool BTreeIndex::is_key_in_range(int key, int lowVal, const Operator lowOp, int highVal, const Operator highOp)
+    size_t IndexScanCursor::scanNextBatch(RecordId* out, const size_t max)
     {
-        if (lowOp == GT) {
-            if (highOp == LT)
-                return key > lowVal && key < highVal;
-            else
-                return key > lowVal && key <= highVal;
+        return scanNextBatch(out, nullptr, max);
+    }
+
+    size_t IndexScanCursor::scanNextBatch(RecordId* out, void* included, const size_t max)
+    {
+        if (!scanExecuting) {
+            throw ScanNotInitializedException();
+        }
+        char* columns = (char*)included;
+        //the bound operator stays the same for the whole scan, so the loop is picked once here
+        if (descending) {
+            switch (index->attributeType) {
+            case INTEGER:
+                return (lowOp == GT) ? scanPrevBatchKey<int, GT>(out, columns, max) : scanPrevBatchKey<int, GTE>(out, columns, max);
+            case DOUBLE:
+                return (lowOp == GT) ? scanPrevBatchKey<double, GT>(out, columns, max) : scanPrevBatchKey<double, GTE>(out, columns, max);
+            case STRING:
+                return (lowOp == GT) ? scanPrevBatchKey<StringKey, GT>(out, columns, max) : scanPrevBatchKey<StringKey, GTE>(out, columns, max);
+            }
+        }
+        switch (index->attributeType) {
+        case INTEGER:
+            return (highOp == LT) ? scanNextBatchKey<int, LT>(out, columns, max) : scanNextBatchKey<int, LTE>(out, columns, max);
+        case DOUBLE:
+            return (highOp == LT) ? scanNextBatchKey<double, LT>(out, columns, max) : scanNextBatchKey<double, LTE>(out, columns, max);
+        case STRING:
+            return (highOp == LT) ? scanNextBatchKey<StringKey, LT>(out, columns, max) : scanNextBatchKey<StringKey, LTE>(out, columns, max);
+        }
+        return 0;
+    }
+
+    template <class T, Operator HighOp>
+    size_t IndexScanCursor::scanNextBatchKey(RecordId* out, char* included, const size_t max)
+    {
+        const int includedBytes = index->includedBytes;
+        size_t filled = 0;
+        while (filled < max) {
+            if (nextEntry == leafEnd) {
+                if (!nextLeaf<T, HighOp>()) {
+                    break;
+                }
+                continue;
+            }
+
+            //Case: entries up to the next shared key are copied straight out of the leaf
+            LeafNode<T>* curNode = (LeafNode<T>*)currentPageData;
+            while (nextEntry < leafEnd && filled < max) {
+                RecordId rid = curNode->ridAt(nextEntry);
+                if (isPostingList(rid)) {
+                    break;
+                }
+                if (included != nullptr) {
+                    std::copy_n(curNode->includedAt(nextEntry), includedBytes, included + filled * includedBytes);
+                }
+                out[filled++] = rid;
+                nextEntry++;
+            }
+            if (nextEntry == leafEnd || filled == max) {
+                continue;
+            }
+
+            //Case: a shared key hands out as much of its posting list as there is room for
+            if (nextPosting == 0) {
+                index->readPostingList(curNode->ridAt(nextEntry).page_number, scanPostings, &scanPostingIncluded);
+            }
+            size_t count = std::min(max - filled, scanPostings.size() - nextPosting);
+            std::copy(scanPostings.begin() + nextPosting, scanPostings.begin() + nextPosting + count, out + filled);
+            if (included != nullptr) {
+                std::copy_n(scanPostingIncluded.begin() + nextPosting * includedBytes, count * includedBytes,
+                        included + filled * includedBytes);
+            }
+            filled += count;
+            nextPosting += count;
+            if (nextPosting == scanPostings.size()) {
+                nextPosting = 0;
+                nextEntry++;
+            }
+        }
+        return filled;
+    }
+
+    template <class T, Operator LowOp>
+    size_t IndexScanCursor::scanPrevBatchKey(RecordId* out, char* included, const size_t max)
+    {
+        const int includedBytes = index->includedBytes;
+        size_t filled = 0;
+        while (filled < max) {
+            if (nextEntry < leafStart) {
+                if (!prevLeaf<T, LowOp>()) {
+                    break;
+                }
+                continue;
+            }
+
+            //Case: entries down to the next shared key are copied straight out of the leaf
+            LeafNode<T>* curNode = (LeafNode<T>*)currentPageData;
+            while (nextEntry >= leafStart && filled < max) {
+                RecordId rid = curNode->ridAt(nextEntry);
+                if (isPostingList(rid)) {
+                    break;
+                }
+                if (included != nullptr) {
+                    std::copy_n(curNode->includedAt(nextEntry), includedBytes, included + filled * includedBytes);
+                }
+                out[filled++] = rid;
+                nextEntry--;
+            }
+            if (nextEntry < leafStart || filled == max) {
+                continue;
+            }
+
+            //Case: a shared key hands out as much of its posting list as there is room for, from the back
+            if (nextPosting == 0) {
+                index->readPostingList(curNode->ridAt(nextEntry).page_number, scanPostings, &scanPostingIncluded);
+            }
+            size_t count = std::min(max - filled, scanPostings.size() - nextPosting);
+            std::reverse_copy(scanPostings.end() - nextPosting - count, scanPostings.end() - nextPosting, out + filled);
+            for (size_t i = 0; included != nullptr && i < count; i++) {
+                size_t position = scanPostings.size() - 1 - nextPosting - i;
+                std::copy_n(scanPostingIncluded.begin() + position * includedBytes, includedBytes,
+                        included + (filled + i) * includedBytes);
+            }
+            filled += count;
+            nextPosting += count;
+            if (nextPosting == scanPostings.size()) {
+                nextPosting = 0;
+                nextEntry--;
+            }
+        }
+        return filled;
+    }
+
+    template <class T, Operator HighOp>
+    void IndexScanCursor::findLeafEnd()
+    {
+        //one search per leaf finds where the keys under the high value stop
+        LeafNode<T>* curNode = (LeafNode<T>*)currentPageData;
+        const T& highVal = scanHighVal<T>();
+        leafEnd = (HighOp == LT) ? curNode->lowerBound(highVal) : curNode->upperBound(highVal);
+        lastLeaf = leafEnd < curNode->header.keyCount || curNode->rightSibPageNo == Page::INVALID_NUMBER;
+    }
+
+    template <class T, Operator HighOp>
+    bool IndexScanCursor::nextLeaf()
+    {
+        if (lastLeaf) {
+            return false;
+        }
+        PageId siblingPageNum = ((LeafNode<T>*)currentPageData)->rightSibPageNo;
+        index->releaseNode(currentPageNum, false);
+        currentPageNum = siblingPageNum;
+        //fetch sibling page
+        currentPageData = index->readNode(siblingPageNum);
+        nextEntry = 0;
+        findLeafEnd<T, HighOp>();
+        if (!upcomingLeaves.empty() || moreParents) {
+            readAhead<T>();
         }
-        if (lowOp == GTE) {
-            if (highOp == LT)
-                return key >= lowVal && key < highVal;
-            else
-                return key >= lowVal && key <= highVal;
+        return true;
+    }
+
+    template <class T, Operator LowOp>
+    void IndexScanCursor::findLeafStart()
+    {
+        //one search per leaf finds where the keys over the low value start
+        LeafNode<T>* curNode = (LeafNode<T>*)currentPageData;
+        const T& lowVal = scanLowVal<T>();
+        leafStart = (LowOp == GTE) ? curNode->lowerBound(lowVal) : curNode->upperBound(lowVal);
+        lastLeaf = leafStart > 0 || curNode->leftSibPageNo == Page::INVALID_NUMBER;
+    }
+
+    template <class T, Operator LowOp>
+    bool IndexScanCursor::prevLeaf()
+    {
+        if (lastLeaf) {
+            return false;
         }
-        return 
-		false;
+        PageId siblingPageNum = ((LeafNode<T>*)currentPageData)->leftSibPageNo;
+        index->releaseNode(currentPageNum, false);
+        currentPageNum = siblingPageNum;
+        currentPageData = index->readNode(siblingPageNum);
+        nextEntry = ((LeafNode<T>*)currentPageData)->header.keyCount - 1;
+        findLeafStart<T, LowOp>();
+        return true;
     }
 
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::endScan
+// IndexScanCursor::endScan
 // -----------------------------------------------------------------------------
 //
-const void BTreeIndex::endScan() 
+const void IndexScanCursor::endScan() 
 {	//throws ScanNotInitializedException If no scan has been initialized.
 	if (!scanExecuting) {
             throw ScanNotInitializedException();
     }
 		//Unpin the current page being scanned 
-        bufMgr->unPinPage(file, currentPageNum, false);
+        index->releaseNode(currentPageNum, false);
 		/**
 		 * terminate the scanning by setting the scanExecuting to false,
 		 * set the page currently being scanned to null
@@ -1063,5 +3962,45 @@ const void BTreeIndex::endScan()
         currentPageData = nullptr;
 }
 
+// -----------------------------------------------------------------------------
+// BTreeIndex::startScan, startReverseScan, scanNext, scanNextBatch and endScan
+// The index keeps one cursor of its own for callers that scan through it directly
+// -----------------------------------------------------------------------------
+
+const void BTreeIndex::startScan(const void* lowValParm, const Operator lowOpParm, const void* highValParm, const Operator highOpParm)
+{
+	scanCursor.startScan(lowValParm, lowOpParm, highValParm, highOpParm);
+}
+
+const void BTreeIndex::startReverseScan(const void* lowValParm, const Operator lowOpParm, const void* highValParm, const Operator highOpParm)
+{
+	scanCursor.startReverseScan(lowValParm, lowOpParm, highValParm, highOpParm);
+}
+
+const void BTreeIndex::scanNext(RecordId& outRid)
+{
+	scanCursor.scanNext(outRid);
+}
+
+const void BTreeIndex::scanNext(RecordId& outRid, void* included)
+{
+	scanCursor.scanNext(outRid, included);
+}
+
+size_t BTreeIndex::scanNextBatch(RecordId* out, const size_t max)
+{
+	return scanCursor.scanNextBatch(out, max);
+}
+
+size_t BTreeIndex::scanNextBatch(RecordId* out, void* included, const size_t max)
+{
+	return scanCursor.scanNextBatch(out, included, max);
+}
+
+const void BTreeIndex::endScan()
+{
+	scanCursor.endScan();
+}
+
 
 }
@@ -13,11 +13,21 @@
 #include <sstream>
 #include <exception>
 #include <cmath>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <list>
+#include <deque>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+#include <memory>
 
 #include "types.h"
 #include "page.h"
 #include "file.h"
 #include "buffer.h"
+#include "key_search.h"
 
 namespace badgerdb
 {
@@ -45,16 +55,235 @@ enum Operator
 
 
 /**
- * @brief Number of key slots in B+Tree leaf for INTEGER key.
+ * @brief Version of the on-page node format written by this code.
+ * Version 1 nodes had no header: empty slots were told apart by zero keys, record ids and page numbers.
+ * Version 2 nodes start with a NodeHeader.
+ * Version 3 STRING nodes hold variable length keys instead of the first 10 characters of each string.
+ * Version 4 leaves may point to a PostingPage instead of a record for keys shared by several records.
+ * Version 5 leaves also link to their left sibling.
+ * Version 6 non-leaf nodes hold the number of records under each child.
+ * Version 7 leaves and posting pages may store included columns after each record id.
+ * Version 8 leaves store record ids as a column of page numbers and a column of slot numbers, and INTEGER leaves store
+ * each key as a bit packed offset from the smallest one.
  */
-//                                                  sibling ptr             key               rid
-const  int INTARRAYLEAFSIZE = ( Page::SIZE - sizeof( PageId ) ) / ( sizeof( int ) + sizeof( RecordId ) );
+const int NODE_FORMAT_VERSION = 8;
+
+/**
+ * @brief Kind of node stored in a page of the index file.
+ */
+enum NodeKind
+{
+	LEAF_NODE = 1,
+	NON_LEAF_NODE = 2,
+	POSTING_NODE = 3
+};
+
+/**
+ * @brief Header at the start of every leaf and non-leaf node page.
+ */
+struct NodeHeader{
+  /**
+   * NODE_FORMAT_VERSION of the code that wrote the node.
+   */
+	std::uint8_t version;
+
+  /**
+   * NodeKind of the node.
+   */
+	std::uint8_t kind;
+
+  /**
+   * Level of the node in the tree: 0 for leaves, 1 for the nodes just above the leaves, and so on up to the root.
+   */
+	std::uint16_t level;
+
+  /**
+   * Number of keys in use. They always form a prefix of the key array.
+   */
+	int keyCount;
+};
+
+/**
+ * @brief Maximum length of a STRING attribute used as a key, the size of the string field of a record.
+ */
+const int STRINGSIZE = 64;
+
+/**
+ * @brief Key of a STRING index: the attribute up to its terminating zero or STRINGSIZE characters.
+ * Characters after the end of a shorter string are zero, so keys compare as plain bytes.
+ */
+struct StringKey{
+	char data[ STRINGSIZE ];
+
+  /**
+   * Number of characters before the zero padding.
+   */
+	int length() const
+	{
+		return strnlen( data, STRINGSIZE );
+	}
+};
+
+inline bool operator<( const StringKey& k1, const StringKey& k2 )
+{
+	return memcmp( k1.data, k2.data, STRINGSIZE ) < 0;
+}
+
+inline bool operator==( const StringKey& k1, const StringKey& k2 )
+{
+	return memcmp( k1.data, k2.data, STRINGSIZE ) == 0;
+}
+
+inline bool operator!=( const StringKey& k1, const StringKey& k2 )
+{
+	return !( k1 == k2 );
+}
+
+/**
+ * @brief Bytes a record id takes in a leaf, where page and slot numbers are stored in two separate columns.
+ */
+const int PACKEDRIDSIZE = sizeof( PageId ) + sizeof( SlotId );
+
+/**
+ * @brief Bytes of a DOUBLE leaf left for its keys, record ids and included columns.
+ */
+//                             header           sibling ptrs        included bytes and capacity            padding
+const int LEAFDATASIZE = Page::SIZE - sizeof( NodeHeader ) - 2 * sizeof( PageId ) - 2 * sizeof( std::uint16_t ) - sizeof( std::uint32_t );
+
+/**
+ * @brief Bytes of an INTEGER leaf left for its keys, record ids and included columns.
+ */
+//                                header           sibling ptrs  included bytes and capacity  bit width and padding  base
+const int INTLEAFDATASIZE = Page::SIZE - sizeof( NodeHeader ) - 2 * sizeof( PageId ) - 2 * sizeof( std::uint16_t ) - 4 * sizeof( std::uint8_t ) - sizeof( int );
+
+/**
+ * @brief Bytes taken by the keys of count entries of an INTEGER leaf packed width bits each, with room at the end so
+ * that any key can be read with one 8 byte load. Rounded up so that the record ids after them stay aligned.
+ */
+constexpr int intLeafKeyBytes( const int count, const int width )
+{
+	return ( ( count * width + 7 ) / 8 + 8 + 3 ) & ~3;
+}
+
+/**
+ * @brief Number of entries an INTEGER leaf holds when its keys are packed width bits each and each entry carries
+ * includedBytes of included columns.
+ */
+constexpr int intLeafCapacity( const int width, const int includedBytes )
+{
+	int count = ( INTLEAFDATASIZE - 12 ) * 8 / ( width + 8 * ( PACKEDRIDSIZE + includedBytes ) );
+	while( intLeafKeyBytes( count, width ) + count * ( PACKEDRIDSIZE + includedBytes ) > INTLEAFDATASIZE )
+		count--;
+	return count;
+}
+
+/**
+ * @brief Number of key slots in a B+Tree leaf and non-leaf for keys of type T, fixed at compile time by the page size.
+ * Leaves of an index with included columns have fewer slots. INTEGER leaves are sized by intLeafCapacity instead.
+ */
+template <class T>
+struct NodeFanout{
+	//                                  key            rid
+	static const int LEAF = LEAFDATASIZE / ( sizeof( T ) + PACKEDRIDSIZE );
+	//                                      header               extra pageNo and count                        key            pageNo and count
+	static const int NONLEAF = ( Page::SIZE - sizeof( NodeHeader ) - sizeof( PageId ) - sizeof( std::uint32_t ) ) / ( sizeof( T ) + sizeof( PageId ) + sizeof( std::uint32_t ) );
+};
+
+template <class T> const int NodeFanout<T>::LEAF;
+template <class T> const int NodeFanout<T>::NONLEAF;
+
+/**
+ * @brief Number of key slots in B+Tree leaf for INTEGER key, when the keys of the leaf are spread over the whole int range.
+ * Leaves of keys closer together hold more, up to intLeafCapacity( 0, 0 ).
+ */
+const  int INTARRAYLEAFSIZE = intLeafCapacity( 32, 0 );
 
 /**
  * @brief Number of key slots in B+Tree non-leaf for INTEGER key.
  */
-//                                                     level     extra pageNo                  key       pageNo
-const  int INTARRAYNONLEAFSIZE = ( Page::SIZE - sizeof( int ) - sizeof( PageId ) ) / ( sizeof( int ) + sizeof( PageId ) );
+const  int INTARRAYNONLEAFSIZE = NodeFanout<int>::NONLEAF;
+
+/**
+ * @brief Number of key slots in B+Tree leaf for DOUBLE key.
+ */
+const  int DOUBLEARRAYLEAFSIZE = NodeFanout<double>::LEAF;
+
+/**
+ * @brief Number of key slots in B+Tree non-leaf for DOUBLE key.
+ */
+const  int DOUBLEARRAYNONLEAFSIZE = NodeFanout<double>::NONLEAF;
+
+/**
+ * @brief Default fraction of the slots of each node that the bulk loader fills.
+ * Leaving some room lets later insertions land without splitting right away.
+ */
+const double BULKLOAD_FILL_FACTOR = 0.9;
+
+/**
+ * @brief Number of key-rid pairs the bulk loader sorts in memory before it spills a sorted run to disk.
+ */
+const int BULKLOAD_RUN_SIZE = 1 << 20;
+
+/**
+ * @brief Default fraction of a node below which deleteEntry merges it with a sibling or borrows from one.
+ * Well under half, so that a node is not merged right after a split and then split again by the next insertions.
+ * Nodes that lose their last entry are always merged.
+ */
+const double UNDERFLOW_THRESHOLD = 0.25;
+
+/**
+ * @brief Default fraction of the entries that stay in the right-most leaf, or non-leaf node, when an entry past all
+ * the others splits it. Keys inserted in increasing order then leave nearly full nodes behind them.
+ */
+const double APPEND_SPLIT_FRACTION = 0.9;
+
+/**
+ * @brief Default number of leaves an ascending scan asks the buffer manager to read ahead of the one it is on.
+ * They are taken from the parents of the leaves, so the reads do not wait on each other's sibling pointers.
+ */
+const int SCAN_READAHEAD_LEAVES = 8;
+
+/**
+ * @brief Most columns an index can include in its leaves besides the key.
+ */
+const int MAX_INCLUDED_COLUMNS = 4;
+
+/**
+ * @brief Most bytes of included columns stored with each record id.
+ */
+const int MAX_INCLUDED_BYTES = 64;
+
+/**
+ * @brief Most levels whose nodes the statistics of an index count. Even STRING nodes of the longest separators split
+ * into dozens of children, so a file could not hold a tree this deep.
+ */
+const int MAX_TREE_LEVELS = 16;
+
+/**
+ * @brief Number of buckets of the equi-depth histogram of the keys that an index keeps in its meta page.
+ */
+const int HISTOGRAM_BUCKETS = 32;
+
+/**
+ * @brief Fixed size attribute of the relation that a covering index stores next to each record id, so that scans
+ * needing only the key and its included columns never read the relation.
+ */
+struct IncludedColumn{
+  /**
+   * Offset of the attribute inside the record.
+   */
+	int byteOffset;
+
+  /**
+   * Size of the attribute in bytes.
+   */
+	int size;
+};
+
+/**
+ * @brief Number of version counters shared out among the nodes of an index used concurrently.
+ */
+const int LATCH_STRIPES = 1024;
 
 /**
  * @brief Structure to store a key-rid pair. It is used to pass the pair to functions that 
@@ -88,10 +317,21 @@ public:
 	}
 };
 
+/**
+ * @brief Order of record ids in a posting list: by page number, then by slot number.
+ */
+inline bool operator<( const RecordId& r1, const RecordId& r2 )
+{
+	if( r1.page_number != r2.page_number )
+		return r1.page_number < r2.page_number;
+	else
+		return r1.slot_number < r2.slot_number;
+}
+
 /**
  * @brief Overloaded operator to compare the key values of two rid-key pairs
  * and if they are the same compares to see if the first pair has
- * a smaller rid.pageNo value.
+ * a smaller rid.
 */
 template <class T>
 bool operator<( const RIDKeyPair<T>& r1, const RIDKeyPair<T>& r2 )
@@ -99,347 +339,1860 @@ bool operator<( const RIDKeyPair<T>& r1, const RIDKeyPair<T>& r2 )
 	if( r1.key != r2.key )
 		return r1.key < r2.key;
 	else
-		return r1.rid.page_number < r2.rid.page_number;
+		return r1.rid < r2.rid;
 }
 
-/**
- * @brief The meta page, which holds metadata for Index file, is always first page of the btree index file and is cast
- * to the following structure to store or retrieve information from it.
- * Contains the relation name for which the index is created, the byte offset
- * of the key value on which the index is made, the type of the key and the page no
- * of the root page. Root page starts as page 2 but since a split can occur
- * at the root the root page may get moved up and get a new page no.
-*/
-struct IndexMetaInfo{
+/**
+ * @brief Statistics of an index, kept in its meta page so that a plan can be costed, and the index opened, without
+ * reading any node. Keys are stored as the bytes of the key type, in STRINGSIZE bytes whatever the type.
+*/
+struct IndexStatistics{
+  /**
+   * Number of levels of the tree, 1 while the root is a leaf.
+   */
+	int height;
+
+  /**
+   * Number of nodes on each level, the leaves on level 0.
+   */
+	std::uint32_t levelPages[ MAX_TREE_LEVELS ];
+
+  /**
+   * Number of records indexed, every record id of a posting list included.
+   */
+	std::uint64_t entryCount;
+
+  /**
+   * Smallest and largest key indexed. Deletes leave them where they are, so after deletes they only bound the keys
+   * until the statistics are worked out again.
+   */
+	char minKey[ STRINGSIZE ];
+	char maxKey[ STRINGSIZE ];
+
+  /**
+   * Number of histogram buckets, 0 if the index was empty when they were drawn.
+   */
+	int bucketCount;
+
+  /**
+   * Number of records when the buckets were drawn.
+   */
+	std::uint64_t drawnEntryCount;
+
+  /**
+   * Highest key of each bucket when the buckets were drawn. Bucket i holds the records over bound i - 1 up to bound i;
+   * the first bucket also those under its bound and the last those over it.
+   */
+	char bucketBounds[ HISTOGRAM_BUCKETS ][ STRINGSIZE ];
+
+  /**
+   * Number of records in each bucket, which every insert and delete adds to or takes from.
+   */
+	std::uint32_t bucketCounts[ HISTOGRAM_BUCKETS ];
+};
+
+/**
+ * @brief The meta page, which holds metadata for Index file, is always first page of the btree index file and is cast
+ * to the following structure to store or retrieve information from it.
+ * Contains the relation name for which the index is created, the byte offset
+ * of the key value on which the index is made, the type of the key and the page no
+ * of the root page. Root page starts as page 2 but since a split can occur
+ * at the root the root page may get moved up and get a new page no.
+*/
+struct IndexMetaInfo{
+  /**
+   * Name of base relation.
+   */
+	char relationName[20];
+
+  /**
+   * Offset of attribute, over which index is built, inside the record stored in pages.
+   */
+	int attrByteOffset;
+
+  /**
+   * Type of the attribute over which index is built.
+   */
+	Datatype attrType;
+
+  /**
+   * Page number of root page of the B+ Tree inside the file index file.
+   */
+	PageId rootPageNo;
+
+  /**
+   * NODE_FORMAT_VERSION of the nodes in the file. Files written before the field existed read 0 here
+   * and hold version 1 nodes.
+   */
+	int nodeFormatVersion;
+
+  /**
+   * Nonzero if the non-leaf nodes keep the record counts of their children up to date.
+   */
+	int subtreeCounts;
+
+  /**
+   * Number of columns stored with each record id, in the order they were given.
+   */
+	int includedColumnCount;
+
+	IncludedColumn includedColumns[ MAX_INCLUDED_COLUMNS ];
+
+  /**
+   * Nonzero once statistics is kept up to date. Files written before it existed read 0 here, and get their statistics
+   * worked out when they are first opened.
+   */
+	int statisticsKept;
+
+	IndexStatistics statistics;
+};
+
+/*
+Each node is a page, so once we read the page in we just cast the pointer to the page to this struct and use it to access the parts
+These structures basically are the format in which the information is stored in the pages for the index file depending on what kind of 
+node they are. Every node starts with a NodeHeader, so its occupancy, kind and level can be read without looking at the keys.
+The tree only reaches keys and children through the member functions, so STRING nodes can lay their keys out differently from
+the fixed size arrays of the other key types.
+*/
+
+/**
+ * @brief Structure for all non-leaf nodes, templated for the type of the key.
+*/
+template <class T>
+struct NonLeafNode{
+  /**
+   * Key count, kind and level of the node.
+   */
+	NodeHeader header;
+
+  /**
+   * Stores keys.
+   */
+	T keyArray[ NodeFanout<T>::NONLEAF ];
+
+  /**
+   * Stores page numbers of child pages which themselves are other non-leaf/leaf nodes in the tree.
+   */
+	PageId pageNoArray[ NodeFanout<T>::NONLEAF + 1 ];
+
+  /**
+   * Number of records under each child. Moved along with the children always, but only counted while the index
+   * keeps subtree counts.
+   */
+	std::uint32_t countArray[ NodeFanout<T>::NONLEAF + 1 ];
+
+  /**
+   * Position of the first key not less than key, which is also the child to descend into for it.
+   */
+	int lowerBound( const T& key ) const
+	{
+		return badgerdb::lowerBound( keyArray, header.keyCount, key );
+	}
+
+  /**
+   * Position of the first key greater than key.
+   */
+	int upperBound( const T& key ) const
+	{
+		return badgerdb::upperBound( keyArray, header.keyCount, key );
+	}
+
+	T keyAt( const int i ) const
+	{
+		return keyArray[ i ];
+	}
+
+	PageId childAt( const int i ) const
+	{
+		return pageNoArray[ i ];
+	}
+
+	std::uint32_t countAt( const int i ) const
+	{
+		return countArray[ i ];
+	}
+
+	void setCountAt( const int i, const std::uint32_t count )
+	{
+		countArray[ i ] = count;
+	}
+
+  /**
+   * Empty the node, leaving it with a single child and no keys.
+   */
+	void reset( const PageId firstChild )
+	{
+		header.keyCount = 0;
+		pageNoArray[ 0 ] = firstChild;
+		countArray[ 0 ] = 0;
+	}
+
+  /**
+   * Insert key at position i, with rightChild, holding rightCount records, as the child on its right.
+   * @return false, leaving the node unchanged, if the node is full
+   */
+	bool insertAt( const int i, const T& key, const PageId rightChild, const std::uint32_t rightCount )
+	{
+		int count = header.keyCount;
+		if( count == NodeFanout<T>::NONLEAF )
+			return false;
+		std::copy_backward( keyArray + i, keyArray + count, keyArray + count + 1 );
+		std::copy_backward( pageNoArray + i + 1, pageNoArray + count + 1, pageNoArray + count + 2 );
+		std::copy_backward( countArray + i + 1, countArray + count + 1, countArray + count + 2 );
+		keyArray[ i ] = key;
+		pageNoArray[ i + 1 ] = rightChild;
+		countArray[ i + 1 ] = rightCount;
+		header.keyCount++;
+		return true;
+	}
+
+  /**
+   * Add a key and its right child after the last one, as long as the node holds no more than fillFactor of its children.
+   * @return false, leaving the node unchanged, if the node is filled up to fillFactor
+   */
+	bool append( const T& key, const PageId rightChild, const double fillFactor )
+	{
+		int fill = std::max( 2, std::min( NodeFanout<T>::NONLEAF + 1, (int) ( ( NodeFanout<T>::NONLEAF + 1 ) * fillFactor ) ) );
+		if( header.keyCount + 2 > fill )
+			return false;
+		keyArray[ header.keyCount ] = key;
+		pageNoArray[ header.keyCount + 1 ] = rightChild;
+		countArray[ header.keyCount + 1 ] = 0;
+		header.keyCount++;
+		return true;
+	}
+
+  /**
+   * Drop the last key and the child on its right.
+   */
+	void popBack()
+	{
+		header.keyCount--;
+	}
+
+  /**
+   * Remove key i and the child on its right.
+   */
+	void removeAt( const int i )
+	{
+		int count = header.keyCount;
+		std::copy( keyArray + i + 1, keyArray + count, keyArray + i );
+		std::copy( pageNoArray + i + 2, pageNoArray + count + 1, pageNoArray + i + 1 );
+		std::copy( countArray + i + 2, countArray + count + 1, countArray + i + 1 );
+		header.keyCount--;
+	}
+
+  /**
+   * Replace key i, keeping the children on both sides of it.
+   * @return false, leaving the node unchanged, if the node has no room for the new key
+   */
+	bool replaceKeyAt( const int i, const T& key )
+	{
+		keyArray[ i ] = key;
+		return true;
+	}
+
+  /**
+   * Fraction of the node in use.
+   */
+	double occupancy() const
+	{
+		return (double) header.keyCount / NodeFanout<T>::NONLEAF;
+	}
+
+  /**
+   * Whether count keys, with the children around them, fit in one node.
+   */
+	static bool fits( const T* keys, const int count )
+	{
+		return count <= NodeFanout<T>::NONLEAF;
+	}
+
+  /**
+   * Replace the contents of the node with count keys and the count + 1 children around them, and their record counts.
+   */
+	void load( const T* keys, const PageId* children, const std::uint32_t* counts, const int count )
+	{
+		std::copy( keys, keys + count, keyArray );
+		std::copy( children, children + count + 1, pageNoArray );
+		std::copy( counts, counts + count + 1, countArray );
+		header.keyCount = count;
+	}
+};
+
+
+/**
+ * @brief Structure for all leaf nodes, templated for the type of the key.
+ * The keys, the page and slot numbers of the record ids and the included columns are arrays one after the other in data,
+ * sized for capacity entries.
+*/
+template <class T>
+struct LeafNode{
+  /**
+   * Key count, kind and level of the node.
+   */
+	NodeHeader header;
+
+  /**
+   * Page number of the leaf on the right side.
+	 * This linking of leaves allows to easily move from one leaf to the next leaf during index scan.
+   */
+	PageId rightSibPageNo;
+
+  /**
+   * Page number of the leaf on the left side, so that a scan can also run from high keys to low ones.
+   */
+	PageId leftSibPageNo;
+
+  /**
+   * Bytes of included columns stored with each record id, 0 unless the index covers some columns.
+   */
+	std::uint16_t includedBytes;
+
+  /**
+   * Number of entries the leaf has room for.
+   */
+	std::uint16_t capacity;
+
+	std::uint32_t padding;
+
+  /**
+   * Stores the keys, then the page numbers, then the slot numbers, then the included columns of each entry.
+   */
+	char data[ LEAFDATASIZE ];
+
+  /**
+   * Empty the leaf and size its arrays for entries carrying bytes of included columns each.
+   */
+	void format( const int bytes )
+	{
+		header.keyCount = 0;
+		includedBytes = bytes;
+		capacity = LEAFDATASIZE / ( sizeof( T ) + PACKEDRIDSIZE + bytes );
+	}
+
+  /**
+   * Position of the first key not less than key.
+   */
+	int lowerBound( const T& key ) const
+	{
+		return badgerdb::lowerBound( keyArray(), header.keyCount, key );
+	}
+
+  /**
+   * Position of the first key greater than key.
+   */
+	int upperBound( const T& key ) const
+	{
+		return badgerdb::upperBound( keyArray(), header.keyCount, key );
+	}
+
+	T keyAt( const int i ) const
+	{
+		return keyArray()[ i ];
+	}
+
+	RecordId ridAt( const int i ) const
+	{
+		RecordId rid;
+		rid.page_number = pageArray()[ i ];
+		rid.slot_number = slotArray()[ i ];
+		return rid;
+	}
+
+	void setRidAt( const int i, const RecordId rid )
+	{
+		pageArray()[ i ] = rid.page_number;
+		slotArray()[ i ] = rid.slot_number;
+	}
+
+  /**
+   * Included columns of entry i, includedBytes of them.
+   */
+	const char* includedAt( const int i ) const
+	{
+		return includedArray() + i * includedBytes;
+	}
+
+	void setIncludedAt( const int i, const char* included )
+	{
+		std::copy_n( included, includedBytes, includedArray() + i * includedBytes );
+	}
+
+  /**
+   * Insert the entry at position i.
+   * @return false, leaving the leaf unchanged, if the leaf is full
+   */
+	bool insertAt( const int i, const T& key, const RecordId rid, const char* included )
+	{
+		int count = header.keyCount;
+		if( count == capacity )
+			return false;
+		T* keys = keyArray();
+		PageId* pages = pageArray();
+		SlotId* slots = slotArray();
+		char* columns = includedArray();
+		std::copy_backward( keys + i, keys + count, keys + count + 1 );
+		std::copy_backward( pages + i, pages + count, pages + count + 1 );
+		std::copy_backward( slots + i, slots + count, slots + count + 1 );
+		std::copy_backward( columns + i * includedBytes, columns + count * includedBytes, columns + ( count + 1 ) * includedBytes );
+		keys[ i ] = key;
+		setRidAt( i, rid );
+		setIncludedAt( i, included );
+		header.keyCount++;
+		return true;
+	}
+
+  /**
+   * Add an entry after the last one, as long as the leaf holds no more than fillFactor of its slots.
+   * @return false, leaving the leaf unchanged, if the leaf is filled up to fillFactor
+   */
+	bool append( const T& key, const RecordId rid, const char* included, const double fillFactor )
+	{
+		int fill = std::max( 1, std::min( (int) capacity, (int) ( capacity * fillFactor ) ) );
+		if( header.keyCount >= fill )
+			return false;
+		keyArray()[ header.keyCount ] = key;
+		setRidAt( header.keyCount, rid );
+		setIncludedAt( header.keyCount, included );
+		header.keyCount++;
+		return true;
+	}
+
+  /**
+   * Remove entry i.
+   */
+	void removeAt( const int i )
+	{
+		int count = header.keyCount;
+		T* keys = keyArray();
+		PageId* pages = pageArray();
+		SlotId* slots = slotArray();
+		char* columns = includedArray();
+		std::copy( keys + i + 1, keys + count, keys + i );
+		std::copy( pages + i + 1, pages + count, pages + i );
+		std::copy( slots + i + 1, slots + count, slots + i );
+		std::copy( columns + ( i + 1 ) * includedBytes, columns + count * includedBytes, columns + i * includedBytes );
+		header.keyCount--;
+	}
+
+  /**
+   * Fraction of the leaf in use.
+   */
+	double occupancy() const
+	{
+		return (double) header.keyCount / capacity;
+	}
+
+  /**
+   * Whether count entries with these keys fit in one leaf like this one.
+   */
+	bool fits( const T* keys, const int count ) const
+	{
+		return count <= capacity;
+	}
+
+  /**
+   * Replace the contents of the leaf with count entries, whose included columns follow each other in included.
+   */
+	void load( const T* keys, const RecordId* rids, const char* included, const int count )
+	{
+		std::copy( keys, keys + count, keyArray() );
+		for( int i = 0; i < count; i++ )
+			setRidAt( i, rids[ i ] );
+		std::copy_n( included, count * includedBytes, includedArray() );
+		header.keyCount = count;
+	}
+
+ private:
+	T* keyArray() { return reinterpret_cast<T*>( data ); }
+	const T* keyArray() const { return reinterpret_cast<const T*>( data ); }
+	PageId* pageArray() { return reinterpret_cast<PageId*>( data + capacity * sizeof( T ) ); }
+	const PageId* pageArray() const { return reinterpret_cast<const PageId*>( data + capacity * sizeof( T ) ); }
+	SlotId* slotArray() { return reinterpret_cast<SlotId*>( data + capacity * ( sizeof( T ) + sizeof( PageId ) ) ); }
+	const SlotId* slotArray() const { return reinterpret_cast<const SlotId*>( data + capacity * ( sizeof( T ) + sizeof( PageId ) ) ); }
+	char* includedArray() { return data + capacity * ( sizeof( T ) + PACKEDRIDSIZE ); }
+	const char* includedArray() const { return data + capacity * ( sizeof( T ) + PACKEDRIDSIZE ); }
+};
+
+/**
+ * @brief Leaf node when the key is of INTEGER type.
+ * Each key is stored as its offset from base in bitWidth bits, just enough for the largest key of the leaf, so leaves
+ * of keys close together hold many more entries. data holds the packed offsets, then the page numbers, then the slot
+ * numbers, then the included columns of each entry, sized for capacity entries at the current bitWidth.
+ */
+template <>
+struct LeafNode<int>{
+	NodeHeader header;
+
+	PageId rightSibPageNo;
+
+	PageId leftSibPageNo;
+
+  /**
+   * Bytes of included columns stored with each record id.
+   */
+	std::uint16_t includedBytes;
+
+  /**
+   * Number of entries the leaf has room for at bitWidth.
+   */
+	std::uint16_t capacity;
+
+  /**
+   * Bits of each packed key offset.
+   */
+	std::uint8_t bitWidth;
+
+	std::uint8_t padding[ 3 ];
+
+  /**
+   * Key every offset is added to, no greater than the first key.
+   */
+	int base;
+
+	char data[ INTLEAFDATASIZE ];
+
+	void format( const int bytes );
+	int lowerBound( const int& key ) const;
+	int upperBound( const int& key ) const;
+	int keyAt( const int i ) const;
+	RecordId ridAt( const int i ) const;
+	void setRidAt( const int i, const RecordId rid );
+	const char* includedAt( const int i ) const;
+	void setIncludedAt( const int i, const char* included );
+	bool insertAt( const int i, const int& key, const RecordId rid, const char* included );
+	bool append( const int& key, const RecordId rid, const char* included, const double fillFactor );
+	void removeAt( const int i );
+	double occupancy() const;
+	bool fits( const int* keys, const int count ) const;
+	void load( const int* keys, const RecordId* rids, const char* included, const int count );
+
+ private:
+	PageId* pageArray() { return reinterpret_cast<PageId*>( data + intLeafKeyBytes( capacity, bitWidth ) ); }
+	const PageId* pageArray() const { return reinterpret_cast<const PageId*>( data + intLeafKeyBytes( capacity, bitWidth ) ); }
+	SlotId* slotArray() { return reinterpret_cast<SlotId*>( pageArray() + capacity ); }
+	const SlotId* slotArray() const { return reinterpret_cast<const SlotId*>( pageArray() + capacity ); }
+	char* includedArray() { return reinterpret_cast<char*>( slotArray() + capacity ); }
+	const char* includedArray() const { return reinterpret_cast<const char*>( slotArray() + capacity ); }
+	std::uint32_t offsetAt( const int i ) const;
+	void setOffsetAt( const int i, const std::uint32_t offset );
+	bool insertWithin( const int i, const int key, const RecordId rid, const char* included, const double fillFactor );
+};
+
+/**
+ * @brief Bytes of a STRING leaf left for its slots and key suffixes.
+ */
+//                                  header           sibling ptrs  prefix length, heap bytes, included bytes and padding  prefix
+const int STRINGLEAFDATASIZE = Page::SIZE - sizeof( NodeHeader ) - 2 * sizeof( PageId ) - 4 * sizeof( std::uint16_t ) - STRINGSIZE;
+
+/**
+ * @brief Bytes of a STRING non-leaf left for its slots and separators.
+ */
+//                                     header           first child and its count                       heap bytes and padding
+const int STRINGNONLEAFDATASIZE = Page::SIZE - sizeof( NodeHeader ) - sizeof( PageId ) - sizeof( std::uint32_t ) - 2 * sizeof( std::uint16_t );
+
+/**
+ * @brief Slot of a STRING leaf: the record id of an entry and where the rest of its key is stored. The included
+ * columns of the entry follow the key suffix.
+ */
+struct StringLeafSlot{
+	RecordId rid;
+	std::uint16_t offset;
+	std::uint8_t length;
+};
+
+/**
+ * @brief Slot of a STRING non-leaf: a child page, the records under it and where the separator on its left is stored.
+ */
+struct StringNonLeafSlot{
+	PageId pageNo;
+	std::uint32_t count;
+	std::uint16_t offset;
+	std::uint8_t length;
+};
+
+/**
+ * @brief Non-leaf node when the key is of STRING type.
+ * Separators are the shortest strings that tell two neighbouring children apart, so they are rarely more than a few characters.
+ * The slots grow from the front of data and the separators from its back.
+ */
+template <>
+struct NonLeafNode<StringKey>{
+	NodeHeader header;
+
+  /**
+   * Child to the left of the first separator.
+   */
+	PageId firstPageNo;
+
+  /**
+   * Number of records under firstPageNo.
+   */
+	std::uint32_t firstCount;
+
+  /**
+   * Number of bytes at the back of data taken by separators.
+   */
+	std::uint16_t heapBytes;
+
+	std::uint16_t padding;
+
+  /**
+   * Slot i holds separator i and the child on its right.
+   */
+	char data[ STRINGNONLEAFDATASIZE ];
+
+	int lowerBound( const StringKey& key ) const;
+	int upperBound( const StringKey& key ) const;
+	StringKey keyAt( const int i ) const;
+	PageId childAt( const int i ) const;
+	std::uint32_t countAt( const int i ) const;
+	void setCountAt( const int i, const std::uint32_t count );
+	void reset( const PageId firstChild );
+	bool insertAt( const int i, const StringKey& key, const PageId rightChild, const std::uint32_t rightCount );
+	bool append( const StringKey& key, const PageId rightChild, const double fillFactor );
+	void popBack();
+	void removeAt( const int i );
+	bool replaceKeyAt( const int i, const StringKey& key );
+	double occupancy() const;
+	static bool fits( const StringKey* keys, const int count );
+	void load( const StringKey* keys, const PageId* children, const std::uint32_t* counts, const int count );
+
+ private:
+	StringNonLeafSlot* slots() { return reinterpret_cast<StringNonLeafSlot*>( data ); }
+	const StringNonLeafSlot* slots() const { return reinterpret_cast<const StringNonLeafSlot*>( data ); }
+	int usedBytes() const;
+	void gather( std::vector<StringKey>& keys, std::vector<PageId>& children, std::vector<std::uint32_t>& counts ) const;
+	int compareSeparator( const int i, const StringKey& key, const int keyLength ) const;
+};
+
+/**
+ * @brief Leaf node when the key is of STRING type.
+ * The characters every key of the leaf starts with are stored once as its prefix, and each entry only keeps the rest of
+ * its key. The slots grow from the front of data and the key suffixes, each followed by the included columns of its
+ * entry, from its back.
+ */
+template <>
+struct LeafNode<StringKey>{
+	NodeHeader header;
+
+	PageId rightSibPageNo;
+
+	PageId leftSibPageNo;
+
+  /**
+   * Number of characters in prefix.
+   */
+	std::uint16_t prefixLength;
+
+  /**
+   * Number of bytes at the back of data taken by key suffixes and included columns.
+   */
+	std::uint16_t heapBytes;
+
+  /**
+   * Bytes of included columns stored with each record id.
+   */
+	std::uint16_t includedBytes;
+
+	std::uint16_t padding;
+
+  /**
+   * Characters shared by every key of the leaf.
+   */
+	char prefix[ STRINGSIZE ];
+
+  /**
+   * Slot i holds the record id of entry i and the location of its key suffix.
+   */
+	char data[ STRINGLEAFDATASIZE ];
+
+	void format( const int bytes );
+	int lowerBound( const StringKey& key ) const;
+	int upperBound( const StringKey& key ) const;
+	StringKey keyAt( const int i ) const;
+	RecordId ridAt( const int i ) const;
+	void setRidAt( const int i, const RecordId rid );
+	const char* includedAt( const int i ) const;
+	void setIncludedAt( const int i, const char* included );
+	bool insertAt( const int i, const StringKey& key, const RecordId rid, const char* included );
+	bool append( const StringKey& key, const RecordId rid, const char* included, const double fillFactor );
+	void removeAt( const int i );
+	double occupancy() const;
+	bool fits( const StringKey* keys, const int count ) const;
+	void load( const StringKey* keys, const RecordId* rids, const char* included, const int count );
+
+ private:
+	StringLeafSlot* slots() { return reinterpret_cast<StringLeafSlot*>( data ); }
+	const StringLeafSlot* slots() const { return reinterpret_cast<const StringLeafSlot*>( data ); }
+	int usedBytes() const;
+	int compareSuffix( const int i, const char* rest, const int restLength ) const;
+	bool insertWithin( const int i, const StringKey& key, const RecordId rid, const char* included, const int limit );
+	bool reencode( const int i, const StringKey& key, const RecordId rid, const char* included, const int limit );
+	int encodedSize( const StringKey* keys, const int count ) const;
+};
+
+/**
+ * @brief Non-leaf and leaf nodes when the key is of INTEGER type.
+ */
+typedef NonLeafNode<int> NonLeafNodeInt;
+typedef LeafNode<int> LeafNodeInt;
+
+/**
+ * @brief Non-leaf and leaf nodes when the key is of DOUBLE type.
+ */
+typedef NonLeafNode<double> NonLeafNodeDouble;
+typedef LeafNode<double> LeafNodeDouble;
+
+/**
+ * @brief Non-leaf and leaf nodes when the key is of STRING type.
+ */
+typedef NonLeafNode<StringKey> NonLeafNodeString;
+typedef LeafNode<StringKey> LeafNodeString;
+
+static_assert( sizeof( LeafNodeInt ) <= Page::SIZE && sizeof( NonLeafNodeInt ) <= Page::SIZE, "INTEGER nodes must fit in a page" );
+static_assert( sizeof( LeafNodeDouble ) <= Page::SIZE && sizeof( NonLeafNodeDouble ) <= Page::SIZE, "DOUBLE nodes must fit in a page" );
+static_assert( sizeof( LeafNodeString ) <= Page::SIZE && sizeof( NonLeafNodeString ) <= Page::SIZE, "STRING nodes must fit in a page" );
+
+/**
+ * @brief Bytes of a posting page left for its encoded record ids.
+ */
+//                                 header           next page      total count     used bytes and included bytes
+const int POSTINGDATASIZE = Page::SIZE - sizeof( NodeHeader ) - sizeof( PageId ) - sizeof( int ) - 2 * sizeof( std::uint16_t );
+
+/**
+ * @brief Overflow page holding part of the record ids of a key shared by several records.
+ * The leaf entry of such a key stores postingListRef of the first page instead of a record id. The pages of a list
+ * are chained in record id order, and each one starts with a whole record id followed by the varint encoded
+ * differences to the one before, so a page can be read on its own. Record ids are encoded as page_number << 16 | slot_number.
+ * In a covering index the included columns of each record follow its encoded record id.
+ */
+struct PostingPage{
+  /**
+   * keyCount is the number of record ids on this page.
+   */
+	NodeHeader header;
+
+	PageId nextPageNo;
+
+  /**
+   * Number of record ids in the whole list. Only kept up to date on the first page.
+   */
+	int totalCount;
+
+	std::uint16_t usedBytes;
+
+  /**
+   * Bytes of included columns stored with each record id.
+   */
+	std::uint16_t includedBytes;
+
+	unsigned char data[ POSTINGDATASIZE ];
+
+  /**
+   * Append the record ids of this page to rids, and their included columns to included unless it is null.
+   */
+	void decode( std::vector<RecordId>& rids, std::vector<char>* included ) const;
+
+  /**
+   * Smallest record id of this page, which must not be empty.
+   */
+	RecordId first() const;
+
+  /**
+   * Replace the contents of the page with as many of the sorted record ids, and their included columns, as fit.
+   * @return number of record ids written
+   */
+	int encode( const RecordId* rids, const char* included, const int count );
+};
+
+static_assert( sizeof( PostingPage ) <= Page::SIZE, "posting pages must fit in a page" );
+
+/**
+ * @brief Whether the record id of a leaf entry points to a posting list. Records never use slot number INVALID_SLOT.
+ */
+inline bool isPostingList( const RecordId& rid )
+{
+	return rid.slot_number == Page::INVALID_SLOT;
+}
+
+/**
+ * @brief Record id stored in a leaf entry whose posting list starts at page headPageNo.
+ */
+inline RecordId postingListRef( const PageId headPageNo )
+{
+	RecordId rid;
+	rid.page_number = headPageNo;
+	rid.slot_number = Page::INVALID_SLOT;
+	return rid;
+}
+
+/**
+ * @brief Key to put in the parent between two neighbouring nodes, where left is the last key of the left node and
+ * right the first key of the right one. Any key k with left < k <= right works.
+ */
+template <class T>
+inline T shortestSeparator( const T& left, const T& right )
+{
+	return right;
+}
+
+/**
+ * @brief For STRING keys, the shortest prefix of right that is still greater than left.
+ */
+StringKey shortestSeparator( const StringKey& left, const StringKey& right );
+
+class BTreeIndex;
+
+/**
+ * @brief Position of one range scan over a BTreeIndex. Any number of cursors can scan the same index at once, each
+ * holding its own bounds and keeping its own current leaf pinned in the buffer pool. A cursor has to be ended or
+ * destroyed before its index is, and the index should not be changed while one of its cursors is scanning.
+*/
+class IndexScanCursor {
+
+ private:
+
+  /**
+   * Index being scanned.
+   */
+	BTreeIndex	*index;
+
+  /**
+   * True if an index scan has been started.
+   */
+	bool		scanExecuting;
+
+  /**
+   * Index of next entry to be scanned in current leaf being scanned.
+   */
+	int			nextEntry;
+
+  /**
+   * Index just past the last entry of the current leaf that is within the high bound.
+   */
+	int			leafEnd;
+
+  /**
+   * In a descending scan, index of the first entry of the current leaf that is within the low bound.
+   */
+	int			leafStart;
+
+  /**
+   * True if the scan ends in the current leaf, either at its bound or because there is no further leaf.
+   */
+	bool		lastLeaf;
+
+  /**
+   * True if the scan returns entries from the high bound down to the low bound.
+   */
+	bool		descending;
+
+  /**
+   * Page number of current page being scanned.
+   */
+	PageId	currentPageNum;
+
+  /**
+   * Current Page being scanned.
+   */
+	Page		*currentPageData;
+
+  /**
+   * Low INTEGER value for scan.
+   */
+	int			lowValInt;
+
+  /**
+   * Low DOUBLE value for scan.
+   */
+	double	lowValDouble;
+
+  /**
+   * Low STRING value for scan.
+   */
+	StringKey	lowValString;
+
+  /**
+   * High INTEGER value for scan.
+   */
+	int			highValInt;
+
+  /**
+   * High DOUBLE value for scan.
+   */
+	double	highValDouble;
+
+  /**
+   * High STRING value for scan.
+   */
+	StringKey highValString;
+
+  /**
+   * Record ids of the entry being scanned, when its key is shared by several records.
+   */
+	std::vector<RecordId> scanPostings;
+
+  /**
+   * Included columns of the record ids in scanPostings, one after the other.
+   */
+	std::vector<char> scanPostingIncluded;
+
+  /**
+   * Index of the next record id to return from scanPostings.
+   */
+	size_t	nextPosting;
+	
+  /**
+   * Low Operator. Can only be GT(>) or GTE(>=).
+   */
+	Operator	lowOp;
+
+  /**
+   * High Operator. Can only be LT(<) or LTE(<=).
+   */
+	Operator	highOp;
+
+  /**
+   * Leaves an ascending scan moves to after the current one, in key order, as listed by their parents. The first
+   * readaheadIssued of them have been handed to the buffer manager to be read in the background.
+   */
+	std::deque<PageId> upcomingLeaves;
+	size_t	readaheadIssued;
+
+  /**
+   * Separator on the right of the last parent whose leaves were listed, for INTEGER, DOUBLE and STRING keys.
+   */
+	int			fenceInt;
+	double	fenceDouble;
+	StringKey	fenceString;
+
+  /**
+   * True if a parent on the right of the listed leaves can still hold keys within the high bound.
+   */
+	bool		moreParents;
+
+  /**
+   * Check the operators, store the bounds and start an ascending or descending scan.
+   */
+	void beginScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp, const bool descending);
+
+  /**
+   * startScan for an index whose keys are of type T, once the bounds are stored in the scan members.
+   */
+  template <class T>
+  void startScanKey();
+
+  /**
+   * startReverseScan for an index whose keys are of type T, once the bounds are stored in the scan members.
+   */
+  template <class T>
+  void startReverseScanKey();
+
+  /**
+   * scanNext for an index whose keys are of type T. The included columns are copied to included unless it is null.
+   */
+  template <class T>
+  void scanNextKey(RecordId& outRid, char* included);
+
+  /**
+   * scanNext of a descending scan for an index whose keys are of type T.
+   */
+  template <class T>
+  void scanPrevKey(RecordId& outRid, char* included);
+
+  /**
+   * scanNextBatch for an index whose keys are of type T and a scan whose high operator is HighOp.
+   */
+  template <class T, Operator HighOp>
+  size_t scanNextBatchKey(RecordId* out, char* included, const size_t max);
+
+  /**
+   * scanNextBatch of a descending scan for an index whose keys are of type T and whose low operator is LowOp.
+   */
+  template <class T, Operator LowOp>
+  size_t scanPrevBatchKey(RecordId* out, char* included, const size_t max);
+
+  /**
+   * Set leafEnd and lastLeaf for the current leaf with a single search for the high value.
+   */
+  template <class T, Operator HighOp>
+  void findLeafEnd();
+
+  /**
+   * Move to the right sibling of the current leaf and position at its first entry.
+   * @return false, without moving, if the scan ends in the current leaf
+   */
+  template <class T, Operator HighOp>
+  bool nextLeaf();
+
+  /**
+   * Set leafStart and lastLeaf for the current leaf of a descending scan with a single search for the low value.
+   */
+  template <class T, Operator LowOp>
+  void findLeafStart();
+
+  /**
+   * Move to the left sibling of the current leaf and position at its last entry.
+   * @return false, without moving, if the descending scan ends in the current leaf
+   */
+  template <class T, Operator LowOp>
+  bool prevLeaf();
+
+  /**
+   * Low and high values of the current scan for keys of type T.
+   */
+  template <class T>
+  T &scanLowVal();
+  template <class T>
+  T &scanHighVal();
+
+  /**
+   * Separator on the right of the last listed parent, for keys of type T.
+   */
+  template <class T>
+  T &readaheadFence();
+
+  /**
+   * Append the children of the level 1 node parent from position first on to upcomingLeaves, up to the first one
+   * whose keys are all over the high value.
+   */
+  template <class T>
+  void listLeaves(const NonLeafNode<T>* parent, const int first);
+
+  /**
+   * Descend from the root to the parent on the right of the fence and list its leaves.
+   */
+  template <class T>
+  void listNextParent();
+
+  /**
+   * Drop the leaves up to the current one from upcomingLeaves, list those of the next parent once fewer than the
+   * readahead are left, and have the buffer manager read the ones not asked for yet.
+   */
+  template <class T>
+  void readAhead();
+
+ public:
+
+  /**
+   * Create a cursor over index. No scan is started yet.
+   */
+	IndexScanCursor(BTreeIndex *index);
+
+  /**
+   * End the scan, if one is executing.
+   */
+	~IndexScanCursor();
+
+	IndexScanCursor(const IndexScanCursor &) = delete;
+	IndexScanCursor &operator=(const IndexScanCursor &) = delete;
+
+  /**
+	 * Begin a filtered scan of the index.  For instance, if the method is called
+	 * using ("a",GT,"d",LTE) then we should seek all entries with a value
+	 * greater than "a" and less than or equal to "d".
+	 * If another scan is already executing on this cursor, it is ended here. Scans of other cursors are left alone.
+	 * Start from root to find out the leaf page that contains the first RecordID
+	 * that satisfies the scan parameters. Keep that page pinned in the buffer pool.
+   * @param lowVal	Low value of range, pointer to integer / double / char string
+   * @param lowOp		Low operator (GT/GTE)
+   * @param highVal	High value of range, pointer to integer / double / char string
+   * @param highOp	High operator (LT/LTE)
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+	 * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
+	**/
+	const void startScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+
+  /**
+	 * Begin a filtered scan of the index that returns the matching entries from the highest key down to the lowest,
+	 * walking the leaves from right to left. Only the leaves that hold the entries fetched are read, so fetching the
+	 * top few keys of a large range stays cheap. Record ids sharing a key come in the reverse of the ascending order.
+   * @param lowVal	Low value of range, pointer to integer / double / char string
+   * @param lowOp		Low operator (GT/GTE)
+   * @param highVal	High value of range, pointer to integer / double / char string
+   * @param highOp	High operator (LT/LTE)
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+	 * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
+	**/
+	const void startReverseScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+
+  /**
+	 * Fetch the record id of the next index entry that matches the scan.
+   * @param outRid	RecordId of next record found that satisfies the scan criteria returned in this
+	 * @throws ScanNotInitializedException If no scan has been initialized.
+	 * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
+	**/
+	const void scanNext(RecordId& outRid);
+
+  /**
+	 * Fetch the record id of the next index entry that matches the scan, along with the columns the index includes.
+   * @param outRid	RecordId of next record found that satisfies the scan criteria returned in this
+   * @param included	receives the included columns of the record, one after the other in the order the index was given them
+	 * @throws ScanNotInitializedException If no scan has been initialized.
+	 * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
+	**/
+	const void scanNext(RecordId& outRid, void* included);
+
+  /**
+	 * Fetch the record ids of up to max of the next index entries that match the scan.
+   * @param out	array of at least max record ids, the matching record ids are written to its start
+   * @param max	most record ids to fetch
+   * @return number of record ids written; less than max once the scan has run out of matches
+	 * @throws ScanNotInitializedException If no scan has been initialized.
+	**/
+	size_t scanNextBatch(RecordId* out, const size_t max);
+
+  /**
+	 * scanNextBatch that also fetches the columns the index includes.
+   * @param out	array of at least max record ids, the matching record ids are written to its start
+   * @param included	room for the included columns of max records, those of out[i] are written after those of out[i - 1]
+   * @param max	most record ids to fetch
+   * @return number of record ids written; less than max once the scan has run out of matches
+	 * @throws ScanNotInitializedException If no scan has been initialized.
+	**/
+	size_t scanNextBatch(RecordId* out, void* included, const size_t max);
+
+  /**
+	 * Terminate the current scan. Unpin any pinned pages.
+	 * @throws ScanNotInitializedException If no scan has been initialized.
+	**/
+	const void endScan();
+
+  /**
+   * Whether a scan has been started and not ended yet.
+   */
+	bool isScanning() const;
+};
+
+/**
+ * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute of a
+ * relation. Scans through the index itself run one at a time, any number can run through IndexScanCursor objects.
+*/
+class BTreeIndex {
+
+ private:
+
+  /**
+   * File object for the index file.
+   */
+	File		*file;
+
+  /**
+   * Buffer Manager Instance.
+   */
+	BufMgr	*bufMgr;
+
+  /**
+   * Page number of meta page.
+   */
+	PageId	headerPageNum;
+
+  /**
+   * page number of root page of B+ tree inside index file.
+   */
+	std::atomic<PageId>	rootPageNum;
+
+  /**
+   * Datatype of attribute over which index is built.
+   */
+	Datatype	attributeType;
+
+  /**
+   * Offset of attribute, over which index is built, inside records. 
+   */
+	int 		attrByteOffset;
+
+  /**
+   * Columns stored with each record id in the leaves, empty unless the index covers some.
+   */
+	std::vector<IncludedColumn> includedColumns;
+
+  /**
+   * Sum of the sizes of includedColumns.
+   */
+	int			includedBytes;
+
+  /**
+   * Number of keys in leaf node, depending upon the type of key.
+   */
+	int			leafOccupancy;
+
+  /**
+   * Number of keys in non-leaf node, depending upon the type of key.
+   */
+	int			nodeOccupancy;
+
+  /**
+   * The height of the current tree.  
+   * If the root node is the only node height = 1
+   * If root node has children then node height = 2
+   * ...
+   */
+  std::atomic<int>     height;
+
+  /**
+   * Fraction of a node below which deleteEntry rebalances it with a sibling.
+   */
+	double	underflowThreshold;
+
+  /**
+   * Most keys remembered by lookup, 0 when lookups are not cached.
+   */
+	size_t	lookupCacheCapacity;
+
+  /**
+   * Keys remembered by lookup, as the bytes of the key, most recently used first.
+   */
+	std::list<std::string> lookupCacheOrder;
+
+  /**
+   * Record id found by lookup for each key in lookupCacheOrder, and the position of the key in that list.
+   */
+	std::unordered_map<std::string, std::pair<RecordId, std::list<std::string>::iterator> > lookupCache;
+
+  /**
+   * Cursor behind startScan, scanNext and endScan.
+   */
+	IndexScanCursor	scanCursor;
+
+  /**
+   * True if non leaf nodes stay pinned in the buffer pool once read.
+   */
+	bool		innerNodesResident;
+
+  /**
+   * Frame of each resident non leaf node, by page number. nullptr for every other page.
+   */
+	std::vector<Page *> residentNodes;
+
+  /**
+   * True if readNode remembers the frame of every node it reads that is not resident.
+   */
+	bool		swizzling;
+
+  /**
+   * Frame holding each node remembered by readNode, by page number, until the page leaves the buffer pool.
+   * NO_FRAME for every other page.
+   */
+	std::vector<FrameId> swizzledFrames;
+
+  /**
+   * Entry of swizzledFrames for a page whose frame is not known.
+   */
+	static const FrameId NO_FRAME = (FrameId) -1;
+
+  /**
+   * True if lookup, insertEntry and deleteEntry may be called from several threads at once.
+   */
+	bool		concurrent;
+
+  /**
+   * Version counters of the nodes while concurrent; the node at page p uses counter p % LATCH_STRIPES.
+   * A counter is odd while a writer holds the latch of its nodes and moves on each time the writer lets go.
+   */
+	std::unique_ptr<std::atomic<std::uint64_t>[]> latches;
+
+  /**
+   * Counters latched by the writer that holds structureMutex.
+   */
+	std::vector<int> heldLatches;
+
+  /**
+   * Held by writers that split or merge nodes and by every delete, so that only one of them runs at a time.
+   */
+	std::mutex	structureMutex;
+
+  /**
+   * Held while the statistics in metaPageInfo change or are read, if the index is concurrent.
+   */
+	std::mutex	statisticsMutex;
+
+  /**
+   * True if the statistics changed since they were last written to the meta page.
+   */
+	std::atomic<bool> statisticsChanged;
+
+  /**
+   * Number of concurrent lookups, inserts and deletes running.
+   */
+	std::atomic<int> activeOperations;
+
+  /**
+   * Pages given up while concurrent, disposed of once no operation that may still be reading them is running.
+   */
+	std::vector<PageId> retiredPages;
+
+  /**
+   * True if the non leaf nodes keep the number of records under each child up to date.
+   */
+	bool		subtreeCounts;
+
+  /**
+   * Fraction of the entries the left node keeps when an entry past all the others splits the right-most node of a level.
+   */
+	double	appendSplitFraction;
+
+  /**
+   * Number of leaves an ascending scan has read in the background ahead of the one it is on; 0 reads none.
+   */
+	int			scanReadahead;
+
+  /**
+   * Moves on each time a node is allocated or disposed of, which every change to the shape of the tree does.
+   */
+	std::uint64_t	shapeVersion;
+
+  /**
+   * Right-most leaf, the non leaf nodes above it and the child taken in each, as found by the last insert that went
+   * there. Only used while shapeVersion is still rightmostVersion.
+   */
+	PageId	rightmostLeafPageNo;
+	std::vector<PageId> rightmostPath;
+	std::vector<int> rightmostChildIndex;
+	std::uint64_t	rightmostVersion;
+
+  /**
+   * Outcome of one optimistic attempt at an operation.
+   */
+	enum Attempt
+	{
+		RETRY,			/* a node changed while it was read, start again */
+		FAILED,			/* the key is missing, or the leaf has no room */
+		SUCCEEDED
+	};
+
+  IndexMetaInfo metaPageInfo {};
+
+  /**
+   * Allocate a leaf node in the buffer
+   *
+   * @param pageID the page id for the node
+   * @return pointer of new leaf node
+   */
+  template <class T>
+  LeafNode<T> *allocateLeafNode(PageId &pageID);
+
+  /**
+   * Allocate a non leaf node in the buffer
+   *
+   * @param pageID the page id for the node
+   * @param level level of the node in the tree
+   * @return pointer of new non leaf node
+   */
+  template <class T>
+  NonLeafNode<T> *allocateNonLeafNode(PageId &pageID, const int level);
+
+  /**
+   * Copy the included columns of record one after the other to included.
+   */
+  void copyIncluded(const char * record, char * included) const;
+
+  /**
+   * Create the index file, with its meta page, and build the tree over the base relation.
+   *
+   * @param relationName  Name of the base relation.
+   * @param outIndexName  Name of the index file.
+   * @param fillFactor    Fraction of the slots of each node to fill.
+   * @param runSize       Number of pairs sorted in memory before a run is spilled.
+   */
+  void createIndex(const std::string & relationName, const std::string & outIndexName,
+      const double fillFactor, const int runSize);
+
+  /**
+   * Build the tree bottom-up from every tuple of the base relation.
+   * The <key, rid> pairs are collected with FileScan and sorted in runs of at most runSize pairs. Runs that
+   * do not fit in memory are spilled to temporary files next to the index and merged back in key order.
+   *
+   * @param relationName  Name of the base relation.
+   * @param fillFactor    Fraction of the slots of each node to fill.
+   * @param runSize       Number of pairs sorted in memory before a run is spilled.
+   */
+  template <class T>
+  void bulkLoad(const std::string & relationName, const double fillFactor, const int runSize);
+
+  /**
+   * Build the tree from pairs handed out in key order. Leaves are written left to right and each non leaf
+   * level is built on top of the one below it, so every page of the index is written once.
+   * Sets rootPageNum and height.
+   *
+   * @param nextPair      Returns the next pair through its first argument and the included columns of its record
+   *                      through the second, or false once there are no more.
+   * @param fillFactor    Fraction of the slots of each node to fill.
+   */
+  template <class T>
+  void buildFromSorted(const std::function<bool (RIDKeyPair<T> &, char *)> & nextPair, const double fillFactor);
+
+  /**
+   * Rewrite an index file whose nodes predate the current NODE_FORMAT_VERSION. The entries of the old
+   * leaf chain are streamed, already in key order, into a new file that replaces the old one.
+   * Version 1 files only ever held INTEGER keys.
+   *
+   * @param oldRootPageNo   Root page of the old tree.
+   */
+  void upgradeNodeFormat(const PageId oldRootPageNo);
+
+  /**
+   * Point the leaf at pageNo to leftPageNo as its left sibling, once a split or merge has changed it.
+   */
+  template <class T>
+  void setLeftSibling(const PageId pageNo, const PageId leftPageNo);
+
+  /**
+   * Sort a run of <key, rid> pairs, moving the included columns of each pair along with it.
+   *
+   * @param run       Pairs in the order they were read.
+   * @param included  Included columns of the pairs of run, one after the other.
+   */
+  template <class T>
+  void sortRun(std::vector<RIDKeyPair<T> > & run, std::vector<char> & included);
+
+  /**
+   * Write a sorted run of <key, rid> pairs, each followed by its included columns, to a temporary blob file.
+   *
+   * @param run       Sorted pairs.
+   * @param included  Included columns of the pairs of run, one after the other.
+   * @param runName   Name of the file to create.
+   */
+  template <class T>
+  void spillRun(const std::vector<RIDKeyPair<T> > & run, const std::vector<char> & included, const std::string & runName);
+
+  /**
+   * Build one non leaf level of the tree on top of the level described by children.
+   *
+   * @param children    Separator in front of and page number of every node of the level below, in key order.
+   *                    Replaced by the separators and page numbers of the nodes just built.
+   * @param level       Level of the new nodes, 1 if the children are leaves.
+   * @param fillFactor  Fraction of each new node to fill.
+   */
+  template <class T>
+  void buildNonLeafLevel(std::vector<PageKeyPair<T> > & children, const int level, const double fillFactor);
+
+  /**
+   * Split a full leaf while inserting a new entry into it. The lower half stays in the leaf, the
+   * upper half moves to a newly allocated right sibling.
+   *
+   * @param leaf      full leaf, pinned
+   * @param leafPageNo  page number of the leaf
+   * @param index     slot at which the new entry belongs
+   * @param key       key of the new entry
+   * @param rid       record id of the new entry
+   * @param included  included columns of the new entry
+   * @param rightmost true if the leaf is the right-most one; a new entry past all of its keys then leaves
+   *                  appendSplitFraction of the entries in the leaf instead of half
+   * @return the first key of the new leaf and its page number, to be inserted into the parent
+   */
+  template <class T>
+  PageKeyPair<T> splitLeaf(LeafNode<T> *leaf, const PageId leafPageNo, const int index, const T key, const RecordId rid,
+      const char *included, const bool rightmost);
+
+  /**
+   * Split a full non leaf node while inserting a new separator into it. The middle key moves up
+   * to the parent instead of staying in either half.
+   *
+   * @param node      full non leaf node, pinned
+   * @param index     position at which the new separator belongs
+   * @param entry     separator and the page number of the child on its right
+   * @param entryCount  number of records under the child on the right of the new separator
+   * @param rightmost   true if the node is the right-most one of its level, split like a right-most leaf
+   * @return the middle key and the page number of the new right node, to be inserted into the parent
+   */
+  template <class T>
+  PageKeyPair<T> splitNonLeaf(NonLeafNode<T> *node, const int index, const PageKeyPair<T> entry, const std::uint32_t entryCount,
+      const bool rightmost);
+
+  /**
+   * Put a new root above the current one after the root has been split, and record it in the meta page.
+   *
+   * @param entry     separator and the page number of the new right half of the old root
+   */
+  template <class T>
+  void growRoot(const PageKeyPair<T> entry);
+
+  /**
+   * Make the node at pageNo the root of a tree of newHeight levels and record it in the meta page. Both change under
+   * the meta page latch, so that an optimistic reader never pairs a root with the height of another.
+   */
+  void recordRoot(const PageId pageNo, const int newHeight);
+
+  /**
+   * Whether keyValue is greater than every key of the leaf at rightmostLeafPageNo.
+   */
+  template <class T>
+  bool pastRightmost(const T keyValue);
+
+  /**
+   * insertBatch for an index whose keys are of type T, with the keys stride bytes apart.
+   */
+  template <class T>
+  void insertBatchKeys(const char * keys, const size_t stride, const RecordId * rids, const size_t n, const void * const * records);
+
+  /**
+   * Merge the sorted batch entries [begin, end), which all belong in the leaf at leafPageNo, into it in one pass. A leaf
+   * that overflows is split into as few leaves as hold its entries, and their separators go up together.
+   *
+   * @param path        non leaf nodes from the root down to the leaf
+   * @param childIndex  position of the child taken in each of them
+   * @param begin       key of each entry and its position in rids
+   * @param included    included columns of the batch, those of rids[i] at i * includedBytes
+   */
+  template <class T>
+  void mergeIntoLeaf(const PageId leafPageNo, std::vector<PageId> & path, std::vector<int> & childIndex,
+      const std::pair<T, size_t> * begin, const std::pair<T, size_t> * end, const RecordId * rids, const char * included);
+
+  /**
+   * Insert the separators of new children, split off the child childIndex.back() of path.back(), into the nodes of
+   * path from the bottom up, splitting the ones that overflow. New roots are added while the root overflows.
+   *
+   * @param entries       separator in front of and page number of each new child, in key order
+   * @param entryCounts   number of records under each new child
+   * @param added         records added under the split child, which the counts along path grow by
+   */
+  template <class T>
+  void insertChildren(std::vector<PageId> & path, std::vector<int> & childIndex, std::vector<PageKeyPair<T> > entries,
+      std::vector<std::uint32_t> entryCounts, const int added);
+
+  /**
+   * Load keys, with the children around them and their record counts, into node and as many new nodes on its level as
+   * they need, sharing them out evenly.
+   *
+   * @param pushUp        set to the key that moved up in front of each new node, and its page number
+   * @param pushUpCounts  set to the number of records under each new node
+   */
+  template <class T>
+  void distributeNonLeaf(NonLeafNode<T> * node, const std::vector<T> & keys, const std::vector<PageId> & children,
+      const std::vector<std::uint32_t> & counts, std::vector<PageKeyPair<T> > & pushUp, std::vector<std::uint32_t> & pushUpCounts);
+
   /**
-   * Name of base relation.
+   * Number of records behind the record id of a leaf entry: the length of its posting list, or 1.
    */
-	char relationName[20];
+  std::uint32_t entryRecords(const RecordId rid);
 
   /**
-   * Offset of attribute, over which index is built, inside the record stored in pages.
+   * Number of records under the node at pageNo, from the entries of a leaf or the counts of a non leaf node.
    */
-	int attrByteOffset;
+  template <class T>
+  std::uint32_t subtreeRecords(const PageId pageNo);
 
   /**
-   * Type of the attribute over which index is built.
+   * Add delta to the count of the child taken in each node of path, when subtree counts are kept.
+   *
+   * @param path        non leaf nodes from the root down
+   * @param childIndex  position of the child taken in each of them
+   * @param delta       records added (1) or removed (-1) under the last one
    */
-	Datatype attrType;
+  template <class T>
+  void addToCounts(const std::vector<PageId> & path, const std::vector<int> & childIndex, const int delta);
 
   /**
-   * Page number of root page of the B+ Tree inside the file index file.
+   * Count the records under the node at pageNo again, storing the counts of every non leaf node below it.
+   * @return number of records under the node
    */
-	PageId rootPageNo;
-};
+  template <class T>
+  std::uint32_t countSubtree(const PageId pageNo);
 
-/*
-Each node is a page, so once we read the page in we just cast the pointer to the page to this struct and use it to access the parts
-These structures basically are the format in which the information is stored in the pages for the index file depending on what kind of 
-node they are. The level memeber of each non leaf structure seen below is set to 1 if the nodes 
-at this level are just above the leaf nodes. Otherwise set to 0.
-*/
+  /**
+   * Number of records whose key is less than key, or not greater than it if inclusive. With subtree counts this
+   * reads one node per level; without them every leaf up to the key.
+   */
+  template <class T>
+  size_t countBelow(const T key, const bool inclusive);
 
-/**
- * @brief Structure for all non-leaf nodes when the key is of INTEGER type.
-*/
-struct NonLeafNodeInt{
   /**
-   * Level of the node in the tree.
+   * countRange for an index whose keys are of type T, once it keeps subtree counts.
    */
-	int level;
+  template <class T>
+  size_t countRangeKey(const T lowVal, const Operator lowOp, const T highVal, const Operator highOp);
 
   /**
-   * Stores keys.
+   * Count a node added to a level of the tree in the statistics, or one taken from it if change is negative.
    */
-	int keyArray[ INTARRAYNONLEAFSIZE ];
+  void countLevelPages(const int level, const int change);
 
   /**
-   * Stores page numbers of child pages which themselves are other non-leaf/leaf nodes in the tree.
+   * Count a record with key keyValue added to the index in the statistics, or one taken from it if change is -1.
    */
-	PageId pageNoArray[ INTARRAYNONLEAFSIZE + 1 ];
-};
+  template <class T>
+  void countEntry(const T keyValue, const int change);
 
+  /**
+   * Work the statistics out again once the number of records has doubled, or halved, since the histogram was drawn,
+   * unless the index is concurrent. Drawing it costs a read of every node, but happens less and less often.
+   */
+  void redrawStaleHistogram();
 
-/**
- * @brief Structure for all leaf nodes when the key is of INTEGER type.
-*/
-struct LeafNodeInt{
   /**
-   * Stores keys.
+   * Read every node under pageNo, counting the nodes of each level in levelPages, and hand the key of each leaf entry
+   * and its number of records to visit, in key order.
    */
-	int keyArray[ INTARRAYLEAFSIZE ];
+  template <class T>
+  void gatherStatistics(const PageId pageNo, std::uint32_t * levelPages,
+      const std::function<void (const T &, const std::uint32_t)> & visit);
 
   /**
-   * Stores RecordIds.
+   * refreshStatistics for an index whose keys are of type T.
    */
-	RecordId ridArray[ INTARRAYLEAFSIZE ];
+  template <class T>
+  void refreshStatisticsKey();
 
   /**
-   * Page number of the leaf on the right side.
-	 * This linking of leaves allows to easily move from one leaf to the next leaf during index scan.
+   * Copy the statistics to the meta page, if they changed since they were last written.
    */
-	PageId rightSibPageNo;
-};
-class duplicateKeyException
-{
-public:
-    duplicateKeyException(){
+  void writeStatistics();
 
-    }
-    void what(){
-      
-    }
+  /**
+   * estimateRange for an index whose keys are of type T.
+   */
+  template <class T>
+  double estimateRangeKey(const T lowVal, const Operator lowOp, const T highVal, const Operator highOp);
 
-};
-  class Queue{
-    public:
-    struct queueNode{
-      void * currentValue;
-      queueNode* nextValue;
-    };
-    queueNode* currentTop;
-    queueNode* currentEnd;
-
-    Queue(void *initValue){
-      queueNode tempCurrentTop = {initValue, NULL};
-      currentTop = &tempCurrentTop;
-      currentEnd = currentTop;
-    }
-    ~Queue(){
-      currentTop = NULL;
-      currentEnd = NULL;
-    }
-    const void pushNode(void * newNodeValue){
-      //Places the node on top of stack
-      queueNode current;
-      current = {newNodeValue, NULL};
-      currentEnd->nextValue = &current;
-      currentEnd = &current;
-    }
-    const void* peek(){
-      //Returns the top value without taking it off the top
-      void * current;
-      current = currentTop->currentValue;
-      return current;
-    }
-    const void* pop(){
-      //This returns the top value and takes it off the top
-      void * current;
-      current = currentTop->currentValue;
-      currentTop = currentTop->nextValue;
-      return current;
-    }
-    const int isEmpty(){
-      return (currentTop == currentEnd);
-    }
-  };
+  /**
+   * insertEntry for an index whose keys are of type T, with the included columns of the record already copied out.
+   * @return false if the record was already indexed under the key
+   */
+  template <class T>
+  bool insertKey(const T key, const RecordId rid, const char *included);
 
+  /**
+   * deleteEntry for an index whose keys are of type T.
+   */
+  template <class T>
+  void deleteKey(const T key, const RecordId rid);
 
+  /**
+   * Rebalance an underfull leaf with its right sibling under the same parent, or with its left one if it is
+   * the last child. The two are merged into the left one if their entries fit in a single leaf, and the right
+   * page is disposed of. Otherwise the entries are shared out evenly and the separator between them is replaced.
+   *
+   * @param parent    parent of the leaf, pinned
+   * @param position  child index of the underfull leaf in parent
+   * @return true if the leaves were merged, which removes a key from parent
+   */
+  template <class T>
+  bool rebalanceLeaves(NonLeafNode<T> *parent, const int position);
 
-/**
- * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute of a
- * relation. This index supports only one scan at a time.
-*/
-class BTreeIndex {
+  /**
+   * rebalanceLeaves for an underfull non leaf node. The separator in the parent is pulled down between the
+   * keys of the two nodes when they are merged or shared out.
+   */
+  template <class T>
+  bool rebalanceNonLeaves(NonLeafNode<T> *parent, const int position);
 
- private:
+  /**
+   * Write a posting list holding rids to newly allocated posting pages.
+   *
+   * @param rids      record ids sorted in increasing order, at least two of them
+   * @param included  included columns of the record ids, one after the other
+   * @return postingListRef of the first page, to store in the leaf entry of the key
+   */
+  RecordId writePostingList(const std::vector<RecordId> & rids, const std::vector<char> & included);
 
   /**
-   * File object for the index file.
+   * Read every record id of the posting list starting at headPageNo into rids, in increasing order, and their
+   * included columns into included unless it is null.
    */
-	File		*file;
+  void readPostingList(const PageId headPageNo, std::vector<RecordId> & rids, std::vector<char> * included);
 
   /**
-   * Buffer Manager Instance.
+   * Add rid, with its included columns, to the posting list starting at headPageNo. A page that overflows passes the
+   * record ids that no longer fit on to a new page chained after it.
+   *
+   * @return false, leaving the list unchanged, if rid is already in the list
    */
-	BufMgr	*bufMgr;
+  bool addToPostingList(const PageId headPageNo, const RecordId rid, const char * included);
 
   /**
-   * Page number of meta page.
+   * Remove rid from the posting list starting at headPageNo. Pages left empty are disposed of.
+   *
+   * @param remaining   set to the number of record ids left in the list
+   * @return false, leaving the list unchanged, if rid is not in the list
    */
-	PageId	headerPageNum;
+  bool removeFromPostingList(const PageId headPageNo, const RecordId rid, int & remaining);
 
   /**
-   * page number of root page of B+ tree inside index file.
+   * Dispose of every page of the posting list starting at headPageNo.
    */
-	PageId	rootPageNum;
+  void freePostingList(const PageId headPageNo);
 
   /**
-   * Datatype of attribute over which index is built.
+   * Make the only child of a root without keys the new root, dispose of the old root page and record the
+   * new root in the meta page.
+   *
+   * @param newRootPageNo   the only child of the root
    */
-	Datatype	attributeType;
+  void shrinkRoot(const PageId newRootPageNo);
 
   /**
-   * Offset of attribute, over which index is built, inside records. 
+   * Compact the leaves under every node of level 1 in the subtree at pageNo, from left to right.
    */
-	int 		attrByteOffset;
+  template <class T>
+  void compactSubtree(const PageId pageNo, const double fillFactor, std::vector<PageId> & replaced);
 
   /**
-   * Number of keys in leaf node, depending upon the type of key.
+   * Move the entries of the leaves under the level 1 node at parentPageNo into new leaves filled up to fillFactor, or
+   * fuller if the parent has no room for that many, and point the parent and the neighbouring leaves at them.
+   *
+   * @param replaced   receives the old leaves, to be disposed of once every leaf has moved
    */
-	int			leafOccupancy;
+  template <class T>
+  void compactLeaves(const PageId parentPageNo, const double fillFactor, std::vector<PageId> & replaced);
 
   /**
-   * Number of keys in non-leaf node, depending upon the type of key.
+   * Read the node at pageNo: a resident node straight from residentNodes, a node whose frame is in swizzledFrames
+   * by pinning that frame, any other page through the buffer pool.
+   * While inner nodes are kept resident, a non leaf node read here stays pinned from then on.
    */
-	int			nodeOccupancy;
+  Page *readNode(const PageId pageNo);
 
   /**
-   * The height of the current tree.  
-   * If the root node is the only node height = 1
-   * If root node has children then node height = 2
-   * ...
+   * Eviction handler of the index file while swizzling: the page left its frame.
    */
-  int     height;
+  void forgetFrame(const PageId pageNo);
 
-	// MEMBERS SPECIFIC TO SCANNING
+  /**
+   * Let go of a node read by readNode. Resident nodes stay pinned.
+   * @param dirty	true if the node was changed
+   */
+  void releaseNode(const PageId pageNo, const bool dirty);
 
   /**
-   * True if an index scan has been started.
+   * Hand the page of a released node back to the index file, unpinning it first if it is resident.
    */
-	bool		scanExecuting;
+  void disposeNode(const PageId pageNo);
 
   /**
-   * Index of next entry to be scanned in current leaf being scanned.
+   * Read every non leaf node of the subtree rooted at the non leaf node pageNo, so that they all become resident.
    */
-	int			nextEntry;
+  template <class T>
+  void loadResidentNodes(const PageId pageNo);
 
   /**
-   * Page number of current page being scanned.
+   * Wait until no writer holds the latch of pageNo and return its version.
    */
-	PageId	currentPageNum;
+  std::uint64_t awaitLatch(const PageId pageNo) const;
 
   /**
-   * Current Page being scanned.
+   * Whether the version of pageNo is still version, so that what was read from it since is consistent.
    */
-	Page		*currentPageData;
+  bool checkLatch(const PageId pageNo, const std::uint64_t version) const;
 
   /**
-   * Low INTEGER value for scan.
+   * Latch pageNo if its version is still version.
+   * @return false if another writer got there first
    */
-	int			lowValInt;
+  bool tryLatch(const PageId pageNo, const std::uint64_t version);
 
   /**
-   * Low DOUBLE value for scan.
+   * Let go of a latch taken by tryLatch.
    */
-	double	lowValDouble;
+  void unlatch(const PageId pageNo);
 
   /**
-   * Low STRING value for scan.
+   * Latch pageNo for the writer holding structureMutex until finishStructureChange, if the index is concurrent.
    */
-	std::string	lowValString;
+  void latchNode(const PageId pageNo);
 
   /**
-   * High INTEGER value for scan.
+   * Let go of every latch taken by latchNode and dispose of the retired pages if no other operation is running.
    */
-	int			highValInt;
+  void finishStructureChange();
 
   /**
-   * High DOUBLE value for scan.
+   * Follow keyValue from the root to its leaf without latching anything.
+   * @param leafPageNo	the leaf
+   * @param leafVersion	version of the leaf, taken before the descent was found to be consistent
+   * @return false if a node changed on the way down
    */
-	double	highValDouble;
+  template <class T>
+  bool descendOptimistic(const T keyValue, PageId & leafPageNo, std::uint64_t & leafVersion);
 
   /**
-   * High STRING value for scan.
+   * lookup while concurrent, one optimistic attempt.
    */
-	std::string highValString;
-	
+  template <class T>
+  Attempt lookupOptimistic(const T keyValue, RecordId & outRid);
+
   /**
-   * Low Operator. Can only be GT(>) or GTE(>=).
+   * insertEntry while concurrent, when the leaf of the key has room: the leaf is the only node latched.
+   * @param added  set to whether the record joined the index, it may already have been there
+   * @return FAILED if the leaf has to split
    */
-	Operator	lowOp;
+  template <class T>
+  Attempt insertInPlace(const T keyValue, const RecordId rid, const char * included, bool & added);
 
   /**
-   * High Operator. Can only be LT(<) or LTE(<=).
+   * insertEntry and deleteEntry while concurrent.
+   * @return false if the record was already indexed under the key
    */
-	Operator	highOp;
+  template <class T>
+  bool insertConcurrent(const T keyValue, const RecordId rid, const char * included);
+  template <class T>
+  void deleteConcurrent(const T keyValue, const RecordId rid);
 
-  IndexMetaInfo metaPageInfo {};
+  /**
+   * lookup for an index whose keys are of type T.
+   */
+  template <class T>
+  bool lookupKey(const T keyValue, RecordId & outRid);
 
   /**
-   * Allocate a leaf node in the buffer
-   *
-   * @param pageID the page id for the node
-   * @return pointer of new leaf node
+   * lookupMany for an index whose keys are of type T, with the keys stride bytes apart.
    */
-  LeafNodeInt *allocateLeafNode(PageId &pageID);
-
-  //Helper method specific.
-  const int checkOccupancy(int keyArray[],int size,int isLeaf,PageId children[],RecordId records[]);
-  const int findIndex(int keyArray[],int size,int key,RecordId currentRecordArray[INTARRAYLEAFSIZE],int isLeaf);
-  const void moveKeyIndex(int keyArray[],int size,int index);
-  const void moveRecordIndex(RecordId recordIdArray[],int size,int index);
-  const int  split(void *childNode,int isLeaf, PageId &newID,PageId currentId,int keyValue, RecordId rid,PageId childPageId_1,PageId childPageId_2);
-  const int split_1(NonLeafNodeInt *&childNode,int isLeaf, PageId &newID,PageId &currentId,int &keyValue, RecordId rid,PageId& childPageId_1,PageId& childPageId_2);
-  const void correctHeight();
-  const void insertMovePage(PageId tempPage[],PageId childPageId_1,PageId childPageId_2,int size);
-  const void moveRecordIndex_1(RecordId recordIdArray[],int &size,int &index);
-  const void moveRecordIndex_2(RecordId recordIdArray[],int &size,int index);
-  // class duplicateKeyException: public exception {
-  //   const char * what() const throw (){
-  //     return "C++ Exception";
-  //   }
-  // };
-/**
-*/
+  template <class T>
+  size_t lookupManyKeys(const char * keys, const size_t stride, const size_t n, RecordId * out, bool * found);
 
+  /**
+   * Look up the sorted probes [begin, end) in the subtree rooted at pageNo. Each node of the subtree is read at most
+   * once, and only if some probe falls in it.
+   * @return number of probes found
+   */
+  template <class T>
+  size_t probeSubtree(const PageId pageNo, const std::pair<T, size_t> * begin, const std::pair<T, size_t> * end,
+      RecordId * out, bool * found);
+
+  /**
+   * Remember rid as the lookup result for the key with bytes cacheKey, dropping the least recently used key if the
+   * cache is full.
+   */
+  void rememberLookup(const std::string & cacheKey, const RecordId rid);
 
-  class Stack{
-   public: 
-    struct stackNode{
-      void * currentValue;
-      stackNode * nextValue;
-    };
-    stackNode *currentTop;
-
-    Stack(void *initValue){
-      currentTop->currentValue = initValue;
-     }
-    ~Stack(){
-      currentTop = NULL;
-    }
-    const void pushNode(void * newNode){
-      //Places the node on top of stack
-      struct stackNode current;
-      current.currentValue = newNode;
-      current.nextValue = currentTop;
-      currentTop = &current;
-
-    }
-    const void* peek(){
-      //Returns the top value without taking it off the top
-      void * current;
-      current = currentTop->currentValue;
-      return current;
-    }
-    const void* pop(){
-      //This returns the top value and takes it off the top
-      void * current;
-      current = currentTop->currentValue;
-      currentTop = currentTop->nextValue;
-      return current;
-    }
-  };
+  /**
+   * Drop the remembered lookup result of the key with bytes cacheKey, if any.
+   */
+  void forgetLookup(const std::string & cacheKey);
 
+  // Helper function to find the page ID of the next level of page, return the  page ID of node in the next level
+  template <class T>
+  void find_next_nonleaf_node(NonLeafNode<T>* curpage, PageId& nextpageID, const T key);
 
+  friend class IndexScanCursor;
 
-	
  public:
 
   /**
    * BTreeIndex Constructor. 
 	 * Check to see if the corresponding index file exists. If so, open the file.
-	 * If not, create it and insert entries for every tuple in the base relation using FileScan class.
+	 * If not, create it and bulk load entries for every tuple in the base relation using FileScan class.
    *
    * @param relationName        Name of file.
    * @param outIndexName        Return the name of index file.
    * @param bufMgrIn						Buffer Manager Instance
    * @param attrByteOffset			Offset of attribute, over which index is to be built, in the record
    * @param attrType						Datatype of attribute over which index is built
-   * @throws  BadIndexInfoException     If the index file already exists for the corresponding attribute, but values in metapage(relationName, attribute byte offset, attribute type etc.) do not match with values received through constructor parameters.
+   * @param fillFactor					Fraction of each node filled when the index is bulk loaded
+   * @param runSize							Number of entries sorted in memory before spilling to disk during bulk loading
+   * @param includedColumns			Fixed size attributes stored with each record id in the leaves, so that scanNext can hand
+   *                          them out without the relation being read. At most MAX_INCLUDED_COLUMNS of them, of
+   *                          MAX_INCLUDED_BYTES in all.
+   * @throws  BadIndexInfoException     If the index file already exists for the corresponding attribute, but values in metapage(relationName, attribute byte offset, attribute type, included columns etc.) do not match with values received through constructor parameters, or if there are too many included columns.
    */
 	BTreeIndex(const std::string & relationName, std::string & outIndexName,
-						BufMgr *bufMgrIn,	const int attrByteOffset,	const Datatype attrType);
+						BufMgr *bufMgrIn,	const int attrByteOffset,	const Datatype attrType,
+						const double fillFactor = BULKLOAD_FILL_FACTOR, const int runSize = BULKLOAD_RUN_SIZE,
+						const std::vector<IncludedColumn> & includedColumns = std::vector<IncludedColumn>());
 	
 
   /**
@@ -457,10 +2210,248 @@ class BTreeIndex {
 	 * This splitting will require addition of new leaf page number entry into the parent non-leaf, which may in-turn get split.
 	 * This may continue all the way upto the root causing the root to get split. If root gets split, metapage needs to be changed accordingly.
 	 * Make sure to unpin pages as soon as you can.
+	 * A key that is already indexed keeps its single entry, and rid is added to the posting list of the key.
    * @param key			Key to insert, pointer to integer/double/char string
    * @param rid			Record ID of a record whose entry is getting inserted into the index.
+   * @param record	The record itself, which the included columns are copied from. Only needed if the index has any.
+	 * @throws  BadIndexInfoException If the index has included columns and no record is given.
 	**/
-	const void insertEntry(const void* key, const RecordId rid);
+	const void insertEntry(const void* key, const RecordId rid, const void* record = nullptr);
+
+
+  /**
+	 * Insert n entries at once, as insertEntry would one by one. The batch is sorted first and each leaf it falls into
+	 * is reached with a single descent, and gets all of its new entries merged in one pass. A leaf that overflows is
+	 * split into as many leaves as it needs at once, and so are the non leaf nodes above it, so appending a sorted batch
+	 * to an index costs about as much as bulk loading it. While concurrent the entries are inserted one by one.
+   * @param keys		n keys one after the other: ints, doubles, or char strings of STRINGSIZE bytes each
+   * @param rids		Record ID of the record of keys[i] in rids[i]
+   * @param n				Number of entries
+   * @param records	The record of keys[i] in records[i], which its included columns are copied from. Only needed if the
+   *                index has any.
+	 * @throws  BadIndexInfoException If the index has included columns and no records are given.
+	**/
+	void insertBatch(const void* keys, const RecordId* rids, const size_t n, const void* const* records = nullptr);
+
+
+  /**
+	 * Delete the entry <value,rid>.
+	 * Start from root to find the leaf holding the entry. If the key is shared by other records, rid only leaves its posting list.
+	 * Otherwise the entry is removed from the leaf. A leaf left with less than the underflow
+	 * threshold of its space, or with no entries at all, is merged with or borrows from a sibling. A merge removes a key
+	 * from the parent, which may leave the parent underfull in turn, up to the root. A root left with a single child is
+	 * replaced by that child. Pages emptied by merges are handed back to the index file.
+   * @param key			Key to delete, pointer to integer/double/char string
+   * @param rid			Record ID of the record whose entry is getting deleted from the index.
+	 * @throws  NoSuchKeyFoundException If the index holds no entry <value,rid>.
+	**/
+	const void deleteEntry(const void* key, const RecordId rid);
+
+
+  /**
+	 * Set the fraction of the entries that stay behind when the right-most leaf, or the right-most non leaf node of a
+	 * level, is split by an entry past all of its keys. With keys inserted in increasing order the nodes left behind
+	 * are then nearly full instead of half full. Such inserts also go straight to the right-most leaf, without a descent.
+   * @param fraction	Fraction between 0 and 1; 0.5 splits these nodes like any other.
+	**/
+	void setAppendSplitFraction(const double fraction);
+
+
+  /**
+	 * Set how many of the next leaves of an ascending scan are read in the background while the scan is on the current
+	 * one. The leaves are listed from their parent, so all of them are asked for at once rather than one sibling
+	 * pointer at a time. Descending scans do not read ahead. Leaves read too far ahead are evicted again before the scan
+	 * gets to them, so the number should stay well under the size of the buffer pool.
+   * @param leaves	Number of leaves to read ahead; 0 turns reading ahead off.
+	**/
+	void setScanReadahead(const int leaves);
+
+
+  /**
+	 * Set the fraction of a node below which deleteEntry rebalances it with a sibling. 0 only rebalances nodes that
+	 * are left empty.
+   * @param threshold	Fraction between 0 and 1. Past one half most deletes end up moving entries between siblings.
+	**/
+	void setUnderflowThreshold(const double threshold);
+
+
+  /**
+	 * Rewrite the leaves in key order into pages allocated one after the other, each filled up to fillFactor, so that
+	 * a range scan reads the index file front to back instead of jumping between pages left behind by splits. The
+	 * pages come from the end of the file, unless deletes left free pages in it. The leaves under one non leaf node
+	 * move at a time, and the old pages are given back to the file at the end. While concurrent, lookups and inserts
+	 * into leaves with room keep going; each move latches only the parent and the leaves it changes.
+	 * A scan in progress is ended first.
+   * @param fillFactor	Fraction of each leaf to fill, between 0 and 1
+	**/
+	void compact(const double fillFactor = BULKLOAD_FILL_FACTOR);
+
+
+  /**
+	 * Find the record with the given key. A single descent from the root, without starting a scan.
+	 * If the key is shared by several records the one with the smallest record id is returned, the first one a scan
+	 * would return.
+   * @param key			Key to find, pointer to integer/double/char string
+   * @param outRid	Record ID of the record with the key, set only if it is found
+   * @return true if the index holds the key
+	**/
+	bool lookup(const void* key, RecordId& outRid);
+
+
+  /**
+	 * Remember the results of up to entries keys found by lookup, the most recently used ones, so that repeated
+	 * lookups skip the descent. insertEntry and deleteEntry drop whatever is remembered for their key.
+   * @param entries	Most keys to remember. 0, the default, turns the cache off.
+	**/
+	void setLookupCacheSize(const size_t entries);
+
+
+  /**
+	 * Keep every non leaf node pinned in the buffer pool, so that the clock replacement never evicts the upper levels
+	 * of the tree, and reach them without the buffer hash table. Turning it on reads all non leaf nodes at once; nodes
+	 * created later by splits become resident when first read. The buffer pool has to have a frame for each of them
+	 * on top of what the other users of the pool need.
+   * @param resident	true to keep non leaf nodes resident, false to unpin them again
+	**/
+	void setInnerNodesResident(const bool resident);
+
+
+  /**
+	 * Remember the buffer frame of every node read on the way through the tree, so that reading the node again while it
+	 * is in the buffer pool pins its frame straight away instead of looking the page up in the buffer hash table.
+	 * The buffer manager tells the index when a page leaves its frame, through an eviction handler on the index file,
+	 * and the remembered frame is dropped.
+   * @param swizzle	true to remember frames, false to forget them and look every page up again
+	**/
+	void setSwizzling(const bool swizzle);
+
+
+  /**
+	 * Let lookup, insertEntry and deleteEntry be called from several threads at once, by optimistic lock coupling with
+	 * a single structure writer. Lookups never latch: they read each node together with its version counter, wait
+	 * while a writer holds it and start again if it changed meanwhile. There are no right links to follow past a
+	 * split, so a lookup that meets one starts over from the root. Inserts into a leaf with room latch only that leaf
+	 * and run alongside lookups and each other. Splits, merges, root changes and every delete take structureMutex and
+	 * run one at a time, so only lookups and inserts that need no split gain from more threads.
+	 * Pages freed while concurrent are disposed of once no operation is running.
+	 * Turns off the lookup cache, resident inner nodes and swizzling, whose tables are not shared between threads;
+	 * they must stay off while concurrent. Scans and lookupMany must not run alongside writers.
+	 * Must itself be called while no other thread uses the index.
+   * @param enable	true to allow concurrent use, false to go back to a single thread
+	**/
+	void setConcurrent(const bool enable);
+
+
+  /**
+	 * Keep the number of records under each child in the non leaf nodes, so that countRange and rankOf read only one
+	 * node per level instead of the leaves in between. Turning it on counts the whole tree once; from then on every
+	 * insert and delete adds to or takes from the counts along its path, and concurrent inserts always take the path
+	 * that latches the nodes they change. The setting is kept in the index file.
+	 * Must be called while no other thread uses the index.
+   * @param enable	true to keep counts, false to stop updating them
+	**/
+	void setSubtreeCounts(const bool enable);
+
+
+  /**
+	 * Number of records whose key is within the range, as the scan startScan would give with the same bounds.
+	 * With subtree counts this takes two descents of the tree; without them the range is scanned.
+   * @param lowVal	Low value of range, pointer to integer / double / char string
+   * @param lowOp		Low operator (GT/GTE)
+   * @param highVal	High value of range, pointer to integer / double / char string
+   * @param highOp	High operator (LT/LTE)
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+	**/
+	size_t countRange(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+
+
+  /**
+	 * Number of records whose key is less than key, which is where the first record with the key would be in a
+	 * full scan of the index. With subtree counts this takes one descent of the tree.
+   * @param key	Key to rank, pointer to integer / double / char string
+	**/
+	size_t rankOf(const void* key);
+
+
+  /**
+	 * Statistics of the index: height, nodes per level, records, smallest and largest key and an equi-depth histogram
+	 * of the keys. They come with the meta page when the index is opened and every change keeps them up to date, so
+	 * no node is read here. They reach the index file when it is closed.
+	**/
+	IndexStatistics getStatistics();
+
+
+  /**
+	 * Work the statistics out again from every node of the tree, which makes the smallest and largest key exact after
+	 * deletes and draws the histogram buckets again. Inserts and deletes do this themselves each time the number of
+	 * records has doubled or halved since the buckets were drawn, except while the index is concurrent.
+	 * Must not run alongside writers.
+	**/
+	void refreshStatistics();
+
+
+  /**
+	 * Number of records whose key is within the range, estimated from the histogram without reading any node. The
+	 * keys are taken to be spread evenly within each bucket.
+   * @param lowVal	Low value of range, pointer to integer / double / char string
+   * @param lowOp		Low operator (GT/GTE)
+   * @param highVal	High value of range, pointer to integer / double / char string
+   * @param highOp	High operator (LT/LTE)
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+	**/
+	double estimateRange(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+
+
+  /**
+	 * Whether the records within the range are expected to be fetched with fewer page reads through a scan of the
+	 * index than through a FileScan of the relation, which reads each of its pages once. The index scan is costed from
+	 * the statistics as a descent, the leaves holding the estimated matches, and a relation page for each match, as the
+	 * relation is not kept in key order.
+   * @param lowVal	Low value of range, pointer to integer / double / char string
+   * @param lowOp		Low operator (GT/GTE)
+   * @param highVal	High value of range, pointer to integer / double / char string
+   * @param highOp	High operator (LT/LTE)
+   * @param relationPages	Number of pages of the relation
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+	**/
+	bool preferIndexScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp,
+			const std::uint32_t relationPages);
+
+
+  /**
+	 * Fetch every record whose key is within the range, as the scan startScan would give with the same bounds.
+	 * The record ids of the range are gathered and sorted by page number first, so that each page of the relation
+	 * holding a match is read and pinned exactly once, in increasing page order, however the keys are spread over
+	 * the pages. A large range then costs about as much as a sequential scan of the pages it touches.
+	 * The scan started by startScan, if any, is left alone.
+   * @param lowVal	Low value of range, pointer to integer / double / char string
+   * @param lowOp		Low operator (GT/GTE)
+   * @param highVal	High value of range, pointer to integer / double / char string
+   * @param highOp	High operator (LT/LTE)
+   * @param outRids	Receives the record ids of the matching records, in increasing order
+   * @param outRecords	Receives the matching records, the one of outRids[i] in outRecords[i]
+   * @return number of records fetched
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+	**/
+	size_t fetchRange(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp,
+			std::vector<RecordId>& outRids, std::vector<std::string>& outRecords);
+
+
+  /**
+	 * Look up n keys at once, as lookup would one by one. The keys are sorted first, so that keys falling in the same
+	 * subtree share its descent and every node, leaves included, is read at most once for the whole batch.
+	 * The lookup cache is neither used nor filled.
+   * @param keys		n keys one after the other: ints, doubles, or char strings of STRINGSIZE bytes each
+   * @param n				Number of keys
+   * @param out			Record ID of the record with keys[i] in out[i], set only if it is found
+   * @param found		Whether keys[i] is in the index in found[i]
+   * @return number of keys found
+	**/
+	size_t lookupMany(const void* keys, const size_t n, RecordId* out, bool* found);
 
 
   /**
@@ -477,11 +2468,23 @@ x	 * greater than "a" and less than or equal to "d".
    * @throws  BadScanrangeException If lowVal > highval
 	 * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
 	**/
-	const void find_next_nonleaf_node(NonLeafNodeInt* curpage, PageId& nextpageID, int key);
-        const bool is_key_in_range(int key, int lowVal, const Operator lowOp, int highVal, const Operator highOp);
 	const void startScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
 
 
+  /**
+	 * Begin a filtered scan of the index that returns the matching entries from the highest key down to the lowest.
+	 * If another scan is already executing, that needs to be ended here.
+   * @param lowVal	Low value of range, pointer to integer / double / char string
+   * @param lowOp		Low operator (GT/GTE)
+   * @param highVal	High value of range, pointer to integer / double / char string
+   * @param highOp	High operator (LT/LTE)
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+	 * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
+	**/
+	const void startReverseScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+
+
   /**
 	 * Fetch the record id of the next index entry that matches the scan.
 	 * Return the next record from current page being scanned. If current page has been scanned to its entirety, move on to the right sibling of current page, if any exists, to start scanning that page. Make sure to unpin any pages that are no longer required.
@@ -492,6 +2495,38 @@ x	 * greater than "a" and less than or equal to "d".
 	const void scanNext(RecordId& outRid);  // returned record id
 
 
+  /**
+	 * Fetch the record id of the next index entry that matches the scan, along with the columns the index includes,
+	 * so that a scan needing no other column never reads the relation.
+   * @param outRid	RecordId of next record found that satisfies the scan criteria returned in this
+   * @param included	receives the included columns of the record, one after the other in the order the index was given them
+	 * @throws ScanNotInitializedException If no scan has been initialized.
+	 * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
+	**/
+	const void scanNext(RecordId& outRid, void* included);
+
+
+  /**
+	 * Fetch the record ids of up to max of the next index entries that match the scan, without an exception at the end.
+   * @param out	array of at least max record ids, the matching record ids are written to its start
+   * @param max	most record ids to fetch
+   * @return number of record ids written; less than max once the scan has run out of matches
+	 * @throws ScanNotInitializedException If no scan has been initialized.
+	**/
+	size_t scanNextBatch(RecordId* out, const size_t max);
+
+
+  /**
+	 * scanNextBatch that also fetches the columns the index includes.
+   * @param out	array of at least max record ids, the matching record ids are written to its start
+   * @param included	room for the included columns of max records, those of out[i] are written after those of out[i - 1]
+   * @param max	most record ids to fetch
+   * @return number of record ids written; less than max once the scan has run out of matches
+	 * @throws ScanNotInitializedException If no scan has been initialized.
+	**/
+	size_t scanNextBatch(RecordId* out, void* included, const size_t max);
+
+
   /**
 	 * Terminate the current scan. Unpin any pinned pages. Reset scan specific variables.
 	 * @throws ScanNotInitializedException If no scan has been initialized.
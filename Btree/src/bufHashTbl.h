@@ -40,7 +40,8 @@ struct hashBucket {
 /**
 * @brief Hash table class to keep track of pages in the buffer pool
 *
-* @warning This class is not threadsafe.
+* @warning This class is not threadsafe. Calls for entries in different buckets touch different chains, so the
+* caller may let them run at once, as long as calls for entries of one bucket run one at a time.
 */
 class BufHashTbl
 {
@@ -73,6 +74,18 @@ class BufHashTbl
    * Destructor of BufHashTbl class
 	 */
   ~BufHashTbl(); // destructor
+
+	/**
+   * Bucket of the hash table that holds the entry of (file, pageNo), if any.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @return  			Bucket number, between 0 and HTSIZE-1
+	 */
+  int bucketOf(const File* file, const PageId pageNo)
+  {
+		return hash(file, pageNo);
+  }
 	
 	/**
    * Insert entry into hash table mapping (file, pageNo) to frameNo.
@@ -21,7 +21,7 @@ namespace badgerdb {
 //----------------------------------------
 
 BufMgr::BufMgr(std::uint32_t bufs)
-	: numBufs(bufs) {
+	: numBufs(bufs), prefetchStopping(false), prefetchFile(NULL), prefetchPageNo(Page::INVALID_NUMBER) {
 	bufDescTable = new BufDesc[bufs];
 
   for (FrameId i = 0; i < bufs; i++) 
@@ -35,11 +35,22 @@ BufMgr::BufMgr(std::uint32_t bufs)
   int htsize = ((((int) (bufs * 1.2))*2)/2)+1;
   hashTable = new BufHashTbl (htsize);  // allocate the buffer hash table
 
-  clockHand = bufs - 1;
+  clockHand = 0;
+  clearBufStats();
 }
 
 
 BufMgr::~BufMgr() {
+  if (prefetchThread.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> guard(prefetchMutex);
+      prefetchStopping = true;
+    }
+    prefetchWakeup.notify_one();
+    prefetchThread.join();
+  }
+
   //Flush out all unwritten pages
   for (std::uint32_t i = 0; i < numBufs; i++) 
   {
@@ -54,67 +65,186 @@ BufMgr::~BufMgr() {
   delete [] bufPool;
 }
 
-void BufMgr::allocBuf(FrameId & frame) 
+void BufMgr::allocBuf(FrameId & frame, const bool quiet) 
 {
   // perform first part of clock algorithm to search for 
   // open buffer frame
-  // Assumes non-concurrent access to buffer manager
   std::uint32_t numScanned = 0;
-  bool found = 0;
 
   while (numScanned < 2*numBufs)	//Need to scn twice
   {
     // advance the clock
-    advanceClock();
+    FrameId candidate = advanceClock();
+    BufDesc* tmpbuf = &bufDescTable[candidate];
     numScanned++;
 
-    // if invalid, use frame
-    if (! bufDescTable[clockHand].valid)
+    std::unique_lock<std::mutex> latch(tmpbuf->latch);
+    // if invalid, use frame, unless another thread is setting it up
+    if (! tmpbuf->valid)
     {
-      break;
+      if (tmpbuf->pinCnt == 0)
+      {
+        tmpbuf->pinCnt = 1;
+        frame = candidate;
+        return;
+      }
+      continue;
     }
 
     // is valid, check referenced bit
-    if (! bufDescTable[clockHand].refbit)
+    if (tmpbuf->refbit)
     {
-      // check to see if someone has it pinned
-      if (bufDescTable[clockHand].pinCnt == 0)
-      {
-        // hasn't been referenced and is not pinned, use it
-        // remove previous entry from hash table
-        hashTable->remove(bufDescTable[clockHand].file, bufDescTable[clockHand].pageNo);
-        found = true;
-        break;
-      }
+      // has been referenced, clear the bit
+      accessCount++;
+      tmpbuf->refbit = false;
+      continue;
     }
-    else
+
+    // check to see if someone has it pinned, or if its file would have to hear about it and must not
+    if (tmpbuf->pinCnt > 0 || (quiet && hasEvictionHandler(tmpbuf->file)))
     {
-      // has been referenced, clear the bit
-      bufStats.accesses++;
-      bufDescTable[clockHand].refbit = false;
+      continue;
+    }
+
+    // the table latch of the page comes first, so the frame is looked at again once both are held
+    File* file = tmpbuf->file;
+    PageId pageNo = tmpbuf->pageNo;
+    latch.unlock();
+    std::lock_guard<std::mutex> table(tableLatch(file, pageNo));
+    latch.lock();
+    if (!tmpbuf->valid || tmpbuf->file != file || tmpbuf->pageNo != pageNo || tmpbuf->pinCnt > 0 || tmpbuf->refbit)
+    {
+      continue;
+    }
+
+    // flush any existing changes to disk if necessary; a thread reading the page again waits on the table latch
+    // until it is written
+    if (tmpbuf->dirty)
+    {
+      diskWriteCount++;
+      tmpbuf->file->writePage(pageNo, bufPool[candidate]);
     }
+
+    // hasn't been referenced and is not pinned, use it
+    // remove previous entry from hash table
+    notifyEviction(candidate);
+    hashTable->remove(file, pageNo);
+
+    //Reset all the BufDesc entry for the frame before returning the frame
+    tmpbuf->Clear();
+    tmpbuf->pinCnt = 1;
+
+    // return new frame number
+    frame = candidate;
+    return;
   }
-  
+
   // check for full buffer pool
-  if (!found && numScanned >= 2*numBufs)
+  throw BufferExceededException();
+} // end allocBuf
+
+void BufMgr::releaseBuf(const FrameId frame)
+{
+  std::lock_guard<std::mutex> latch(bufDescTable[frame].latch);
+  bufDescTable[frame].Clear();
+}
+
+bool BufMgr::pinResident(File* file, const PageId pageNo, FrameId & frameNo, bool & loading)
+{
+  try
   {
-    throw BufferExceededException();
+    hashTable->lookup(file, pageNo, frameNo);
   }
-  
-  // flush any existing changes to disk if necessary
-  if (bufDescTable[clockHand].dirty)
+  catch(HashNotFoundException e)
+  {
+    return false;
+  }
+  std::lock_guard<std::mutex> latch(bufDescTable[frameNo].latch);
+  // set the referenced bit
+  bufDescTable[frameNo].refbit = true;
+  bufDescTable[frameNo].pinCnt++;
+  loading = bufDescTable[frameNo].loading;
+  return true;
+}
+
+bool BufMgr::reserveLoad(File* file, const PageId pageNo, const FrameId frameNo)
+{
+  std::lock_guard<std::mutex> table(tableLatch(file, pageNo));
+  // another thread may have put the page in the pool while the frame was found
+  try
+  {
+    FrameId residentNo = 0;
+    hashTable->lookup(file, pageNo, residentNo);
+    releaseBuf(frameNo);
+    return false;
+  }
+  catch(HashNotFoundException e)
   {
-    bufStats.diskwrites++;
-    //status = bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo,
-    bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo, bufPool[clockHand]);
   }
 
-	//Reset all the BufDesc entry for the frame before returning the frame
-  bufDescTable[clockHand].Clear();
+  // set up the entry properly, pinned by the thread that reads the page in
+  {
+    std::lock_guard<std::mutex> latch(bufDescTable[frameNo].latch);
+    bufDescTable[frameNo].Set(file, pageNo);
+    bufDescTable[frameNo].loading = true;
+  }
 
-  // return new frame number
-  frame = clockHand;
-} // end allocBuf
+  // insert in the hash table
+  hashTable->insert(file, pageNo, frameNo);
+  return true;
+}
+
+void BufMgr::loadFrame(File* file, const PageId pageNo, const FrameId frameNo)
+{
+  BufDesc* tmpbuf = &bufDescTable[frameNo];
+  try
+  {
+    diskReadCount++;
+    //status = file->readPage(pageNo, &bufPool[frameNo]);
+    bufPool[frameNo] = file->readPage(pageNo);
+  }
+  catch(...)
+  {
+    // the page leaves the pool; the frame is free again once the threads waiting on it have given their pins back
+    {
+      std::lock_guard<std::mutex> table(tableLatch(file, pageNo));
+      std::lock_guard<std::mutex> latch(tmpbuf->latch);
+      hashTable->remove(file, pageNo);
+      int waiting = tmpbuf->pinCnt - 1;
+      std::lock_guard<std::mutex> guard(loadMutex);
+      tmpbuf->Clear();
+      tmpbuf->pinCnt = waiting;
+    }
+    loadDone.notify_all();
+    throw;
+  }
+  {
+    std::lock_guard<std::mutex> latch(tmpbuf->latch);
+    std::lock_guard<std::mutex> guard(loadMutex);
+    tmpbuf->loading = false;
+  }
+  loadDone.notify_all();
+}
+
+bool BufMgr::awaitLoad(const FrameId frameNo)
+{
+  BufDesc* tmpbuf = &bufDescTable[frameNo];
+  {
+    std::unique_lock<std::mutex> guard(loadMutex);
+    loadDone.wait(guard, [tmpbuf]() { return !tmpbuf->loading; });
+  }
+  std::lock_guard<std::mutex> latch(tmpbuf->latch);
+  if (tmpbuf->valid)
+  {
+    return true;
+  }
+  // the read failed, and the pin taken on the page now holds an empty frame
+  if (--tmpbuf->pinCnt == 0)
+  {
+    tmpbuf->Clear();
+  }
+  return false;
+}
 
 	
 void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
@@ -122,32 +252,38 @@ void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
   // check to see if it is already in the buffer pool
   // std::cout << "readPage called on file.page " << file << "." << pageNo << endl;
   FrameId frameNo = 0;
-	try
-	{
-  	hashTable->lookup(file, pageNo, frameNo);
-
-    // set the referenced bit
-    bufDescTable[frameNo].refbit = true;
-    bufDescTable[frameNo].pinCnt++;
-    page = &bufPool[frameNo];
-  }
-  catch(HashNotFoundException e) //not in the buffer pool, must allocate a new page
+  while (true)
   {
+    bool found;
+    bool loading = false;
+    {
+      std::lock_guard<std::mutex> table(tableLatch(file, pageNo));
+      found = pinResident(file, pageNo, frameNo, loading);
+    }
+    if (found)
+    {
+      // a page still being read by another thread is waited for, and looked up again if that read failed
+      if (loading && !awaitLoad(frameNo))
+      {
+        continue;
+      }
+      page = &bufPool[frameNo];
+      return;
+    }
+
+    //not in the buffer pool, must allocate a new page
     // alloc a new frame
     allocBuf(frameNo);
-
-    // read the page into the new frame
-    bufStats.diskreads++;
-    //status = file->readPage(pageNo, &bufPool[frameNo]);
-    bufPool[frameNo] = file->readPage(pageNo);
-
-    // set up the entry properly
-    bufDescTable[frameNo].Set(file, pageNo);
-    page = &bufPool[frameNo];
-
-    // insert in the hash table
-    hashTable->insert(file, pageNo, frameNo);
+    if (reserveLoad(file, pageNo, frameNo))
+    {
+      break;
+    }
   }
+
+  // read the page into the new frame; a request to read it in the background is late and would read it again
+  dropPrefetches(file, pageNo);
+  loadFrame(file, pageNo, frameNo);
+  page = &bufPool[frameNo];
 }
 
 
@@ -156,25 +292,118 @@ void BufMgr::unPinPage(File* file, const PageId pageNo,
 {
   // lookup in hashtable
   FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
+  {
+    std::lock_guard<std::mutex> table(tableLatch(file, pageNo));
+    hashTable->lookup(file, pageNo, frameNo);
+  }
+
+  // the page is pinned, so the frame holds it until the pin is given back
+  unPinFrame(frameNo, dirty);
+}
 
+void BufMgr::unPinFrame(const FrameId frameNo, const bool dirty)
+{
+  std::lock_guard<std::mutex> latch(bufDescTable[frameNo].latch);
   if (dirty == true) bufDescTable[frameNo].dirty = dirty;
 
   // make sure the page is actually pinned
   if (bufDescTable[frameNo].pinCnt == 0)
   {
-  	throw PageNotPinnedException(file->filename(), pageNo, frameNo);
+  	throw PageNotPinnedException(bufDescTable[frameNo].file->filename(), bufDescTable[frameNo].pageNo, frameNo);
   }
   else bufDescTable[frameNo].pinCnt--;
 }
 
+void BufMgr::setEvictionHandler(const File* file, const std::function<void (const PageId)> & handler)
+{
+  std::lock_guard<std::mutex> guard(handlerMutex);
+  for (std::size_t i = 0; i < evictionHandlers.size(); i++)
+  {
+    if (evictionHandlers[i].first == file)
+    {
+      evictionHandlers.erase(evictionHandlers.begin() + i);
+      break;
+    }
+  }
+  if (handler)
+  {
+    evictionHandlers.push_back(std::make_pair(file, handler));
+  }
+}
+
+void BufMgr::notifyEviction(const FrameId frame)
+{
+  std::lock_guard<std::mutex> guard(handlerMutex);
+  for (std::size_t i = 0; i < evictionHandlers.size(); i++)
+  {
+    if (evictionHandlers[i].first == bufDescTable[frame].file)
+    {
+      evictionHandlers[i].second(bufDescTable[frame].pageNo);
+    }
+  }
+}
+
+void BufMgr::dropPrefetches(const File* file, const PageId pageNo)
+{
+  std::unique_lock<std::mutex> guard(prefetchMutex);
+  for (std::size_t i = 0; i < prefetchQueue.size(); )
+  {
+    if (prefetchQueue[i].first == file && (pageNo == Page::INVALID_NUMBER || prefetchQueue[i].second == pageNo))
+      prefetchQueue.erase(prefetchQueue.begin() + i);
+    else
+      i++;
+  }
+  //a request already taken off the queue is waited for, as it may still put the page in the pool
+  prefetchDone.wait(guard, [this, file, pageNo]() {
+    return prefetchFile != file || (pageNo != Page::INVALID_NUMBER && prefetchPageNo != pageNo);
+  });
+}
+
+bool BufMgr::hasEvictionHandler(const File* file) const
+{
+  std::lock_guard<std::mutex> guard(handlerMutex);
+  for (std::size_t i = 0; i < evictionHandlers.size(); i++)
+  {
+    if (evictionHandlers[i].first == file)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
 void BufMgr::flushFile(const File* file) 
 {
+  //the file may be closed next, so nothing is read from it in the background any more
+  dropPrefetches(file, Page::INVALID_NUMBER);
   for (std::uint32_t i = 0; i < numBufs; i++)
 	{
   	BufDesc* tmpbuf = &(bufDescTable[i]);
-  	if(tmpbuf->valid == true && tmpbuf->file == file)
+  	std::unique_lock<std::mutex> latch(tmpbuf->latch);
+  	if (tmpbuf->file != file)
+  		continue;
+  	if (tmpbuf->valid == false)
+  		throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty, tmpbuf->valid, tmpbuf->refbit);
+
+  	// the table latch of the page comes first, so the frame is looked at again once both are held
+  	PageId pageNo = tmpbuf->pageNo;
+  	latch.unlock();
+  	std::unique_lock<std::mutex> table(tableLatch(file, pageNo));
+  	latch.lock();
+  	if (tmpbuf->valid == true && tmpbuf->file == file && tmpbuf->pageNo == pageNo)
 		{
+	    if (tmpbuf->loading)
+			{
+				// the pin of the thread reading the page in is not one the caller forgot; wait for the read, then look again
+				tmpbuf->pinCnt++;
+				latch.unlock();
+				table.unlock();
+				if (awaitLoad(i))
+					unPinFrame(i, false);
+				i--;
+				continue;
+			}
+
 	    if (tmpbuf->pinCnt > 0)
   			throw PagePinnedException(file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
 
@@ -185,25 +414,55 @@ void BufMgr::flushFile(const File* file)
 				tmpbuf->dirty = false;
     	}
 
+    	notifyEviction(i);
     	hashTable->remove(file,tmpbuf->pageNo);
     	tmpbuf->Clear();
   	}
-		else if (tmpbuf->valid == false && tmpbuf->file == file)
-  		throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty, tmpbuf->valid, tmpbuf->refbit);
   }
+  // the file itself no longer flushes on every write
+  file->flush();
 }
 
 void BufMgr::disposePage(File* file, const PageId pageNo) 
 {
+  //a page read after this would still be in the pool when the file hands the page number out again
+  dropPrefetches(file, pageNo);
 	//Deallocate from file altogether
   //See if it is in the buffer pool
-  FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
+  while (true)
+  {
+    std::unique_lock<std::mutex> table(tableLatch(file, pageNo));
+    FrameId frameNo = 0;
+    try
+    {
+      hashTable->lookup(file, pageNo, frameNo);
+    }
+    catch(HashNotFoundException e) //not in the buffer pool, only the file has to let go of it
+    {
+      break;
+    }
+
+    std::unique_lock<std::mutex> latch(bufDescTable[frameNo].latch);
+    if (bufDescTable[frameNo].loading)
+    {
+      // a frame cleared under the thread reading the page in would be filled again; wait for the read, then look again
+      bufDescTable[frameNo].pinCnt++;
+      latch.unlock();
+      table.unlock();
+      if (awaitLoad(frameNo))
+      {
+        unPinFrame(frameNo, false);
+      }
+      continue;
+    }
 
-	// clear the page
-	bufDescTable[frameNo].Clear();
+    // clear the page
+    notifyEviction(frameNo);
+    bufDescTable[frameNo].Clear();
 
-	hashTable->remove(file, pageNo);
+    hashTable->remove(file, pageNo);
+    break;
+  }
 
   // deallocate it in the file	
   file->deletePage(pageNo);
@@ -219,16 +478,130 @@ void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page)
 
   // allocate a new page in the file
 	//std::cerr << "buffer data size:" << bufPool[frameNo].data_.length() << "\n";
-  bufPool[frameNo] = file->allocatePage(pageNo);
+  try
+  {
+    bufPool[frameNo] = file->allocatePage(pageNo);
+  }
+  catch(...)
+  {
+    releaseBuf(frameNo);
+    throw;
+  }
   page = &bufPool[frameNo];
 
   // set up the entry properly
-  bufDescTable[frameNo].Set(file, pageNo);
+  std::lock_guard<std::mutex> table(tableLatch(file, pageNo));
+  {
+    std::lock_guard<std::mutex> latch(bufDescTable[frameNo].latch);
+    bufDescTable[frameNo].Set(file, pageNo);
+  }
 
   // insert in the hash table
   hashTable->insert(file, pageNo, frameNo);
 }
 
+bool BufMgr::prefetchPage(File* file, const PageId pageNo)
+{
+  {
+    std::lock_guard<std::mutex> table(tableLatch(file, pageNo));
+    FrameId frameNo = 0;
+    try
+    {
+      hashTable->lookup(file, pageNo, frameNo);
+      return true;
+    }
+    catch(HashNotFoundException e)
+    {
+    }
+  }
+  std::lock_guard<std::mutex> guard(prefetchMutex);
+  //pages asked for too far ahead would push out of the pool the ones asked for before them
+  if (prefetchQueue.size() >= numBufs / 4)
+  {
+    return false;
+  }
+  prefetchQueue.push_back(std::make_pair(file, pageNo));
+  if (!prefetchThread.joinable())
+  {
+    prefetchThread = std::thread(&BufMgr::prefetchLoop, this);
+  }
+  prefetchWakeup.notify_one();
+  return true;
+}
+
+void BufMgr::prefetchLoop()
+{
+  while (true)
+  {
+    File* file;
+    PageId pageNo;
+    {
+      std::unique_lock<std::mutex> lock(prefetchMutex);
+      prefetchWakeup.wait(lock, [this]() { return prefetchStopping || !prefetchQueue.empty(); });
+      if (prefetchStopping)
+      {
+        return;
+      }
+      file = prefetchQueue.front().first;
+      pageNo = prefetchQueue.front().second;
+      prefetchQueue.pop_front();
+      // the request stays visible to dropPrefetches until the page is in the pool or given up
+      prefetchFile = file;
+      prefetchPageNo = pageNo;
+    }
+
+    readAhead(file, pageNo);
+
+    {
+      std::lock_guard<std::mutex> lock(prefetchMutex);
+      prefetchFile = NULL;
+      prefetchPageNo = Page::INVALID_NUMBER;
+    }
+    prefetchDone.notify_all();
+  }
+}
+
+void BufMgr::readAhead(File* file, const PageId pageNo)
+{
+  //the page may have been read by its user meanwhile
+  FrameId frameNo = 0;
+  {
+    std::lock_guard<std::mutex> table(tableLatch(file, pageNo));
+    try
+    {
+      hashTable->lookup(file, pageNo, frameNo);
+      return;
+    }
+    catch(HashNotFoundException e)
+    {
+    }
+  }
+  try
+  {
+    allocBuf(frameNo, true);
+  }
+  catch(...)
+  {
+    //a request that cannot be met for want of a frame is only a hint and is dropped
+    return;
+  }
+  if (!reserveLoad(file, pageNo, frameNo))
+  {
+    return;
+  }
+  try
+  {
+    loadFrame(file, pageNo, frameNo);
+  }
+  catch(...)
+  {
+    //nor is one for a page that is gone
+    return;
+  }
+  // the page stays in the pool unpinned, for its user to find
+  unPinFrame(frameNo, false);
+}
+
 void BufMgr::printSelf(void) 
 {
   BufDesc* tmpbuf;
@@ -10,6 +10,13 @@
 #include "file.h"
 #include "bufHashTbl.h"
 #include <iostream>
+#include <functional>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
 
 namespace badgerdb {
 
@@ -61,6 +68,18 @@ class BufDesc {
 	 */
   bool refbit;
 
+	/**
+   * True while the page is being read from the file into the frame. Threads that find the page meanwhile pin it
+   * and wait for the read to finish.
+	 */
+  bool loading;
+
+	/**
+   * Held while the other members are read or changed, so that threads using different frames do not wait for each
+   * other. Taken after the table latch of the page of the frame, when both are needed.
+	 */
+  std::mutex latch;
+
 	/**
    * Initialize buffer frame for a new user
 	 */
@@ -72,6 +91,7 @@ class BufDesc {
     dirty = false;
     refbit = false;
 		valid = false;
+    loading = false;
   };
 
 	/**
@@ -104,6 +124,7 @@ class BufDesc {
 		std::cout << "valid:" << valid << " ";
 		std::cout << "pinCnt:" << pinCnt << " ";
 		std::cout << "dirty:" << dirty << " ";
+		std::cout << "loading:" << loading << " ";
 		std::cout << "refbit:" << refbit << "\n";
   }
 
@@ -162,9 +183,9 @@ class BufMgr
 {
  private:
 	/**
-   * Current position of clockhand in our buffer pool
+   * Current position of clockhand in our buffer pool, advanced by every thread looking for a frame
 	 */
-  FrameId clockHand;
+  std::atomic<std::uint32_t> clockHand;
 
 	/**
    * Number of frames in the buffer pool
@@ -182,24 +203,176 @@ class BufMgr
   BufDesc *bufDescTable;
 
 	/**
-   * Maintains Buffer pool usage statistics 
+   * Buffer pool usage statistics, as in BufStats, counted by every thread using the pool
+	 */
+  std::atomic<int> accessCount;
+  std::atomic<int> diskReadCount;
+  std::atomic<int> diskWriteCount;
+
+	/**
+   * Number of latches the buckets of hashTable are shared out over
+	 */
+  static const std::uint32_t TABLE_STRIPES = 64;
+
+	/**
+   * Latches over the buckets of hashTable. The latch of a page is held while its entry is looked up, added or
+   * removed, and while the page is written back, so that threads using pages of different latches do not wait for
+   * each other.
+	 */
+  std::mutex tableLatches[TABLE_STRIPES];
+
+	/**
+   * Held while evictionHandlers is read or changed
+	 */
+  mutable std::mutex handlerMutex;
+
+	/**
+   * Held while the loading flag of a frame is cleared or waited on
+	 */
+  std::mutex loadMutex;
+
+	/**
+   * Wakes the threads waiting for a page to be read into its frame
+	 */
+  std::condition_variable loadDone;
+
+	/**
+   * Held while prefetchQueue, prefetchThread, prefetchStopping or the request being read is read or changed
+	 */
+  std::mutex prefetchMutex;
+
+	/**
+   * Functions called with the page number whenever a page of their file leaves the buffer pool
+	 */
+  std::vector<std::pair<const File*, std::function<void (const PageId)> > > evictionHandlers;
+
+	/**
+   * Pages asked for by prefetchPage and not read yet, oldest first
+	 */
+  std::deque<std::pair<File*, PageId> > prefetchQueue;
+
+	/**
+   * Reads the pages of prefetchQueue, started by the first call to prefetchPage
+	 */
+  std::thread prefetchThread;
+
+	/**
+   * Wakes prefetchThread when a page is queued, or when it has to stop
+	 */
+  std::condition_variable prefetchWakeup;
+
+	/**
+   * True once prefetchThread has to stop
+	 */
+  bool prefetchStopping;
+
+	/**
+   * File of the request prefetchThread took off prefetchQueue and is still reading, NULL if none
+	 */
+  File* prefetchFile;
+
+	/**
+   * Page of the request prefetchThread is still reading
+	 */
+  PageId prefetchPageNo;
+
+	/**
+   * Wakes the threads waiting in dropPrefetches once prefetchThread is done with a request
+	 */
+  std::condition_variable prefetchDone;
+
+	/**
+	 * Body of prefetchThread: read the queued pages one at a time into frames that are left unpinned. No latch is
+	 * held while a page is read, so the threads using the pool meanwhile only wait for it if they want that page.
+	 */
+  void prefetchLoop();
+
+	/**
+	 * Read one page taken off prefetchQueue into a frame that is left unpinned, unless it is already in the pool.
+	 * A request that cannot be met, for want of a frame or because the page is gone, is dropped.
+	 */
+  void readAhead(File* file, const PageId pageNo);
+
+	/**
+	 * Call the eviction handlers of the file of a frame that is about to be given up.
+	 *
+	 * @param frame   	Frame whose page is leaving the buffer pool
+	 */
+  void notifyEviction(const FrameId frame);
+
+	/**
+	 * Take the requests for a page of file out of prefetchQueue, or those for all its pages if pageNo is
+	 * Page::INVALID_NUMBER, and wait for prefetchThread to be done with such a request if it is reading one.
+	 * The caller must not hold any latch.
 	 */
-  BufStats bufStats;
+  void dropPrefetches(const File* file, const PageId pageNo);
 
 	/**
-	 * Allocate a free frame.  
+	 * Whether an eviction handler is set for file.
+	 */
+  bool hasEvictionHandler(const File* file) const;
+
+	/**
+	 * Allocate a free frame. The frame comes back invalid and pinned once, so that no other thread takes it until the
+	 * caller sets it up or gives it back with releaseBuf. The caller must not hold any latch.
 	 *
 	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
+	 * @param quiet		True to pass over frames whose file has an eviction handler, so that no handler is called
 	 * @throws BufferExceededException If no such buffer is found which can be allocated
 	 */
-  void allocBuf(FrameId & frame);
+  void allocBuf(FrameId & frame, const bool quiet = false);
+
+	/**
+	 * Give back a frame from allocBuf that was not used after all.
+	 */
+  void releaseBuf(const FrameId frame);
+
+	/**
+	 * Look up the frame of a page and pin it. The caller holds the table latch of the page.
+	 *
+	 * @param loading  set to whether the page is still being read into the frame, in which case the caller has to
+	 *                 awaitLoad before using it
+	 * @return false if the page is not in the buffer pool
+	 */
+  bool pinResident(File* file, const PageId pageNo, FrameId & frameNo, bool & loading);
+
+	/**
+	 * Enter a frame from allocBuf in the hash table for a page, pinned once and marked loading, so that the page
+	 * can be read into it with no latch held. Threads that look the page up meanwhile wait for loadFrame.
+	 *
+	 * @return false if another thread put the page in the pool first, in which case the frame is given back
+	 */
+  bool reserveLoad(File* file, const PageId pageNo, const FrameId frameNo);
+
+	/**
+	 * Read a page into the frame reserveLoad entered it in, then wake the threads waiting for it. If the read fails,
+	 * the page leaves the hash table again and the exception is passed on.
+	 */
+  void loadFrame(File* file, const PageId pageNo, const FrameId frameNo);
+
+	/**
+	 * Wait for the read of the page a pinned frame is loading. If the read failed, the pin is given back.
+	 *
+	 * @return false if the read failed, so that the page has to be looked up again
+	 */
+  bool awaitLoad(const FrameId frameNo);
+
+	/**
+   * Latch of the buckets of hashTable the entry of a page goes in
+	 */
+  std::mutex & tableLatch(const File* file, const PageId pageNo)
+  {
+		return tableLatches[(std::uint32_t) hashTable->bucketOf(file, pageNo) % TABLE_STRIPES];
+  }
 
 	/**
    * Advance clock to next frame in the buffer pool
+	 *
+	 * @return the frame the clock moved to
 	 */
-  void advanceClock()
+  FrameId advanceClock()
   {
-		clockHand = (clockHand + 1) % numBufs;
+		return clockHand++ % numBufs;
   }
 
 
@@ -271,6 +444,60 @@ class BufMgr
   void disposePage(File* file, const PageId PageNo);
 
 	/**
+	 * Ask for a page to be read into the buffer pool in the background, so that a readPage of it soon after finds it
+	 * there instead of waiting for the disk. The page is left unpinned and may be evicted again before it is used.
+	 * A thread started on the first request reads the pages in the order asked for, and never evicts a page whose
+	 * file has an eviction handler. Requests still queued when readPage gets to the page first, or when its file is
+	 * flushed, are dropped. A readPage of a page whose read has started waits for that read instead.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file
+	 * @return false if a quarter of the pool is already asked for and the request is refused, true otherwise
+	 */
+  bool prefetchPage(File* file, const PageId PageNo);
+
+	/**
+	 * Pin the page held by a frame, without looking the page up in the hash table. The caller has to know that the
+	 * frame still holds the page it wants, for instance from an eviction handler.
+	 *
+	 * @param frameNo  Frame number, as returned by frameOf
+	 * @return the page held by the frame
+	 */
+  Page* pinFrame(const FrameId frameNo)
+  {
+		std::lock_guard<std::mutex> guard(bufDescTable[frameNo].latch);
+		bufDescTable[frameNo].refbit = true;
+		bufDescTable[frameNo].pinCnt++;
+		return &bufPool[frameNo];
+  }
+
+	/**
+	 * Unpin the page held by a frame, without looking the page up in the hash table.
+	 *
+	 * @param frameNo  Frame number, as returned by frameOf
+	 * @param dirty		True if the page to be unpinned needs to be marked dirty
+   * @throws  PageNotPinnedException If the page is not already pinned
+	 */
+  void unPinFrame(const FrameId frameNo, const bool dirty);
+
+	/**
+	 * Frame number of a page returned by readPage or allocPage.
+	 */
+  FrameId frameOf(const Page* page) const
+  {
+		return (FrameId) (page - bufPool);
+  }
+
+	/**
+	 * Have handler called with the page number whenever a page of file leaves the buffer pool: when its frame is
+	 * given to another page, and when the page is flushed or disposed of. Replaces any handler the file had.
+	 *
+	 * @param file   	File object
+	 * @param handler	Function to call, or an empty function to stop calling the one the file had
+	 */
+  void setEvictionHandler(const File* file, const std::function<void (const PageId)> & handler);
+
+	/**
    * Print member variable values. 
 	 */
   void  printSelf();
@@ -278,9 +505,13 @@ class BufMgr
 	/**
    * Get buffer pool usage statistics
 	 */
-  BufStats & getBufStats()
+  BufStats getBufStats()
   {
-		return bufStats;
+		BufStats stats;
+		stats.accesses = accessCount;
+		stats.diskreads = diskReadCount;
+		stats.diskwrites = diskWriteCount;
+		return stats;
   }
 
 	/**
@@ -288,7 +519,9 @@ class BufMgr
 	 */
   void clearBufStats() 
   {
-		bufStats.clear();
+		accessCount = 0;
+		diskReadCount = 0;
+		diskWriteCount = 0;
   }
 };
 
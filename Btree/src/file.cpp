@@ -25,6 +25,7 @@ namespace badgerdb {
 
 File::StreamMap File::open_streams_;
 File::CountMap File::open_counts_;
+File::LatchMap File::open_latches_;
 
 void File::remove(const std::string& filename) {
   if (!exists(filename)) {
@@ -79,6 +80,7 @@ void File::openIfNeeded(const bool create_new) {
   if (open_counts_.find(filename_) != open_counts_.end()) {	//exists an entry already
     ++open_counts_[filename_];
     stream_ = open_streams_[filename_];
+    latch_ = open_latches_[filename_];
   } else {
     std::ios_base::openmode mode =
         std::fstream::in | std::fstream::out | std::fstream::binary;
@@ -97,7 +99,9 @@ void File::openIfNeeded(const bool create_new) {
       }
     }
     stream_.reset(new std::fstream(filename_, mode));
+    latch_.reset(new std::recursive_mutex());
     open_streams_[filename_] = stream_;
+    open_latches_[filename_] = latch_;
     open_counts_[filename_] = 1;
   }
 }
@@ -107,15 +111,18 @@ void File::close() {
   	--open_counts_[filename_];
 
   stream_.reset();
+  latch_.reset();
 	assert(open_counts_[filename_] >= 0);
 
   if (open_counts_[filename_] == 0) {
     open_streams_.erase(filename_);
+    open_latches_.erase(filename_);
     open_counts_.erase(filename_);
   }
 }
 
 FileHeader File::readHeader() const {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
   FileHeader header;
   stream_->seekg(0 /* pos */, std::ios::beg);
   stream_->read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
@@ -123,8 +130,13 @@ FileHeader File::readHeader() const {
 }
 
 void File::writeHeader(const FileHeader& header) {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
   stream_->seekp(0 /* pos */, std::ios::beg);
   stream_->write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
+}
+
+void File::flush() const {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
   stream_->flush();
 }
 
@@ -163,6 +175,7 @@ PageFile& PageFile::operator=(const PageFile& rhs) {
 }
 
 Page PageFile::allocatePage(PageId &new_page_number) {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
   FileHeader header = readHeader();
   Page new_page;
   Page existing_page;
@@ -236,6 +249,7 @@ Page PageFile::allocatePage(PageId &new_page_number) {
 }
 
 Page PageFile::readPage(const PageId page_number) const {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
   FileHeader header = readHeader();
 
 	if (page_number >= header.num_pages)
@@ -246,6 +260,7 @@ Page PageFile::readPage(const PageId page_number) const {
 }
 
 Page PageFile::readPage(const PageId page_number, const bool allow_free) const {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
   Page page;
   stream_->seekg(pagePosition(page_number), std::ios::beg);
   stream_->read(reinterpret_cast<char*>(&page.header_), sizeof(PageHeader));
@@ -258,6 +273,7 @@ Page PageFile::readPage(const PageId page_number, const bool allow_free) const {
 }
 
 void PageFile::writePage(const PageId new_page_number, const Page& new_page) {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
 	PageHeader header = readPageHeader(new_page_number);
 	if (header.current_page_number == Page::INVALID_NUMBER)
 	{
@@ -274,6 +290,7 @@ void PageFile::writePage(const PageId new_page_number, const Page& new_page) {
 }
 
 void PageFile::deletePage(const PageId page_number) {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
   FileHeader header = readHeader();
 
   Page existing_page = readPage(page_number);
@@ -315,14 +332,15 @@ FileIterator PageFile::end() {
 
 void PageFile::writePage(const PageId page_number, const PageHeader& header,
                      const Page& new_page) {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
   stream_->seekp(pagePosition(page_number), std::ios::beg);
   stream_->write(reinterpret_cast<const char*>(&header), sizeof(PageHeader));
   stream_->write(reinterpret_cast<const char*>(&new_page.data_[0]),
                  Page::DATA_SIZE);
-  stream_->flush();
 }
 
 PageHeader PageFile::readPageHeader(PageId page_number) const {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
   PageHeader header;
   stream_->seekg(pagePosition(page_number), std::ios::beg);
   stream_->read(reinterpret_cast<char*>(&header), sizeof(PageHeader));
@@ -362,16 +380,24 @@ BlobFile& BlobFile::operator=(const BlobFile& rhs) {
 }
 
 Page BlobFile::allocatePage(PageId &new_page_number) {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
   FileHeader header = readHeader();
 	Page new_page;
 
-	new_page_number = header.num_pages;
+	if (header.num_free_pages > 0) {
+		// Reuse the page at the head of the free list.
+		new_page_number = header.first_free_page;
+		header.first_free_page = readPage(new_page_number).next_page_number();
+		--header.num_free_pages;
+	} else {
+		new_page_number = header.num_pages;
 
-	if (header.first_used_page == Page::INVALID_NUMBER) {
-		header.first_used_page = header.num_pages;
-	}
+		if (header.first_used_page == Page::INVALID_NUMBER) {
+			header.first_used_page = header.num_pages;
+		}
 
-	++header.num_pages;
+		++header.num_pages;
+	}
 
 	writePage(new_page_number, new_page);
 	writeHeader(header);
@@ -380,6 +406,7 @@ Page BlobFile::allocatePage(PageId &new_page_number) {
 }
 
 Page BlobFile::readPage(const PageId page_number) const {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
 	Page page;
 	stream_->seekg(pagePosition(page_number), std::ios::beg);
 	stream_->read(reinterpret_cast<char*>(&page), Page::SIZE);
@@ -387,14 +414,29 @@ Page BlobFile::readPage(const PageId page_number) const {
 }
 
 void BlobFile::writePage(const PageId new_page_number, const Page& new_page) {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
 	stream_->seekp(pagePosition(new_page_number), std::ios::beg);
 	stream_->write(reinterpret_cast<const char*>(&new_page), Page::SIZE);
-	stream_->flush();
 }
 
-//delePage should not be called for a blob_file, not supported
+// A blob page has no header of its own, so a deleted page is overwritten with
+// an empty page whose header links it into the free list.
 void BlobFile::deletePage(const PageId page_number) {
-	throw InvalidPageException(page_number, filename_);
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  FileHeader header = readHeader();
+
+	if (page_number >= header.num_pages || page_number == Page::INVALID_NUMBER)
+	{
+		throw InvalidPageException(page_number, filename_);
+	}
+
+	Page freed_page;
+	freed_page.set_next_page_number(header.first_free_page);
+	header.first_free_page = page_number;
+	++header.num_free_pages;
+
+	writePage(page_number, freed_page);
+	writeHeader(header);
 }
 
 }
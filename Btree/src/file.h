@@ -11,6 +11,7 @@
 #include <string>
 #include <map>
 #include <memory>
+#include <mutex>
 
 #include "page.h"
 
@@ -150,6 +151,13 @@ class File {
    */
   virtual void deletePage(const PageId page_number) = 0;
 
+  /**
+   * Hands whatever the stream of the file still buffers over to the
+   * filesystem. Pages and headers are written without flushing the stream,
+   * so that a run of writes costs one flush instead of one each.
+   */
+  void flush() const;
+
   /**
    * Returns the name of the file this object represents.
    *
@@ -212,6 +220,7 @@ class File {
 
   typedef std::map<std::string, std::shared_ptr<std::fstream> > StreamMap;
   typedef std::map<std::string, int> CountMap;
+  typedef std::map<std::string, std::shared_ptr<std::recursive_mutex> > LatchMap;
 
   /**
    * Streams for opened files.
@@ -223,6 +232,11 @@ class File {
    */
   static CountMap open_counts_;
 
+  /**
+   * Latches for opened files.
+   */
+  static LatchMap open_latches_;
+
   /**
    * Name of the file this object represents.
    */
@@ -233,6 +247,13 @@ class File {
    */
   std::shared_ptr<std::fstream> stream_;
 
+  /**
+   * Held while <stream_> is used, so that threads sharing the buffer pool can
+   * read and write pages of the same file. Shared by every File object of the
+   * file, like the stream.
+   */
+  std::shared_ptr<std::recursive_mutex> latch_;
+
   friend class FileIterator;
 };
 
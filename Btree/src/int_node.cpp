@@ -0,0 +1,236 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "btree.h"
+
+namespace badgerdb
+{
+
+// -----------------------------------------------------------------------------
+// widthOf:
+// number of bits needed to store every offset up to range
+// -----------------------------------------------------------------------------
+static inline int widthOf(const std::uint32_t range)
+{
+	int width = 0;
+	while (width < 32 && (range >> width) != 0) {
+		width++;
+	}
+	return width;
+}
+
+static inline std::uint32_t offsetOf(const int key, const int base)
+{
+	return (std::uint32_t) key - (std::uint32_t) base;
+}
+
+/**
+ * Once the binary search over the packed offsets is down to this many entries, they are unpacked and searched with the
+ * lowerBound kernel of key_search.h.
+ */
+static const int UNPACKEDBLOCKSIZE = 16;
+
+// -----------------------------------------------------------------------------
+// LeafNode<int>
+// -----------------------------------------------------------------------------
+
+void LeafNode<int>::format(const int bytes)
+{
+	header.keyCount = 0;
+	includedBytes = bytes;
+	bitWidth = 0;
+	base = 0;
+	capacity = intLeafCapacity(bitWidth, includedBytes);
+}
+
+std::uint32_t LeafNode<int>::offsetAt(const int i) const
+{
+	//the slack after the packed offsets lets every one of them be read with a single 8 byte load
+	std::uint64_t bit = (std::uint64_t) i * bitWidth;
+	std::uint64_t word;
+	memcpy(&word, data + (bit >> 3), sizeof(word));
+	return (std::uint32_t) ((word >> (bit & 7)) & ((1ULL << bitWidth) - 1));
+}
+
+void LeafNode<int>::setOffsetAt(const int i, const std::uint32_t offset)
+{
+	std::uint64_t bit = (std::uint64_t) i * bitWidth;
+	std::uint64_t mask = ((1ULL << bitWidth) - 1) << (bit & 7);
+	std::uint64_t word;
+	memcpy(&word, data + (bit >> 3), sizeof(word));
+	word = (word & ~mask) | (((std::uint64_t) offset << (bit & 7)) & mask);
+	memcpy(data + (bit >> 3), &word, sizeof(word));
+}
+
+int LeafNode<int>::lowerBound(const int &key) const
+{
+	int count = header.keyCount;
+	if (count == 0 || key <= base) {
+		return 0;
+	}
+	std::uint32_t target = offsetOf(key, base);
+	if (bitWidth < 32 && target > (1ULL << bitWidth) - 1) {
+		return count;
+	}
+	//The offsets compare like the keys, so the search runs on them until a block is left to unpack
+	int low = 0;
+	int high = count;
+	while (high - low > UNPACKEDBLOCKSIZE) {
+		int middle = (low + high) / 2;
+		if (offsetAt(middle) < target) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	int block[UNPACKEDBLOCKSIZE];
+	for (int i = low; i < high; i++) {
+		block[i - low] = keyAt(i);
+	}
+	return low + badgerdb::lowerBound(block, high - low, key);
+}
+
+int LeafNode<int>::upperBound(const int &key) const
+{
+	return key == INT_MAX ? header.keyCount : lowerBound(key + 1);
+}
+
+int LeafNode<int>::keyAt(const int i) const
+{
+	return (int) ((std::uint32_t) base + offsetAt(i));
+}
+
+RecordId LeafNode<int>::ridAt(const int i) const
+{
+	RecordId rid;
+	rid.page_number = pageArray()[i];
+	rid.slot_number = slotArray()[i];
+	return rid;
+}
+
+void LeafNode<int>::setRidAt(const int i, const RecordId rid)
+{
+	pageArray()[i] = rid.page_number;
+	slotArray()[i] = rid.slot_number;
+}
+
+const char *LeafNode<int>::includedAt(const int i) const
+{
+	return includedArray() + i * includedBytes;
+}
+
+void LeafNode<int>::setIncludedAt(const int i, const char *included)
+{
+	std::copy_n(included, includedBytes, includedArray() + i * includedBytes);
+}
+
+bool LeafNode<int>::insertAt(const int i, const int &key, const RecordId rid, const char *included)
+{
+	return insertWithin(i, key, rid, included, 1.0);
+}
+
+bool LeafNode<int>::append(const int &key, const RecordId rid, const char *included, const double fillFactor)
+{
+	return insertWithin(header.keyCount, key, rid, included, fillFactor);
+}
+
+bool LeafNode<int>::insertWithin(const int i, const int key, const RecordId rid, const char *included, const double fillFactor)
+{
+	//The room of the leaf depends on the width the keys need once the new one is in
+	int count = header.keyCount;
+	int low = (count == 0) ? key : std::min(keyAt(0), key);
+	int high = (count == 0) ? key : std::max(keyAt(count - 1), key);
+	int width = widthOf(offsetOf(high, low));
+	int room = intLeafCapacity(width, includedBytes);
+	//a leaf always takes its first entry, whatever the fill factor
+	int fill = std::max(1, std::min(room, (int) (room * fillFactor)));
+	if (count >= fill) {
+		return false;
+	}
+
+	if (count == 0 || low != base || width != bitWidth) {
+		//Case: the keys are packed again from a new base or at a new width
+		std::vector<int> keys(count + 1);
+		std::vector<RecordId> rids(count + 1);
+		std::vector<char> columns((count + 1) * includedBytes);
+		for (int j = 0, k = 0; j <= count; j++) {
+			if (j == i) {
+				keys[j] = key;
+				rids[j] = rid;
+				std::copy_n(included, includedBytes, columns.begin() + j * includedBytes);
+			} else {
+				keys[j] = keyAt(k);
+				rids[j] = ridAt(k);
+				std::copy_n(includedAt(k), includedBytes, columns.begin() + j * includedBytes);
+				k++;
+			}
+		}
+		load(keys.data(), rids.data(), columns.data(), count + 1);
+		return true;
+	}
+
+	//Case: the entries after i move up by one in every column
+	for (int j = count - 1; j >= i; j--) {
+		setOffsetAt(j + 1, offsetAt(j));
+	}
+	PageId *pages = pageArray();
+	SlotId *slots = slotArray();
+	char *columns = includedArray();
+	std::copy_backward(pages + i, pages + count, pages + count + 1);
+	std::copy_backward(slots + i, slots + count, slots + count + 1);
+	std::copy_backward(columns + i * includedBytes, columns + count * includedBytes, columns + (count + 1) * includedBytes);
+	setOffsetAt(i, offsetOf(key, base));
+	setRidAt(i, rid);
+	setIncludedAt(i, included);
+	header.keyCount++;
+	return true;
+}
+
+void LeafNode<int>::removeAt(const int i)
+{
+	//the base and width stay, the next insert packs the keys tighter if it can
+	int count = header.keyCount;
+	for (int j = i; j < count - 1; j++) {
+		setOffsetAt(j, offsetAt(j + 1));
+	}
+	PageId *pages = pageArray();
+	SlotId *slots = slotArray();
+	char *columns = includedArray();
+	std::copy(pages + i + 1, pages + count, pages + i);
+	std::copy(slots + i + 1, slots + count, slots + i);
+	std::copy(columns + (i + 1) * includedBytes, columns + count * includedBytes, columns + i * includedBytes);
+	header.keyCount--;
+}
+
+double LeafNode<int>::occupancy() const
+{
+	return (double) header.keyCount / capacity;
+}
+
+bool LeafNode<int>::fits(const int *keys, const int count) const
+{
+	//the keys are sorted, so the first and last give the width every offset needs
+	if (count == 0) {
+		return true;
+	}
+	return count <= intLeafCapacity(widthOf(offsetOf(keys[count - 1], keys[0])), includedBytes);
+}
+
+void LeafNode<int>::load(const int *keys, const RecordId *rids, const char *included, const int count)
+{
+	base = (count > 0) ? keys[0] : 0;
+	bitWidth = (count > 0) ? widthOf(offsetOf(keys[count - 1], keys[0])) : 0;
+	capacity = intLeafCapacity(bitWidth, includedBytes);
+	for (int i = 0; i < count; i++) {
+		setOffsetAt(i, offsetOf(keys[i], base));
+		setRidAt(i, rids[i]);
+	}
+	std::copy_n(included, count * includedBytes, includedArray());
+	header.keyCount = count;
+}
+
+}
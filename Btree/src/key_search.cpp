@@ -0,0 +1,115 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "key_search.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KEY_SEARCH_X86
+#endif
+
+namespace badgerdb
+{
+
+// -----------------------------------------------------------------------------
+// narrowBlock:
+// Halves [base, base + n) until at most blockSize keys are left. The answer
+// always stays inside [base, base + n], and the select compiles to a cmov.
+// -----------------------------------------------------------------------------
+static inline const int *narrowBlock(const int *base, int &n, const int key, const int blockSize)
+{
+	while (n > blockSize) {
+		int half = n / 2;
+		base = (base[half] < key) ? base + half : base;
+		n -= half;
+	}
+	return base;
+}
+
+int lowerBoundScalar(const int *keys, const int n, const int key)
+{
+	if (n == 0) {
+		return 0;
+	}
+	int size = n;
+	const int *base = narrowBlock(keys, size, key, 1);
+	return (base - keys) + (*base < key);
+}
+
+#ifdef KEY_SEARCH_X86
+
+__attribute__((target("sse4.1")))
+int lowerBoundSSE4(const int *keys, const int n, const int key)
+{
+	int size = n;
+	const int *base = narrowBlock(keys, size, key, 8);
+	const __m128i needle = _mm_set1_epi32(key);
+	int count = 0;
+	int i = 0;
+	for (; i + 4 <= size; i += 4) {
+		//lanes holding a key smaller than the needle come back all ones
+		__m128i block = _mm_loadu_si128((const __m128i *) (base + i));
+		__m128i less = _mm_cmpgt_epi32(needle, block);
+		count += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(less)));
+	}
+	for (; i < size; i++) {
+		count += (base[i] < key);
+	}
+	return (base - keys) + count;
+}
+
+__attribute__((target("avx2")))
+int lowerBoundAVX2(const int *keys, const int n, const int key)
+{
+	int size = n;
+	const int *base = narrowBlock(keys, size, key, 16);
+	const __m256i needle = _mm256_set1_epi32(key);
+	int count = 0;
+	int i = 0;
+	for (; i + 8 <= size; i += 8) {
+		__m256i block = _mm256_loadu_si256((const __m256i *) (base + i));
+		__m256i less = _mm256_cmpgt_epi32(needle, block);
+		count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(less)));
+	}
+	for (; i < size; i++) {
+		count += (base[i] < key);
+	}
+	return (base - keys) + count;
+}
+
+LowerBoundFunc lowerBoundKernel()
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return lowerBoundAVX2;
+	}
+	if (__builtin_cpu_supports("sse4.1")) {
+		return lowerBoundSSE4;
+	}
+	return lowerBoundScalar;
+}
+
+#else
+
+int lowerBoundSSE4(const int *keys, const int n, const int key)
+{
+	return lowerBoundScalar(keys, n, key);
+}
+
+int lowerBoundAVX2(const int *keys, const int n, const int key)
+{
+	return lowerBoundScalar(keys, n, key);
+}
+
+LowerBoundFunc lowerBoundKernel()
+{
+	return lowerBoundScalar;
+}
+
+#endif
+
+}
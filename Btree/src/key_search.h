@@ -0,0 +1,99 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <climits>
+
+namespace badgerdb
+{
+
+/**
+ * @brief Search kernel over the sorted key array of a B+ tree node.
+ * Returns the index of the first of the n keys that is not less than key, or n if there is none.
+ */
+typedef int (*LowerBoundFunc)(const int *keys, const int n, const int key);
+
+/**
+ * @brief Branch-free binary search. Works on every cpu.
+ */
+int lowerBoundScalar(const int *keys, const int n, const int key);
+
+/**
+ * @brief Binary search down to a small block, which is then finished with 4-wide SSE4.1 compares.
+ * Must only be called if the cpu supports SSE4.1.
+ */
+int lowerBoundSSE4(const int *keys, const int n, const int key);
+
+/**
+ * @brief Binary search down to a small block, which is then finished with 8-wide AVX2 compares.
+ * Must only be called if the cpu supports AVX2.
+ */
+int lowerBoundAVX2(const int *keys, const int n, const int key);
+
+/**
+ * @brief Kernel picked once for the cpu the program runs on: AVX2, then SSE4.1, then scalar.
+ */
+LowerBoundFunc lowerBoundKernel();
+
+/**
+ * @brief Index of the first of the n sorted keys that is not less than key.
+ */
+inline int lowerBound(const int *keys, const int n, const int key)
+{
+	static const LowerBoundFunc kernel = lowerBoundKernel();
+	return kernel(keys, n, key);
+}
+
+/**
+ * @brief Index of the first of the n sorted keys that is greater than key.
+ */
+inline int upperBound(const int *keys, const int n, const int key)
+{
+	return key == INT_MAX ? n : lowerBound(keys, n, key + 1);
+}
+
+/**
+ * @brief Branch-free binary search over sorted keys of any type ordered by operator<.
+ * The int overloads above are preferred for INTEGER keys, so only other key types land here.
+ */
+template <class T>
+inline int lowerBound(const T *keys, const int n, const T &key)
+{
+	if (n == 0) {
+		return 0;
+	}
+	const T *base = keys;
+	int size = n;
+	while (size > 1) {
+		int half = size / 2;
+		base = (base[half] < key) ? base + half : base;
+		size -= half;
+	}
+	return (base - keys) + (*base < key);
+}
+
+/**
+ * @brief Index of the first of the n sorted keys that is greater than key, for keys of any type.
+ */
+template <class T>
+inline int upperBound(const T *keys, const int n, const T &key)
+{
+	if (n == 0) {
+		return 0;
+	}
+	const T *base = keys;
+	int size = n;
+	while (size > 1) {
+		int half = size / 2;
+		base = (key < base[half]) ? base : base + half;
+		size -= half;
+	}
+	return (base - keys) + !(key < *base);
+}
+
+}
@@ -6,6 +6,11 @@
  */
 
 #include <vector>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <numeric>
 #include "btree.h"
 #include "page.h"
 #include "filescan.h"
@@ -19,6 +24,9 @@
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/bad_index_info_exception.h"
+#include "exceptions/invalid_page_exception.h"
+#include "exceptions/page_pinned_exception.h"
 
 #define checkPassFail(a, b) 																				\
 {																																		\
@@ -69,10 +77,45 @@ void createRelationBackward();
 void createRelationRandom();
 void intTests();
 int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp);
+void doubleTests();
+int doubleScan(BTreeIndex *index, double lowVal, Operator lowOp, double highVal, Operator highOp);
+void stringTests();
+int stringScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp);
+int scanCount(BTreeIndex *index, const void *lowVal, Operator lowOp, const void *highVal, Operator highOp);
+int batchScanCount(BTreeIndex *index, const void *lowVal, Operator lowOp, const void *highVal, Operator highOp, size_t batchSize);
+int reverseScanCount(BTreeIndex *index, const void *lowVal, Operator lowOp, const void *highVal, Operator highOp, size_t batchSize);
+int coveredScanCount(BTreeIndex *index, const void *lowVal, Operator lowOp, const void *highVal, Operator highOp, size_t batchSize,
+		size_t includedBytes, const std::function<bool (const char *)> &valid);
 void indexTests();
 void test1();
 void test2();
 void test3();
+void test4();
+void test5();
+void test6();
+void test7();
+void test8();
+void test9();
+void test10();
+void test11();
+void test12();
+void test13();
+void test14();
+void test15();
+void test16();
+void test17();
+void test18();
+void test19();
+void test20();
+void test21();
+void test22();
+void test23();
+void test24();
+void test25();
+int deleteEntries(BTreeIndex *index, int keyOffset, const std::function<bool (int)> &doomed);
+void insertEntries(BTreeIndex *index, int keyOffset);
+void insertBatchEntries(BTreeIndex *index, int keyOffset, Datatype keyType);
+int lookupMatches(BTreeIndex *index, int keyOffset);
 void errorTests();
 void deleteRelation();
 
@@ -140,6 +183,28 @@ int main(int argc, char **argv)
 	// test1();
 	// test2();
 	test3();
+	test4();
+	test5();
+	test6();
+	test7();
+	test8();
+	test9();
+	test10();
+	test11();
+	test12();
+	test13();
+	test14();
+	test15();
+	test16();
+	test17();
+	test18();
+	test19();
+	test20();
+	test21();
+	test22();
+	test23();
+	test24();
+	test25();
 	//errorTests();
 
   return 1;
@@ -178,6 +243,1507 @@ void test3()
 	deleteRelation();
 }
 
+void test4()
+{
+	// Create a relation with tuples valued 0 to relationSize in random order and bulk load
+	// the integer index through several spilled runs with half full nodes
+	std::cout << "--------------------" << std::endl;
+	std::cout << "bulkLoadSpilledRuns" << std::endl;
+	createRelationRandom();
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, 0.5, relationSize / 4);
+
+		checkPassFail(intScan(&index,25,GT,40,LT), 14)
+		checkPassFail(intScan(&index,-3,GT,3,LT), 3)
+		checkPassFail(intScan(&index,3000,GTE,4000,LT), 1000)
+		checkPassFail(intScan(&index,0,GTE,relationSize,LT), relationSize)
+	}
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+}
+
+void test5()
+{
+	// Bulk load the integer index over a relation in random order, then insert two more copies of every
+	// tuple under key + relationSize and key - relationSize so that leaves split, the tree grows through
+	// insertEntry and negative keys are mixed in
+	std::cout << "--------------------" << std::endl;
+	std::cout << "insertEntry" << std::endl;
+	createRelationRandom();
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+
+		FileScan fscan(relationName, bufMgr);
+		try
+		{
+			RecordId scanRid;
+			while(1)
+			{
+				fscan.scanNext(scanRid);
+				std::string recordStr = fscan.getRecord();
+				int key = *((int *)(recordStr.c_str() + offsetof (RECORD, i))) + relationSize;
+				index.insertEntry(&key, scanRid);
+				key -= 2 * relationSize;
+				index.insertEntry(&key, scanRid);
+			}
+		}
+		catch(EndOfFileException e)
+		{
+		}
+
+		checkPassFail(intScan(&index,25,GT,40,LT), 14)
+		checkPassFail(intScan(&index,relationSize + 25,GT,relationSize + 40,LT), 14)
+		checkPassFail(intScan(&index,relationSize - 10,GTE,relationSize + 10,LT), 20)
+		checkPassFail(intScan(&index,-relationSize,GTE,0,LT), relationSize)
+		checkPassFail(intScan(&index,-3,GT,3,LT), 5)
+		checkPassFail(intScan(&index,-relationSize,GTE,2 * relationSize,LT), 3 * relationSize)
+	}
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+}
+
+void test6()
+{
+	// Bulk load the string index, then insert keys of other lengths and prefixes: the decimal value
+	// alone, which changes the prefix leaves share, and the record string with more text after it
+	std::cout << "--------------------" << std::endl;
+	std::cout << "stringInsertEntry" << std::endl;
+	createRelationRandom();
+	{
+		BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple,s), STRING);
+
+		FileScan fscan(relationName, bufMgr);
+		try
+		{
+			RecordId scanRid;
+			while(1)
+			{
+				fscan.scanNext(scanRid);
+				std::string recordStr = fscan.getRecord();
+				int value = *((int *)(recordStr.c_str() + offsetof (RECORD, i)));
+				char key[STRINGSIZE];
+				sprintf(key, "%d", value);
+				index.insertEntry(key, scanRid);
+				sprintf(key, "%05d string record and more", value);
+				index.insertEntry(key, scanRid);
+			}
+		}
+		catch(EndOfFileException e)
+		{
+		}
+
+		// 26..39 as they are, and 25..39 with more text
+		checkPassFail(stringScan(&index,25,GT,40,LT), 29)
+		// "1", "10".."19", "100".."199" and "1000".."1999"
+		checkPassFail(scanCount(&index,"1",GTE,"2",LT), 1111)
+		checkPassFail(scanCount(&index,"",GTE,"99999",LTE), 3 * relationSize)
+	}
+	try
+	{
+		File::remove(stringIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+}
+
+void test7()
+{
+	// Delete two thirds of the entries of the integer and string indexes, then all but a few so that leaves
+	// merge and the root shrinks back to a leaf. Reopen the index and insert every tuple again.
+	std::cout << "--------------------" << std::endl;
+	std::cout << "deleteEntry" << std::endl;
+	createRelationRandom();
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+
+		checkPassFail(deleteEntries(&index, offsetof(tuple,i), [](int value) { return value % 3 != 0; }), 3333)
+		// 27, 30, 33, 36 and 39
+		checkPassFail(intScan(&index,25,GT,40,LT), 5)
+		checkPassFail(intScan(&index,0,GTE,relationSize,LT), 1667)
+		// entries deleted before are not found again
+		checkPassFail(deleteEntries(&index, offsetof(tuple,i), [](int value) { return value >= 10; }), 1663)
+		checkPassFail(intScan(&index,0,GTE,relationSize,LT), 4)
+	}
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+
+		checkPassFail(intScan(&index,0,GTE,relationSize,LT), 4)
+		insertEntries(&index, offsetof(tuple,i));
+		checkPassFail(intScan(&index,25,GT,40,LT), 14)
+		checkPassFail(intScan(&index,0,GTE,relationSize,LT), relationSize)
+	}
+	{
+		BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple,s), STRING);
+
+		checkPassFail(deleteEntries(&index, offsetof(tuple,s), [](int value) { return value % 3 != 0; }), 3333)
+		checkPassFail(stringScan(&index,25,GT,40,LT), 5)
+		checkPassFail(scanCount(&index,"",GTE,"99999",LTE), 1667)
+		checkPassFail(deleteEntries(&index, offsetof(tuple,s), [](int value) { return value >= 10; }), 1663)
+		checkPassFail(scanCount(&index,"",GTE,"99999",LTE), 4)
+	}
+	{
+		BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple,s), STRING);
+
+		checkPassFail(scanCount(&index,"",GTE,"99999",LTE), 4)
+		insertEntries(&index, offsetof(tuple,s));
+		checkPassFail(stringScan(&index,25,GT,40,LT), 14)
+		checkPassFail(scanCount(&index,"",GTE,"99999",LTE), relationSize)
+	}
+	try
+	{
+		File::remove(intIndexName);
+		File::remove(stringIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+}
+
+void test8()
+{
+	// Index only characters 3 and on of the string field, "XY string record", so that every key is shared by
+	// relationSize / 100 tuples. Then add every tuple to the integer index again under value % 10 + relationSize.
+	std::cout << "--------------------" << std::endl;
+	std::cout << "duplicateKeys" << std::endl;
+	createRelationRandom();
+	std::string suffixIndexName;
+	{
+		BTreeIndex index(relationName, suffixIndexName, bufMgr, offsetof(tuple,s) + 3, STRING);
+
+		checkPassFail(scanCount(&index,"00",GTE,"01",LT), relationSize / 100)
+		// "25 string record" is greater than "25"
+		checkPassFail(scanCount(&index,"25",GT,"40",LT), 15 * relationSize / 100)
+		checkPassFail(scanCount(&index,"",GTE,"99999",LTE), relationSize)
+		checkPassFail(deleteEntries(&index, offsetof(tuple,s) + 3, [](int value) { return value % 2 == 0; }), relationSize / 2)
+		checkPassFail(scanCount(&index,"01",GTE,"02",LT), relationSize / 100)
+		checkPassFail(scanCount(&index,"02",GTE,"03",LT), 0)
+		checkPassFail(scanCount(&index,"",GTE,"99999",LTE), relationSize / 2)
+	}
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+
+		FileScan fscan(relationName, bufMgr);
+		try
+		{
+			RecordId scanRid;
+			while(1)
+			{
+				fscan.scanNext(scanRid);
+				std::string recordStr = fscan.getRecord();
+				int key = *((int *)(recordStr.c_str() + offsetof (RECORD, i))) % 10 + relationSize;
+				index.insertEntry(&key, scanRid);
+			}
+		}
+		catch(EndOfFileException e)
+		{
+		}
+
+		checkPassFail(intScan(&index,relationSize + 3,GTE,relationSize + 3,LTE), relationSize / 10)
+		checkPassFail(intScan(&index,relationSize - 2,GT,relationSize + 2,LT), 1 + 2 * relationSize / 10)
+		checkPassFail(intScan(&index,0,GTE,2 * relationSize,LT), 2 * relationSize)
+	}
+	try
+	{
+		File::remove(suffixIndexName);
+		File::remove(intIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+}
+
+void test9()
+{
+	// Run three cursors over the integer index in lock step, with scans through the index itself in between,
+	// and drop a cursor in the middle of its scan
+	std::cout << "--------------------" << std::endl;
+	std::cout << "indexScanCursor" << std::endl;
+	createRelationRandom();
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+
+		int lowVals[3] = {0, 25, 3000};
+		int highVals[3] = {relationSize, 40, 4000};
+		Operator lowOps[3] = {GTE, GT, GTE};
+		IndexScanCursor cursors[3] = {{&index}, {&index}, {&index}};
+		int counts[3] = {0, 0, 0};
+		for (int i = 0; i < 3; i++)
+		{
+			cursors[i].startScan(&lowVals[i], lowOps[i], &highVals[i], LT);
+		}
+		bool scanning = true;
+		while (scanning)
+		{
+			scanning = false;
+			for (int i = 0; i < 3; i++)
+			{
+				if (!cursors[i].isScanning())
+					continue;
+				try
+				{
+					RecordId scanRid;
+					cursors[i].scanNext(scanRid);
+					counts[i]++;
+					scanning = true;
+				}
+				catch(IndexScanCompletedException e)
+				{
+					cursors[i].endScan();
+				}
+			}
+			if (counts[0] == relationSize / 2)
+			{
+				checkPassFail(intScan(&index,300,GT,400,LT), 99)
+			}
+		}
+		checkPassFail(counts[0], relationSize)
+		checkPassFail(counts[1], 14)
+		checkPassFail(counts[2], 1000)
+
+		IndexScanCursor unstarted(&index);
+		int thrown = 0;
+		try
+		{
+			RecordId scanRid;
+			unstarted.scanNext(scanRid);
+		}
+		catch(ScanNotInitializedException e)
+		{
+			thrown++;
+		}
+		checkPassFail(thrown, 1)
+
+		// the cursor lets go of its leaf when it goes out of scope, so the index can still be flushed
+		IndexScanCursor *dropped = new IndexScanCursor(&index);
+		dropped->startScan(&lowVals[0], GTE, &highVals[0], LT);
+		delete dropped;
+	}
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+}
+
+void test10()
+{
+	// Fetch scans in batches, across leaves, posting lists and leaves emptied by deletes, and compare them with
+	// the same scans fetched one record id at a time
+	std::cout << "--------------------" << std::endl;
+	std::cout << "scanNextBatch" << std::endl;
+	createRelationRandom();
+	std::string suffixIndexName;
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+
+		int lowVal = 25, highVal = 40;
+		checkPassFail(batchScanCount(&index, &lowVal, GT, &highVal, LT, 7), 14)
+		checkPassFail(batchScanCount(&index, &lowVal, GTE, &highVal, LTE, 16), 16)
+		lowVal = 0;
+		highVal = 1;
+		checkPassFail(batchScanCount(&index, &lowVal, GT, &highVal, LT, 7), 0)
+		highVal = relationSize;
+		checkPassFail(batchScanCount(&index, &lowVal, GTE, &highVal, LT, 7), relationSize)
+		checkPassFail(batchScanCount(&index, &lowVal, GTE, &highVal, LTE, 1000), relationSize)
+
+		checkPassFail(deleteEntries(&index, offsetof(tuple,i), [](int value) { return value >= 1000 && value < 3000; }), 2000)
+		lowVal = 500;
+		highVal = 3500;
+		checkPassFail(batchScanCount(&index, &lowVal, GTE, &highVal, LT, 64), 1000)
+	}
+	{
+		BTreeIndex index(relationName, suffixIndexName, bufMgr, offsetof(tuple,s) + 3, STRING);
+
+		checkPassFail(batchScanCount(&index, "25", GT, "40", LT, 7), 15 * relationSize / 100)
+		checkPassFail(batchScanCount(&index, "", GTE, "99999", LTE, 333), relationSize)
+	}
+	try
+	{
+		File::remove(intIndexName);
+		File::remove(suffixIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+}
+
+void test11()
+{
+	// Look up every key with and without the lookup cache, across deletes and inserts that have to drop what the
+	// cache remembers, and look up shared keys
+	std::cout << "--------------------" << std::endl;
+	std::cout << "lookup" << std::endl;
+	createRelationRandom();
+	std::string suffixIndexName;
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+
+		checkPassFail(lookupMatches(&index, offsetof(tuple,i)), relationSize)
+		RecordId outRid;
+		int missing[2] = {-1, relationSize};
+		checkPassFail(index.lookup(&missing[0], outRid) + index.lookup(&missing[1], outRid), 0)
+
+		index.setLookupCacheSize(relationSize);
+		checkPassFail(lookupMatches(&index, offsetof(tuple,i)), relationSize)
+		checkPassFail(lookupMatches(&index, offsetof(tuple,i)), relationSize)
+		checkPassFail(deleteEntries(&index, offsetof(tuple,i), [](int value) { return value % 2 == 0; }), relationSize / 2)
+		checkPassFail(lookupMatches(&index, offsetof(tuple,i)), relationSize / 2)
+		insertEntries(&index, offsetof(tuple,i));
+		checkPassFail(lookupMatches(&index, offsetof(tuple,i)), relationSize)
+
+		// a cache smaller than the keys looked up keeps evicting
+		index.setLookupCacheSize(10);
+		checkPassFail(lookupMatches(&index, offsetof(tuple,i)), relationSize)
+	}
+	{
+		BTreeIndex index(relationName, suffixIndexName, bufMgr, offsetof(tuple,s) + 3, STRING);
+
+		// a shared key gives the record id a scan returns first
+		RecordId outRid, scanRid;
+		index.startScan("25 string record", GTE, "25 string record", LTE);
+		index.scanNext(scanRid);
+		index.endScan();
+		bool sameRid = index.lookup("25 string record", outRid) && outRid == scanRid;
+		checkPassFail(sameRid, true)
+		checkPassFail(index.lookup("25 string recor", outRid), false)
+	}
+	try
+	{
+		File::remove(intIndexName);
+		File::remove(suffixIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+}
+
+void test12()
+{
+	// Look up all keys and some missing ones in one batch, in scrambled order, and check every answer against lookup
+	std::cout << "--------------------" << std::endl;
+	std::cout << "lookupMany" << std::endl;
+	createRelationRandom();
+	std::string suffixIndexName;
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+
+		// -100 to relationSize + 99, each once
+		const int n = relationSize + 200;
+		std::vector<int> keys(n);
+		for (int i = 0; i < n; i++)
+			keys[i] = (int) ((long long) i * 7919 % n) - 100;
+		std::vector<RecordId> out(n);
+		std::unique_ptr<bool[]> found(new bool[n]);
+		checkPassFail((int) index.lookupMany(keys.data(), n, out.data(), found.get()), relationSize)
+		int agreed = 0;
+		for (int i = 0; i < n; i++)
+		{
+			RecordId outRid;
+			bool expected = index.lookup(&keys[i], outRid);
+			if (expected == found[i] && (!expected || outRid == out[i]))
+				agreed++;
+		}
+		checkPassFail(agreed, n)
+	}
+	{
+		BTreeIndex index(relationName, suffixIndexName, bufMgr, offsetof(tuple,s) + 3, STRING);
+
+		// every shared key twice, and a key that is missing
+		const int n = 201;
+		std::vector<char> keys(n * STRINGSIZE, 0);
+		for (int i = 0; i < n - 1; i++)
+			sprintf(&keys[i * STRINGSIZE], "%02d string record", (i * 37) % 100);
+		sprintf(&keys[(n - 1) * STRINGSIZE], "100 string record");
+		std::vector<RecordId> out(n);
+		std::unique_ptr<bool[]> found(new bool[n]);
+		checkPassFail((int) index.lookupMany(keys.data(), n, out.data(), found.get()), n - 1)
+		int agreed = 0;
+		for (int i = 0; i < n; i++)
+		{
+			RecordId outRid;
+			bool expected = index.lookup(&keys[i * STRINGSIZE], outRid);
+			if (expected == found[i] && (!expected || outRid == out[i]))
+				agreed++;
+		}
+		checkPassFail(agreed, n)
+	}
+	try
+	{
+		File::remove(intIndexName);
+		File::remove(suffixIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+}
+
+void test13()
+{
+	// Keep the inner nodes resident while the root splits, merges away and grows again, then reopen the index
+	// without them
+	std::cout << "--------------------" << std::endl;
+	std::cout << "innerNodesResident" << std::endl;
+	createRelationRandom();
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+
+		index.setInnerNodesResident(true);
+		checkPassFail(intScan(&index,25,GT,40,LT), 14)
+		checkPassFail(lookupMatches(&index, offsetof(tuple,i)), relationSize)
+		checkPassFail(deleteEntries(&index, offsetof(tuple,i), [](int value) { return value >= 10; }), relationSize - 10)
+		checkPassFail(intScan(&index,0,GTE,relationSize,LT), 10)
+		insertEntries(&index, offsetof(tuple,i));
+		checkPassFail(intScan(&index,3000,GTE,4000,LT), 1000)
+		checkPassFail(lookupMatches(&index, offsetof(tuple,i)), relationSize)
+	}
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+
+		checkPassFail(intScan(&index,0,GTE,relationSize,LT), relationSize)
+		index.setInnerNodesResident(true);
+		index.setInnerNodesResident(false);
+		checkPassFail(lookupMatches(&index, offsetof(tuple,i)), relationSize)
+	}
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+}
+
+void test14()
+{
+	// Remember frames while a buffer pool of its own, far smaller than the index, keeps evicting the nodes
+	std::cout << "--------------------" << std::endl;
+	std::cout << "swizzling" << std::endl;
+	createRelationRandom();
+	{
+		BufMgr smallPool(6);
+		BTreeIndex index(relationName, intIndexName, &smallPool, offsetof(tuple,i), INTEGER);
+
+		index.setSwizzling(true);
+		checkPassFail(lookupMatches(&index, offsetof(tuple,i)), relationSize)
+		checkPassFail(intScan(&index,3000,GTE,4000,LT), 1000)
+		checkPassFail(deleteEntries(&index, offsetof(tuple,i), [](int value) { return value % 3 == 0; }), 1667)
+		checkPassFail(intScan(&index,0,GTE,relationSize,LT), relationSize - 1667)
+		insertEntries(&index, offsetof(tuple,i));
+		checkPassFail(lookupMatches(&index, offsetof(tuple,i)), relationSize)
+
+		index.setInnerNodesResident(true);
+		checkPassFail(deleteEntries(&index, offsetof(tuple,i), [](int value) { return value >= 10; }), relationSize - 10)
+		insertEntries(&index, offsetof(tuple,i));
+		checkPassFail(intScan(&index,0,GTE,relationSize,LT), relationSize)
+		index.setSwizzling(false);
+		checkPassFail(lookupMatches(&index, offsetof(tuple,i)), relationSize)
+	}
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+}
+
+void test15()
+{
+	// Insert, look up and delete from several threads at once. Every thread owns its own keys past relationSize,
+	// with made up record ids, while the keys of the relation are looked up throughout.
+	std::cout << "--------------------" << std::endl;
+	std::cout << "concurrent" << std::endl;
+	createRelationRandom();
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		index.setConcurrent(true);
+
+		const int writers = 4;
+		const int perWriter = relationSize;
+		std::atomic<int> missed(0);
+		std::atomic<bool> writing(true);
+		auto writer = [&](const int first, const bool insert)
+		{
+			for (int key = first; key < relationSize + writers * perWriter; key += writers)
+			{
+				RecordId rid;
+				rid.page_number = key;
+				rid.slot_number = 1;
+				if (insert)
+					index.insertEntry(&key, rid);
+				else
+					index.deleteEntry(&key, rid);
+			}
+		};
+		auto reader = [&]()
+		{
+			do
+			{
+				for (int key = 0; key < relationSize; key += 7)
+				{
+					RecordId outRid;
+					if (!index.lookup(&key, outRid))
+						missed++;
+				}
+			} while (writing);
+		};
+
+		std::vector<std::thread> threads;
+		for (int i = 0; i < 2; i++)
+			threads.push_back(std::thread(reader));
+		for (int i = 0; i < writers; i++)
+			threads.push_back(std::thread(writer, relationSize + i, true));
+		for (int i = 2; i < 2 + writers; i++)
+			threads[i].join();
+		int found = 0;
+		for (int key = relationSize; key < relationSize + writers * perWriter; key++)
+		{
+			RecordId outRid;
+			if (index.lookup(&key, outRid) && outRid.page_number == (PageId) key)
+				found++;
+		}
+		checkPassFail(found, writers * perWriter)
+
+		for (int i = 0; i < writers; i++)
+			threads[2 + i] = std::thread(writer, relationSize + i, false);
+		for (int i = 2; i < 2 + writers; i++)
+			threads[i].join();
+		writing = false;
+		threads[0].join();
+		threads[1].join();
+		checkPassFail(missed.load(), 0)
+
+		index.setConcurrent(false);
+		checkPassFail(intScan(&index,0,GTE,2 * relationSize,LT), relationSize)
+		checkPassFail(lookupMatches(&index, offsetof(tuple,i)), relationSize)
+	}
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+}
+
+void test16()
+{
+	// Scan from the high bound down, across posting lists, merged leaves and split ones, and compare the scans
+	// with the same ranges scanned upwards
+	std::cout << "--------------------" << std::endl;
+	std::cout << "startReverseScan" << std::endl;
+	createRelationRandom();
+	std::string suffixIndexName;
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+
+		int lowVal = 25, highVal = 40;
+		checkPassFail(reverseScanCount(&index, &lowVal, GT, &highVal, LT, 7), 14)
+		checkPassFail(reverseScanCount(&index, &lowVal, GTE, &highVal, LTE, 16), 16)
+		lowVal = 0;
+		highVal = 1;
+		checkPassFail(reverseScanCount(&index, &lowVal, GT, &highVal, LT, 7), 0)
+		highVal = relationSize;
+		checkPassFail(reverseScanCount(&index, &lowVal, GTE, &highVal, LT, 1000), relationSize)
+
+		// the top few keys come from the last leaf alone
+		int top[10];
+		RecordId topRids[10];
+		index.startReverseScan(&lowVal, GTE, &highVal, LT);
+		size_t count = index.scanNextBatch(topRids, 10);
+		index.endScan();
+		for (int i = 0; i < 10; i++)
+			top[i] = relationSize - 1 - i;
+		bool topMatches = count == 10;
+		for (int i = 0; i < 10 && topMatches; i++)
+		{
+			RecordId rid;
+			topMatches = index.lookup(&top[i], rid) && rid == topRids[i];
+		}
+		checkPassFail(topMatches, true)
+
+		checkPassFail(deleteEntries(&index, offsetof(tuple,i), [](int value) { return value >= 1000 && value < 3000; }), 2000)
+		lowVal = 500;
+		highVal = 3500;
+		checkPassFail(reverseScanCount(&index, &lowVal, GTE, &highVal, LT, 64), 1000)
+		insertEntries(&index, offsetof(tuple,i));
+		lowVal = 0;
+		highVal = relationSize;
+		checkPassFail(reverseScanCount(&index, &lowVal, GTE, &highVal, LT, 333), relationSize)
+	}
+	{
+		BTreeIndex index(relationName, suffixIndexName, bufMgr, offsetof(tuple,s) + 3, STRING);
+
+		checkPassFail(reverseScanCount(&index, "25", GT, "40", LT, 7), 15 * relationSize / 100)
+		checkPassFail(reverseScanCount(&index, "", GTE, "99999", LTE, 333), relationSize)
+	}
+	try
+	{
+		File::remove(intIndexName);
+		File::remove(suffixIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+}
+
+void test17()
+{
+	// Count ranges and rank keys from the subtree counts, across deletes, inserts and posting lists, and compare them
+	// with scans of the same ranges; the counts are kept in the index file
+	std::cout << "--------------------" << std::endl;
+	std::cout << "countRange and rankOf" << std::endl;
+	createRelationRandom();
+	std::string suffixIndexName;
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		int lowVal = 25, highVal = 40;
+		checkPassFail((int) index.countRange(&lowVal, GT, &highVal, LT), 14)
+		index.setSubtreeCounts(true);
+		checkPassFail((int) index.countRange(&lowVal, GT, &highVal, LT), 14)
+		lowVal = 20;
+		highVal = 35;
+		checkPassFail((int) index.countRange(&lowVal, GTE, &highVal, LTE), 16)
+		lowVal = highVal = 40;
+		checkPassFail((int) index.countRange(&lowVal, GT, &highVal, LT), 0)
+		checkPassFail((int) index.countRange(&lowVal, GTE, &highVal, LTE), 1)
+		lowVal = -3;
+		highVal = relationSize;
+		checkPassFail((int) index.countRange(&lowVal, GTE, &highVal, LT), relationSize)
+		int key = 1234;
+		checkPassFail((int) index.rankOf(&key), 1234)
+
+		checkPassFail(deleteEntries(&index, offsetof(tuple,i), [](int value) { return value % 2 == 0; }), relationSize / 2)
+		checkPassFail((int) index.countRange(&lowVal, GTE, &highVal, LT), relationSize / 2)
+		key = 1001;
+		checkPassFail((int) index.rankOf(&key), 500)
+		insertEntries(&index, offsetof(tuple,i));
+		lowVal = 1000;
+		highVal = 3999;
+		checkPassFail((int) index.countRange(&lowVal, GTE, &highVal, LTE), 3000)
+	}
+	{
+		// opened again, the index still keeps its counts
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		checkPassFail(deleteEntries(&index, offsetof(tuple,i), [](int value) { return value < 1000; }), 1000)
+		int lowVal = 0, highVal = relationSize;
+		checkPassFail((int) index.countRange(&lowVal, GTE, &highVal, LT), relationSize - 1000)
+		int key = 3000;
+		checkPassFail((int) index.rankOf(&key), 2000)
+	}
+	{
+		BTreeIndex index(relationName, suffixIndexName, bufMgr, offsetof(tuple,s) + 3, STRING);
+		index.setSubtreeCounts(true);
+		checkPassFail((int) index.countRange("25", GT, "40", LT), 15 * relationSize / 100)
+		checkPassFail((int) index.rankOf("50"), relationSize / 2)
+		checkPassFail(deleteEntries(&index, offsetof(tuple,s) + 3, [](int value) { return value % 2 == 0; }), relationSize / 2)
+		checkPassFail((int) index.countRange("", GTE, "99999", LTE), relationSize / 2)
+		checkPassFail((int) index.countRange("25", GT, "40", LT), batchScanCount(&index, "25", GT, "40", LT, 100))
+	}
+	try
+	{
+		File::remove(intIndexName);
+		File::remove(suffixIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+}
+
+void test18()
+{
+	// Scan covering indexes, whose leaves and posting lists carry the double field or the integer field of each
+	// record, and check the included values against the scanned range without reading the relation
+	std::cout << "--------------------" << std::endl;
+	std::cout << "Covering index with included columns" << std::endl;
+	createRelationRandom();
+	std::string suffixIndexName;
+	const std::vector<IncludedColumn> includeD = {{(int) offsetof(tuple,d), sizeof(double)}};
+	const std::vector<IncludedColumn> includeI = {{(int) offsetof(tuple,i), sizeof(int)}};
+	{
+		// small runs, so that the included columns also go through the spilled runs of the bulk load
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, BULKLOAD_FILL_FACTOR, relationSize / 3, includeD);
+		int lowVal = 25, highVal = 40;
+		double last = -1;
+		auto ascending = [&](const char *included) {
+			double d = *((const double *) included);
+			bool inOrder = d > last;
+			last = d;
+			return inOrder && d > 25 && d < 40;
+		};
+		checkPassFail(coveredScanCount(&index, &lowVal, GT, &highVal, LT, 4, sizeof(double), ascending), 14)
+		lowVal = 0;
+		highVal = relationSize;
+		auto any = [](const char *included) { double d = *((const double *) included); return d >= 0 && d < relationSize; };
+		checkPassFail(coveredScanCount(&index, &lowVal, GTE, &highVal, LT, 333, sizeof(double), any), relationSize)
+
+		// the values come out in key order, so a descending scan hands them out from the top
+		RecordId topRid;
+		double top;
+		index.startReverseScan(&lowVal, GTE, &highVal, LT);
+		index.scanNext(topRid, &top);
+		index.endScan();
+		checkPassFail(top, relationSize - 1)
+
+		checkPassFail(deleteEntries(&index, offsetof(tuple,i), [](int value) { return value % 2 == 0; }), relationSize / 2)
+		auto odd = [](const char *included) { return ((int) *((const double *) included)) % 2 == 1; };
+		checkPassFail(coveredScanCount(&index, &lowVal, GTE, &highVal, LT, 100, sizeof(double), odd), relationSize / 2)
+		insertEntries(&index, offsetof(tuple,i));
+		checkPassFail(coveredScanCount(&index, &lowVal, GTE, &highVal, LT, 100, sizeof(double), any), relationSize)
+
+		// without the record the included columns of a new entry are not known
+		bool refused = false;
+		try
+		{
+			index.insertEntry(&lowVal, topRid);
+		}
+		catch(BadIndexInfoException e)
+		{
+			refused = true;
+		}
+		checkPassFail(refused, true)
+	}
+	{
+		// the included columns are kept in the index file, and have to match when it is opened again
+		bool refused = false;
+		try
+		{
+			BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		}
+		catch(BadIndexInfoException e)
+		{
+			refused = true;
+		}
+		checkPassFail(refused, true)
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, BULKLOAD_FILL_FACTOR, BULKLOAD_RUN_SIZE, includeD);
+		int lowVal = 3000, highVal = 4000;
+		auto any = [](const char *included) { double d = *((const double *) included); return d >= 3000 && d < 4000; };
+		checkPassFail(coveredScanCount(&index, &lowVal, GTE, &highVal, LT, 64, sizeof(double), any), 1000)
+	}
+	{
+		// every key of the suffix index is shared by relationSize / 100 records, whose values live in posting lists
+		BTreeIndex index(relationName, suffixIndexName, bufMgr, offsetof(tuple,s) + 3, STRING, BULKLOAD_FILL_FACTOR, BULKLOAD_RUN_SIZE, includeI);
+		auto suffixInRange = [](const char *included) { int i = *((const int *) included) % 100; return i >= 25 && i < 40; };
+		checkPassFail(coveredScanCount(&index, "25", GT, "40", LT, 7, sizeof(int), suffixInRange), 15 * relationSize / 100)
+		checkPassFail(deleteEntries(&index, offsetof(tuple,s) + 3, [](int value) { return value % 2 == 0; }), relationSize / 2)
+		auto oddInRange = [&](const char *included) { return suffixInRange(included) && *((const int *) included) % 2 == 1; };
+		checkPassFail(coveredScanCount(&index, "25", GT, "40", LT, 7, sizeof(int), oddInRange), 8 * relationSize / 100)
+		insertEntries(&index, offsetof(tuple,s) + 3);
+		checkPassFail(coveredScanCount(&index, "25", GT, "40", LT, 50, sizeof(int), suffixInRange), 15 * relationSize / 100)
+	}
+	try
+	{
+		File::remove(intIndexName);
+		File::remove(suffixIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+}
+
+void test19()
+{
+	// Fetch the records of index ranges page by page, and check that each page of the relation holding a match is
+	// read from disk once
+	std::cout << "--------------------" << std::endl;
+	std::cout << "fetchRange in page order" << std::endl;
+	createRelationRandom();
+	std::string suffixIndexName;
+	auto inPageOrder = [](const std::vector<RecordId> &rids) {
+		for (size_t i = 1; i < rids.size(); i++) {
+			if (rids[i].page_number < rids[i - 1].page_number
+					|| (rids[i].page_number == rids[i - 1].page_number && rids[i].slot_number <= rids[i - 1].slot_number)) {
+				return false;
+			}
+		}
+		return true;
+	};
+	auto distinctPages = [](const std::vector<RecordId> &rids) {
+		int pages = 0;
+		for (size_t i = 0; i < rids.size(); i++) {
+			pages += (i == 0 || rids[i].page_number != rids[i - 1].page_number);
+		}
+		return pages;
+	};
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		int lowVal = 25, highVal = 40;
+		std::vector<RecordId> rids;
+		std::vector<std::string> records;
+		checkPassFail((int) index.fetchRange(&lowVal, GT, &highVal, LT, rids, records), 14)
+		int inRange = 0;
+		for (const std::string &record : records) {
+			int key = reinterpret_cast<const RECORD *>(record.data())->i;
+			inRange += (key > 25 && key < 40);
+		}
+		checkPassFail(inRange, 14)
+		checkPassFail(inPageOrder(rids), true)
+
+		// the keys are spread over the relation at random, but every page is read once for the whole range; the leaves
+		// are brought into the buffer pool first, so that only the relation is read
+		lowVal = 0;
+		highVal = relationSize;
+		index.countRange(&lowVal, GTE, &highVal, LT);
+		rids.clear();
+		records.clear();
+		bufMgr->clearBufStats();
+		checkPassFail((int) index.fetchRange(&lowVal, GTE, &highVal, LT, rids, records), relationSize)
+		checkPassFail(bufMgr->getBufStats().diskreads, distinctPages(rids))
+		checkPassFail(inPageOrder(rids), true)
+		long sum = 0;
+		for (const std::string &record : records) {
+			sum += reinterpret_cast<const RECORD *>(record.data())->i;
+		}
+		checkPassFail(sum, (long) relationSize * (relationSize - 1) / 2)
+
+		lowVal = highVal = relationSize;
+		checkPassFail((int) index.fetchRange(&lowVal, GTE, &highVal, LTE, rids, records), 0)
+	}
+	{
+		// every key of the suffix index is shared by relationSize / 100 records, kept in posting lists
+		BTreeIndex index(relationName, suffixIndexName, bufMgr, offsetof(tuple,s) + 3, STRING);
+		std::vector<RecordId> rids;
+		std::vector<std::string> records;
+		checkPassFail((int) index.fetchRange("25", GT, "40", LT, rids, records), 15 * relationSize / 100)
+		int inRange = 0;
+		for (const std::string &record : records) {
+			int suffix = reinterpret_cast<const RECORD *>(record.data())->i % 100;
+			inRange += (suffix >= 25 && suffix < 40);
+		}
+		checkPassFail(inRange, 15 * relationSize / 100)
+		checkPassFail(inPageOrder(rids), true)
+	}
+	try
+	{
+		File::remove(intIndexName);
+		File::remove(suffixIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+}
+
+void test20()
+{
+	// Put entries back with insertBatch, one batch for the whole relation, and check scans and counts against what
+	// inserting them one by one gives
+	std::cout << "--------------------" << std::endl;
+	std::cout << "insertBatch" << std::endl;
+	createRelationRandom();
+	std::string suffixIndexName;
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		index.setSubtreeCounts(true);
+		int lowVal = 0, highVal = relationSize;
+		checkPassFail(deleteEntries(&index, offsetof(tuple,i), [](int value) { return value % 2 == 1; }), relationSize / 2)
+		insertBatchEntries(&index, offsetof(tuple,i), INTEGER);
+		checkPassFail(batchScanCount(&index, &lowVal, GTE, &highVal, LT, 100), relationSize)
+		checkPassFail(reverseScanCount(&index, &lowVal, GTE, &highVal, LT, 100), relationSize)
+		checkPassFail(lookupMatches(&index, offsetof(tuple,i)), relationSize)
+		lowVal = 25;
+		highVal = 40;
+		checkPassFail((int) index.countRange(&lowVal, GT, &highVal, LT), 14)
+
+		// a batch of entries already in the index changes nothing, and an emptied tree grows a new root from one batch
+		insertBatchEntries(&index, offsetof(tuple,i), INTEGER);
+		checkPassFail(scanCount(&index, &lowVal, GT, &highVal, LT), 14)
+		checkPassFail(deleteEntries(&index, offsetof(tuple,i), [](int value) { return true; }), relationSize)
+		insertBatchEntries(&index, offsetof(tuple,i), INTEGER);
+		lowVal = 0;
+		highVal = relationSize;
+		checkPassFail((int) index.countRange(&lowVal, GTE, &highVal, LT), relationSize)
+		checkPassFail(batchScanCount(&index, &lowVal, GTE, &highVal, LT, 64), relationSize)
+		checkPassFail(reverseScanCount(&index, &lowVal, GTE, &highVal, LT, 64), relationSize)
+	}
+	{
+		// every key of the suffix index is shared by relationSize / 100 records, so the batch adds to posting lists
+		BTreeIndex index(relationName, suffixIndexName, bufMgr, offsetof(tuple,s) + 3, STRING);
+		checkPassFail(deleteEntries(&index, offsetof(tuple,s) + 3, [](int value) { return value % 3 != 0; }),
+				relationSize - (relationSize + 2) / 3)
+		insertBatchEntries(&index, offsetof(tuple,s) + 3, STRING);
+		checkPassFail(batchScanCount(&index, "25", GT, "40", LT, 7), 15 * relationSize / 100)
+		checkPassFail(batchScanCount(&index, "", GTE, "99999", LTE, 333), relationSize)
+		checkPassFail(reverseScanCount(&index, "", GTE, "99999", LTE, 100), relationSize)
+	}
+	try
+	{
+		File::remove(intIndexName);
+		File::remove(suffixIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+}
+
+void test21()
+{
+	// Insert keys in increasing order into an emptied index, which goes straight to the right-most leaf and splits it
+	// unevenly, and compare the leaves left behind with those of even splits
+	std::cout << "--------------------" << std::endl;
+	std::cout << "Right-most appends" << std::endl;
+	createRelationForward();
+	int lowVal = 0, highVal = relationSize;
+	// the leaves a full scan reads from disk, once the index is opened again
+	auto leafReads = [&]() {
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		bufMgr->clearBufStats();
+		batchScanCount(&index, &lowVal, GTE, &highVal, LT, 100);
+		return bufMgr->getBufStats().diskreads;
+	};
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		index.setSubtreeCounts(true);
+		checkPassFail(deleteEntries(&index, offsetof(tuple,i), [](int value) { return true; }), relationSize)
+		insertEntries(&index, offsetof(tuple,i));
+		checkPassFail((int) index.countRange(&lowVal, GTE, &highVal, LT), relationSize)
+		checkPassFail(reverseScanCount(&index, &lowVal, GTE, &highVal, LT, 100), relationSize)
+		checkPassFail(lookupMatches(&index, offsetof(tuple,i)), relationSize)
+	}
+	int unevenReads = leafReads();
+	checkPassFail((unevenReads <= relationSize / (INTARRAYLEAFSIZE * 8 / 10) + 1), true)
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		checkPassFail(deleteEntries(&index, offsetof(tuple,i), [](int value) { return true; }), relationSize)
+		index.setAppendSplitFraction(0.5);
+		insertEntries(&index, offsetof(tuple,i));
+		checkPassFail(scanCount(&index, &lowVal, GTE, &highVal, LT), relationSize)
+	}
+	int evenReads = leafReads();
+	checkPassFail((evenReads >= relationSize / (intLeafCapacity(0, 0) / 2 + 1)), true)
+	checkPassFail((unevenReads < evenReads), true)
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+}
+
+void test22()
+{
+	// Fill an INTEGER leaf with keys close together, which it packs into a few bits each, then add keys far apart
+	std::cout << "--------------------" << std::endl;
+	std::cout << "Packed INTEGER leaves" << std::endl;
+	LeafNodeInt *leaf = new LeafNodeInt();
+	leaf->format(0);
+	RecordId rid;
+	int count = 0;
+	do {
+		rid.page_number = 2 + count / 7;
+		rid.slot_number = 1 + count % 7;
+		count++;
+	} while (leaf->append(-1000 + 3 * count, rid, NULL, 1.0));
+	count--;
+	checkPassFail(leaf->header.keyCount, count)
+	checkPassFail((count > INTARRAYLEAFSIZE), true)
+	bool same = true;
+	for (int i = 0; i < count; i++) {
+		RecordId stored = leaf->ridAt(i);
+		same = same && leaf->keyAt(i) == -1000 + 3 * (i + 1) && stored.page_number == (PageId) (2 + i / 7)
+				&& stored.slot_number == 1 + i % 7;
+		same = same && leaf->lowerBound(-1000 + 3 * (i + 1)) == i && leaf->upperBound(-1000 + 3 * (i + 1)) == i + 1
+				&& leaf->lowerBound(-1000 + 3 * (i + 1) - 1) == i;
+	}
+	checkPassFail(same, true)
+	checkPassFail(leaf->lowerBound(INT_MIN), 0)
+	checkPassFail(leaf->upperBound(INT_MAX), count)
+
+	// a key far away needs every offset to be wider, so the full leaf refuses it and stays as it was
+	checkPassFail(leaf->insertAt(0, INT_MIN, rid, NULL), false)
+	checkPassFail(leaf->header.keyCount, count)
+	checkPassFail(leaf->keyAt(0), -997)
+
+	// emptied down to a few entries it takes keys from the whole range
+	while (leaf->header.keyCount > 4) {
+		leaf->removeAt(1);
+	}
+	checkPassFail(leaf->insertAt(0, INT_MIN, rid, NULL), true)
+	checkPassFail(leaf->insertAt(5, INT_MAX, rid, NULL), true)
+	checkPassFail(leaf->keyAt(0), INT_MIN)
+	checkPassFail(leaf->keyAt(1), -997)
+	checkPassFail(leaf->keyAt(5), INT_MAX)
+	checkPassFail(leaf->lowerBound(-996), 2)
+	delete leaf;
+
+	// Look keys up from other threads while keys far away repack the leaves at both ends to wider offsets and fewer
+	// entries, which lookups must never see half done
+	createRelationForward();
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		index.setConcurrent(true);
+		std::atomic<int> missed(0);
+		std::atomic<bool> writing(true);
+		auto reader = [&]() {
+			do {
+				for (int key = 0; key < relationSize; key++) {
+					RecordId outRid;
+					if (!index.lookup(&key, outRid))
+						missed++;
+				}
+			} while (writing);
+		};
+		std::vector<std::thread> threads;
+		for (int i = 0; i < 2; i++)
+			threads.push_back(std::thread(reader));
+		for (int i = 1; i <= 2000; i++) {
+			rid.page_number = i;
+			rid.slot_number = 1;
+			int key = -100000 * i;
+			index.insertEntry(&key, rid);
+			key = relationSize + 100000 * i;
+			index.insertEntry(&key, rid);
+		}
+		writing = false;
+		threads[0].join();
+		threads[1].join();
+		index.setConcurrent(false);
+		checkPassFail(missed.load(), 0)
+		int lowVal = INT_MIN, highVal = INT_MAX;
+		checkPassFail(batchScanCount(&index, &lowVal, GTE, &highVal, LTE, 100), relationSize + 4000)
+		checkPassFail(reverseScanCount(&index, &lowVal, GTE, &highVal, LTE, 100), relationSize + 4000)
+		checkPassFail(lookupMatches(&index, offsetof(tuple,i)), relationSize)
+	}
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+}
+
+void test23()
+{
+	// Build the index from keys in random order, which leaves its leaves part full and out of order in the file, then
+	// compact it while other threads look keys up and insert into leaves with room
+	std::cout << "--------------------" << std::endl;
+	std::cout << "Compaction" << std::endl;
+	createRelationRandom();
+	int lowVal = 0, highVal = relationSize;
+	// the leaves a full scan reads from disk, once the index is opened again
+	auto leafReads = [&]() {
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		bufMgr->clearBufStats();
+		batchScanCount(&index, &lowVal, GTE, &highVal, LT, 100);
+		return bufMgr->getBufStats().diskreads;
+	};
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		checkPassFail(deleteEntries(&index, offsetof(tuple,i), [](int value) { return true; }), relationSize)
+		insertEntries(&index, offsetof(tuple,i));
+	}
+	int scatteredReads = leafReads();
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		index.setSubtreeCounts(true);
+		index.setConcurrent(true);
+		std::atomic<int> missed(0);
+		std::atomic<bool> compacting(true);
+		std::thread reader([&]() {
+			do {
+				for (int key = 0; key < relationSize; key += 3) {
+					RecordId outRid;
+					if (!index.lookup(&key, outRid))
+						missed++;
+				}
+			} while (compacting);
+		});
+		std::thread writer([&]() {
+			for (int key = relationSize; key < 2 * relationSize; key += 50) {
+				RecordId rid;
+				rid.page_number = key;
+				rid.slot_number = 1;
+				index.insertEntry(&key, rid);
+			}
+		});
+		index.compact(1.0);
+		writer.join();
+		compacting = false;
+		reader.join();
+		index.setConcurrent(false);
+		checkPassFail(missed.load(), 0)
+		checkPassFail((int) index.countRange(&lowVal, GTE, &highVal, LT), relationSize)
+		int allHigh = 2 * relationSize;
+		checkPassFail(batchScanCount(&index, &lowVal, GTE, &allHigh, LT, 100), relationSize + relationSize / 50)
+		checkPassFail(reverseScanCount(&index, &lowVal, GTE, &highVal, LT, 100), relationSize)
+		checkPassFail(lookupMatches(&index, offsetof(tuple,i)), relationSize)
+		for (int key = relationSize; key < 2 * relationSize; key += 50) {
+			RecordId rid;
+			rid.page_number = key;
+			rid.slot_number = 1;
+			index.deleteEntry(&key, rid);
+		}
+		index.compact();
+	}
+	int compactReads = leafReads();
+	checkPassFail((compactReads < scatteredReads), true)
+	checkPassFail((compactReads <= relationSize / (INTARRAYLEAFSIZE * 9 / 10) + 2), true)
+
+	// STRING leaves, split by keys of other lengths
+	{
+		BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple,s), STRING);
+		for (int value = 0; value < relationSize; value++) {
+			char key[STRINGSIZE];
+			sprintf(key, "%d", value);
+			RecordId rid;
+			rid.page_number = value + 1;
+			rid.slot_number = 1;
+			index.insertEntry(key, rid);
+		}
+		index.compact(0.5);
+		checkPassFail(batchScanCount(&index, "", GTE, "99999", LTE, 100), 2 * relationSize)
+		checkPassFail(reverseScanCount(&index, "", GTE, "99999", LTE, 100), 2 * relationSize)
+		checkPassFail(batchScanCount(&index, "1", GTE, "2", LT, 100), 1111)
+		index.compact(1.0);
+		checkPassFail(batchScanCount(&index, "", GTE, "99999", LTE, 7), 2 * relationSize)
+	}
+	try
+	{
+		File::remove(intIndexName);
+		File::remove(stringIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+}
+
+void test24()
+{
+	// Scan a STRING index of long keys, three levels deep so that the leaves read ahead come from several parents, with
+	// and without reading ahead
+	std::cout << "--------------------" << std::endl;
+	std::cout << "Scan readahead" << std::endl;
+	createRelationForward();
+	{
+		BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple,s), STRING);
+		for (int value = 0; value < 30 * relationSize; value++) {
+			char key[STRINGSIZE];
+			sprintf(key, "%060d", value);
+			RecordId rid;
+			rid.page_number = value + 1;
+			rid.slot_number = 1;
+			index.insertEntry(key, rid);
+		}
+	}
+	// the pages a scan reads from disk, once the index is opened again
+	auto scanReads = [&](const int leaves, const char *lowVal, const char *highVal, int &count) {
+		BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple,s), STRING);
+		index.setScanReadahead(leaves);
+		bufMgr->clearBufStats();
+		count = batchScanCount(&index, lowVal, GTE, highVal, LT, 100);
+		return bufMgr->getBufStats().diskreads;
+	};
+	char low[STRINGSIZE], high[STRINGSIZE];
+	sprintf(low, "%060d", 1234);
+	sprintf(high, "%060d", 123456);
+	int plainCount, aheadCount;
+	int plainReads = scanReads(0, "", "99999", plainCount);
+	int aheadReads = scanReads(SCAN_READAHEAD_LEAVES, "", "99999", aheadCount);
+	checkPassFail(plainCount, 31 * relationSize)
+	checkPassFail(aheadCount, 31 * relationSize)
+	// every leaf read ahead is one the scan goes through; the non-leaf nodes above the next parents are read besides
+	checkPassFail((aheadReads <= plainReads + plainReads / 20), true)
+	plainReads = scanReads(0, low, high, plainCount);
+	aheadReads = scanReads(2 * SCAN_READAHEAD_LEAVES, low, high, aheadCount);
+	checkPassFail(plainCount, 123456 - 1234)
+	checkPassFail(aheadCount, 123456 - 1234)
+	checkPassFail((aheadReads <= plainReads + plainReads / 20), true)
+	aheadReads = scanReads(1, low, low, aheadCount);
+	checkPassFail(aheadCount, 0)
+
+	// pages of the relation asked for a few ahead and read in order come from disk once each, whether their read in
+	// the background is done, under way or not started when readPage gets to them
+	std::vector<PageId> relationPages;
+	for (FileIterator iter = file1->begin(); iter != file1->end(); ++iter)
+		relationPages.push_back((*iter).page_number());
+	bufMgr->clearBufStats();
+	bool samePages = true;
+	for (size_t i = 0; i < relationPages.size(); i++) {
+		for (size_t j = i + 1; j <= i + 8 && j < relationPages.size(); j++)
+			bufMgr->prefetchPage(file1, relationPages[j]);
+		Page *page;
+		bufMgr->readPage(file1, relationPages[i], page);
+		samePages = samePages && page->page_number() == relationPages[i];
+		bufMgr->unPinPage(file1, relationPages[i], false);
+	}
+	checkPassFail(bufMgr->getBufStats().diskreads, (int) relationPages.size())
+	checkPassFail(samePages, true)
+
+	// a flush right after pages are asked for waits for the one being read in the background instead of finding it
+	// pinned, and a disposed page is not read into the pool after it has left the file
+	bool flushed = true;
+	for (size_t i = 0; i < relationPages.size(); i += 8) {
+		for (size_t j = i; j < i + 8 && j < relationPages.size(); j++)
+			bufMgr->prefetchPage(file1, relationPages[j]);
+		try
+		{
+			bufMgr->flushFile(file1);
+		}
+		catch(PagePinnedException e)
+		{
+			flushed = false;
+		}
+	}
+	checkPassFail(flushed, true)
+	int disposedReads = 0;
+	for (size_t i = 0; i < relationPages.size(); i++) {
+		bufMgr->prefetchPage(file1, relationPages[i]);
+		bufMgr->disposePage(file1, relationPages[i]);
+		try
+		{
+			Page *page;
+			bufMgr->readPage(file1, relationPages[i], page);
+			bufMgr->unPinPage(file1, relationPages[i], false);
+			disposedReads++;
+		}
+		catch(InvalidPageException e)
+		{
+		}
+	}
+	checkPassFail(disposedReads, 0)
+	try
+	{
+		File::remove(stringIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+}
+
+void test25()
+{
+	// Keep the statistics of an index through deletes and inserts, open it again from its meta page alone and weigh an
+	// index scan against a scan of the relation
+	std::cout << "--------------------" << std::endl;
+	std::cout << "Index statistics" << std::endl;
+	createRelationRandom();
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		IndexStatistics stats = index.getStatistics();
+		checkPassFail((int) stats.entryCount, relationSize)
+		checkPassFail((stats.height >= 2), true)
+		checkPassFail((int) stats.levelPages[stats.height - 1], 1)
+		checkPassFail((stats.levelPages[0] > stats.levelPages[1]), true)
+		checkPassFail(*(const int *) stats.minKey, 0)
+		checkPassFail(*(const int *) stats.maxKey, relationSize - 1)
+		checkPassFail(stats.bucketCount, HISTOGRAM_BUCKETS)
+		checkPassFail((int) std::accumulate(stats.bucketCounts, stats.bucketCounts + stats.bucketCount, 0u), relationSize)
+
+		checkPassFail(deleteEntries(&index, offsetof(tuple,i), [](int value) { return value % 2 == 0; }), relationSize / 2)
+		RecordId rid;
+		rid.page_number = relationSize;
+		rid.slot_number = 1;
+		int key = 2 * relationSize;
+		index.insertEntry(&key, rid);
+		// the record is already indexed under the key, so nothing is counted
+		index.insertEntry(&key, rid);
+		stats = index.getStatistics();
+		checkPassFail((int) stats.entryCount, relationSize / 2 + 1)
+		checkPassFail(*(const int *) stats.maxKey, 2 * relationSize)
+		checkPassFail((int) std::accumulate(stats.bucketCounts, stats.bucketCounts + stats.bucketCount, 0u), relationSize / 2 + 1)
+		index.refreshStatistics();
+		checkPassFail((int) index.getStatistics().entryCount, relationSize / 2 + 1)
+		checkPassFail(*(const int *) index.getStatistics().minKey, 1)
+	}
+	{
+		bufMgr->clearBufStats();
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		checkPassFail(bufMgr->getBufStats().diskreads, 1)
+		IndexStatistics stats = index.getStatistics();
+		checkPassFail((int) stats.entryCount, relationSize / 2 + 1)
+		checkPassFail((stats.height >= 2), true)
+
+		int lowVal = 1000, highVal = 3000;
+		double estimate = index.estimateRange(&lowVal, GTE, &highVal, LT);
+		int count = index.countRange(&lowVal, GTE, &highVal, LT);
+		checkPassFail(count, 1000)
+		checkPassFail((estimate > count * 0.9 && estimate < count * 1.1), true)
+		highVal = 1000;
+		checkPassFail((index.estimateRange(&lowVal, GT, &highVal, LT) == 0), true)
+		lowVal = -100;
+		highVal = -1;
+		checkPassFail((index.estimateRange(&lowVal, GTE, &highVal, LTE) == 0), true)
+
+		// a few records come from a few pages of the index, every record from fewer pages of the relation
+		lowVal = 1000;
+		highVal = 1010;
+		checkPassFail(index.preferIndexScan(&lowVal, GTE, &highVal, LT, relationSize / 100), true)
+		lowVal = 0;
+		highVal = 2 * relationSize;
+		checkPassFail(index.preferIndexScan(&lowVal, GTE, &highVal, LTE, relationSize / 100), false)
+	}
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+}
+
+// -----------------------------------------------------------------------------
+// deleteEntries
+// Deletes the entry of every tuple whose integer field is doomed and returns how many were found.
+// -----------------------------------------------------------------------------
+
+int deleteEntries(BTreeIndex *index, int keyOffset, const std::function<bool (int)> &doomed)
+{
+	int deleted = 0;
+	FileScan fscan(relationName, bufMgr);
+	try
+	{
+		RecordId scanRid;
+		while(1)
+		{
+			fscan.scanNext(scanRid);
+			std::string recordStr = fscan.getRecord();
+			const char *record = recordStr.c_str();
+			if (!doomed(*((int *)(record + offsetof (RECORD, i)))))
+				continue;
+			try
+			{
+				index->deleteEntry(record + keyOffset, scanRid);
+				deleted++;
+			}
+			catch(NoSuchKeyFoundException e)
+			{
+			}
+		}
+	}
+	catch(EndOfFileException e)
+	{
+	}
+	return deleted;
+}
+
+// -----------------------------------------------------------------------------
+// insertBatchEntries
+// Inserts the entry of every tuple with a single insertBatch.
+// -----------------------------------------------------------------------------
+
+void insertBatchEntries(BTreeIndex *index, int keyOffset, Datatype keyType)
+{
+	const size_t keySize = (keyType == INTEGER) ? sizeof(int) : (keyType == DOUBLE) ? sizeof(double) : STRINGSIZE;
+	std::vector<char> keys;
+	std::vector<RecordId> rids;
+	std::vector<std::string> records;
+	FileScan fscan(relationName, bufMgr);
+	try
+	{
+		RecordId scanRid;
+		while(1)
+		{
+			fscan.scanNext(scanRid);
+			records.push_back(fscan.getRecord());
+			rids.push_back(scanRid);
+			keys.resize(keys.size() + keySize);
+			if (keyType == STRING)
+			{
+				strncpy(&keys[keys.size() - keySize], records.back().c_str() + keyOffset, keySize);
+			}
+			else
+			{
+				memcpy(&keys[keys.size() - keySize], records.back().c_str() + keyOffset, keySize);
+			}
+		}
+	}
+	catch(EndOfFileException e)
+	{
+	}
+	std::vector<const void *> recordPointers;
+	for (const std::string &record : records)
+	{
+		recordPointers.push_back(record.c_str());
+	}
+	index->insertBatch(keys.data(), rids.data(), rids.size(), recordPointers.data());
+}
+
+// -----------------------------------------------------------------------------
+// insertEntries
+// Inserts the entry of every tuple, entries already in the index are left alone.
+// -----------------------------------------------------------------------------
+
+void insertEntries(BTreeIndex *index, int keyOffset)
+{
+	FileScan fscan(relationName, bufMgr);
+	try
+	{
+		RecordId scanRid;
+		while(1)
+		{
+			fscan.scanNext(scanRid);
+			std::string recordStr = fscan.getRecord();
+			index->insertEntry(recordStr.c_str() + keyOffset, scanRid, recordStr.c_str());
+		}
+	}
+	catch(EndOfFileException e)
+	{
+	}
+}
+
+// -----------------------------------------------------------------------------
+// lookupMatches
+// Looks up the key of every tuple and returns how many lookups find the record id of that tuple.
+// -----------------------------------------------------------------------------
+
+int lookupMatches(BTreeIndex *index, int keyOffset)
+{
+	int matches = 0;
+	FileScan fscan(relationName, bufMgr);
+	try
+	{
+		RecordId scanRid;
+		while(1)
+		{
+			fscan.scanNext(scanRid);
+			std::string recordStr = fscan.getRecord();
+			RecordId outRid;
+			if (index->lookup(recordStr.c_str() + keyOffset, outRid) && outRid == scanRid)
+				matches++;
+		}
+	}
+	catch(EndOfFileException e)
+	{
+	}
+	return matches;
+}
+
 // -----------------------------------------------------------------------------
 // createRelationForward
 // -----------------------------------------------------------------------------
@@ -356,6 +1922,24 @@ void indexTests()
   	catch(FileNotFoundException e)
   	{
   	}
+
+    doubleTests();
+		try
+		{
+			File::remove(doubleIndexName);
+		}
+  	catch(FileNotFoundException e)
+  	{
+  	}
+
+    stringTests();
+		try
+		{
+			File::remove(stringIndexName);
+		}
+  	catch(FileNotFoundException e)
+  	{
+  	}
   }
 }
 
@@ -380,20 +1964,97 @@ void intTests()
 
 int intScan(BTreeIndex * index, int lowVal, Operator lowOp, int highVal, Operator highOp)
 {
-  RecordId scanRid;
-	Page *curPage;
+  std::cout << "Scan for ";
+  if( lowOp == GT ) { std::cout << "("; } else { std::cout << "["; }
+  std::cout << lowVal << "," << highVal;
+  if( highOp == LT ) { std::cout << ")"; } else { std::cout << "]"; }
+  std::cout << std::endl;
+
+	return scanCount(index, &lowVal, lowOp, &highVal, highOp);
+}
+
+// -----------------------------------------------------------------------------
+// doubleTests
+// -----------------------------------------------------------------------------
+
+void doubleTests()
+{
+  std::cout << "Create a B+ Tree index on the double field" << std::endl;
+  BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple,d), DOUBLE);
 
+	// run some tests
+	checkPassFail(doubleScan(&index,25,GT,40,LT), 14)
+	checkPassFail(doubleScan(&index,20,GTE,35,LTE), 16)
+	checkPassFail(doubleScan(&index,-3,GT,3,LT), 3)
+	checkPassFail(doubleScan(&index,996,GT,1001,LT), 4)
+	checkPassFail(doubleScan(&index,0,GT,1,LT), 0)
+	checkPassFail(doubleScan(&index,300,GT,400,LT), 99)
+	checkPassFail(doubleScan(&index,3000,GTE,4000,LT), 1000)
+	checkPassFail(doubleScan(&index,24.5,GT,40.5,LT), 16)
+}
+
+int doubleScan(BTreeIndex * index, double lowVal, Operator lowOp, double highVal, Operator highOp)
+{
   std::cout << "Scan for ";
   if( lowOp == GT ) { std::cout << "("; } else { std::cout << "["; }
   std::cout << lowVal << "," << highVal;
   if( highOp == LT ) { std::cout << ")"; } else { std::cout << "]"; }
   std::cout << std::endl;
 
+	return scanCount(index, &lowVal, lowOp, &highVal, highOp);
+}
+
+// -----------------------------------------------------------------------------
+// stringTests
+// -----------------------------------------------------------------------------
+
+void stringTests()
+{
+  std::cout << "Create a B+ Tree index on the string field" << std::endl;
+  BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple,s), STRING);
+
+	// run some tests
+	checkPassFail(stringScan(&index,25,GT,40,LT), 14)
+	checkPassFail(stringScan(&index,20,GTE,35,LTE), 16)
+	checkPassFail(stringScan(&index,-3,GT,3,LT), 3)
+	checkPassFail(stringScan(&index,996,GT,1001,LT), 4)
+	checkPassFail(stringScan(&index,0,GT,1,LT), 0)
+	checkPassFail(stringScan(&index,300,GT,400,LT), 99)
+	checkPassFail(stringScan(&index,3000,GTE,4000,LT), 1000)
+}
+
+int stringScan(BTreeIndex * index, int lowVal, Operator lowOp, int highVal, Operator highOp)
+{
+	// the string keys are the "%05d string record" values the relations are created with
+	char lowValStr[100];
+	sprintf(lowValStr,"%05d string record",lowVal);
+	char highValStr[100];
+	sprintf(highValStr,"%05d string record",highVal);
+
+  std::cout << "Scan for ";
+  if( lowOp == GT ) { std::cout << "("; } else { std::cout << "["; }
+  std::cout << lowValStr << "," << highValStr;
+  if( highOp == LT ) { std::cout << ")"; } else { std::cout << "]"; }
+  std::cout << std::endl;
+
+	return scanCount(index, lowValStr, lowOp, highValStr, highOp);
+}
+
+// -----------------------------------------------------------------------------
+// scanCount
+// Runs the scan and counts the records it returns, printing the first few.
+// -----------------------------------------------------------------------------
+
+int scanCount(BTreeIndex * index, const void *lowVal, Operator lowOp, const void *highVal, Operator highOp)
+{
+  RecordId scanRid;
+	Page *curPage;
+
   int numResults = 0;
 	
 	try
 	{
-  	index->startScan(&lowVal, lowOp, &highVal, highOp);
+  	index->startScan(lowVal, lowOp, highVal, highOp);
 	}
 	catch(NoSuchKeyFoundException e)
 	{
@@ -438,6 +2099,197 @@ int intScan(BTreeIndex * index, int lowVal, Operator lowOp, int highVal, Operato
 	return numResults;
 }
 
+// -----------------------------------------------------------------------------
+// batchScanCount
+// Runs the scan once with scanNext and once with scanNextBatch, batchSize record ids at a time, and counts the
+// records; -1 if the two scans disagree.
+// -----------------------------------------------------------------------------
+
+int batchScanCount(BTreeIndex * index, const void *lowVal, Operator lowOp, const void *highVal, Operator highOp, size_t batchSize)
+{
+	std::vector<RecordId> expected;
+	try
+	{
+		index->startScan(lowVal, lowOp, highVal, highOp);
+		try
+		{
+			RecordId scanRid;
+			while(1)
+			{
+				index->scanNext(scanRid);
+				expected.push_back(scanRid);
+			}
+		}
+		catch(IndexScanCompletedException e)
+		{
+		}
+		index->endScan();
+	}
+	catch(NoSuchKeyFoundException e)
+	{
+		return 0;
+	}
+
+	std::vector<RecordId> batch(batchSize);
+	size_t numResults = 0;
+	index->startScan(lowVal, lowOp, highVal, highOp);
+	while(1)
+	{
+		size_t count = index->scanNextBatch(batch.data(), batchSize);
+		for (size_t i = 0; i < count; i++, numResults++)
+		{
+			if (numResults >= expected.size() || expected[numResults] != batch[i])
+			{
+				index->endScan();
+				return -1;
+			}
+		}
+		if (count < batchSize)
+			break;
+	}
+	// a finished scan keeps returning nothing
+	size_t after = index->scanNextBatch(batch.data(), batchSize);
+	index->endScan();
+	std::cout << "Batch scan of " << batchSize << ": " << numResults << " results" << std::endl;
+
+	return (numResults == expected.size() && after == 0) ? numResults : -1;
+}
+
+// -----------------------------------------------------------------------------
+// coveredScanCount
+// Runs the scan with scanNext and with scanNextBatch, batchSize record ids at a time, fetching the included columns
+// of every record, and counts the records; -1 if the two scans differ or some included columns are not valid.
+// -----------------------------------------------------------------------------
+
+int coveredScanCount(BTreeIndex * index, const void *lowVal, Operator lowOp, const void *highVal, Operator highOp, size_t batchSize,
+		size_t includedBytes, const std::function<bool (const char *)> &valid)
+{
+	std::vector<RecordId> expected;
+	std::vector<char> expectedIncluded;
+	try
+	{
+		index->startScan(lowVal, lowOp, highVal, highOp);
+		try
+		{
+			RecordId scanRid;
+			std::vector<char> included(includedBytes);
+			while(1)
+			{
+				index->scanNext(scanRid, included.data());
+				if (!valid(included.data()))
+				{
+					index->endScan();
+					return -1;
+				}
+				expected.push_back(scanRid);
+				expectedIncluded.insert(expectedIncluded.end(), included.begin(), included.end());
+			}
+		}
+		catch(IndexScanCompletedException e)
+		{
+		}
+		index->endScan();
+	}
+	catch(NoSuchKeyFoundException e)
+	{
+		return 0;
+	}
+
+	std::vector<RecordId> batch(batchSize);
+	std::vector<char> batchIncluded(batchSize * includedBytes);
+	size_t numResults = 0;
+	index->startScan(lowVal, lowOp, highVal, highOp);
+	while(1)
+	{
+		size_t count = index->scanNextBatch(batch.data(), batchIncluded.data(), batchSize);
+		for (size_t i = 0; i < count; i++, numResults++)
+		{
+			if (numResults >= expected.size() || expected[numResults] != batch[i]
+					|| memcmp(&expectedIncluded[numResults * includedBytes], &batchIncluded[i * includedBytes], includedBytes) != 0)
+			{
+				index->endScan();
+				return -1;
+			}
+		}
+		if (count < batchSize)
+			break;
+	}
+	index->endScan();
+	std::cout << "Covered scan: " << numResults << " results" << std::endl;
+
+	return (numResults == expected.size()) ? numResults : -1;
+}
+
+// -----------------------------------------------------------------------------
+// reverseScanCount
+// Runs the scan upwards, then downwards with scanNext and with scanNextBatch, batchSize record ids at a time, and
+// counts the records; -1 if the downward scans do not return the upward one backwards.
+// -----------------------------------------------------------------------------
+
+int reverseScanCount(BTreeIndex * index, const void *lowVal, Operator lowOp, const void *highVal, Operator highOp, size_t batchSize)
+{
+	std::vector<RecordId> expected;
+	bool empty = false;
+	try
+	{
+		index->startScan(lowVal, lowOp, highVal, highOp);
+		try
+		{
+			RecordId scanRid;
+			while(1)
+			{
+				index->scanNext(scanRid);
+				expected.push_back(scanRid);
+			}
+		}
+		catch(IndexScanCompletedException e)
+		{
+		}
+		index->endScan();
+	}
+	catch(NoSuchKeyFoundException e)
+	{
+		empty = true;
+	}
+	std::reverse(expected.begin(), expected.end());
+
+	std::vector<RecordId> single;
+	try
+	{
+		index->startReverseScan(lowVal, lowOp, highVal, highOp);
+	}
+	catch(NoSuchKeyFoundException e)
+	{
+		return empty ? 0 : -1;
+	}
+	try
+	{
+		RecordId scanRid;
+		while(1)
+		{
+			index->scanNext(scanRid);
+			single.push_back(scanRid);
+		}
+	}
+	catch(IndexScanCompletedException e)
+	{
+	}
+	index->endScan();
+
+	std::vector<RecordId> batched;
+	std::vector<RecordId> batch(batchSize);
+	index->startReverseScan(lowVal, lowOp, highVal, highOp);
+	size_t count;
+	do
+	{
+		count = index->scanNextBatch(batch.data(), batchSize);
+		batched.insert(batched.end(), batch.begin(), batch.begin() + count);
+	} while (count == batchSize);
+	index->endScan();
+	std::cout << "Reverse scan: " << single.size() << " results" << std::endl;
+
+	return (single == expected && batched == expected) ? (int) expected.size() : -1;
+}
 
 // -----------------------------------------------------------------------------
 // errorTests
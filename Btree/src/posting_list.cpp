@@ -0,0 +1,108 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "btree.h"
+
+namespace badgerdb
+{
+
+// -----------------------------------------------------------------------------
+// ridValue:
+// packs a record id into one integer that sorts the same way, so that
+// neighbouring record ids differ by a small number
+// -----------------------------------------------------------------------------
+static inline std::uint64_t ridValue(const RecordId &rid)
+{
+	return ((std::uint64_t) rid.page_number << 16) | rid.slot_number;
+}
+
+static inline RecordId valueRid(const std::uint64_t value)
+{
+	RecordId rid;
+	rid.page_number = (PageId) (value >> 16);
+	rid.slot_number = (SlotId) (value & 0xFFFF);
+	return rid;
+}
+
+static inline int varintLength(std::uint64_t value)
+{
+	int length = 1;
+	while (value >= 0x80) {
+		value >>= 7;
+		length++;
+	}
+	return length;
+}
+
+// -----------------------------------------------------------------------------
+// PostingPage
+// -----------------------------------------------------------------------------
+
+void PostingPage::decode(std::vector<RecordId> &rids, std::vector<char> *included) const
+{
+	std::uint64_t value = 0;
+	int position = 0;
+	for (int i = 0; i < header.keyCount; i++) {
+		//seven bits at a time, low bits first, the high bit set on all but the last byte
+		std::uint64_t delta = 0;
+		int shift = 0;
+		unsigned char byte;
+		do {
+			byte = data[position++];
+			delta |= (std::uint64_t) (byte & 0x7F) << shift;
+			shift += 7;
+		} while (byte & 0x80);
+		value = (i == 0) ? delta : value + delta;
+		rids.push_back(valueRid(value));
+		if (included != NULL) {
+			included->insert(included->end(), data + position, data + position + includedBytes);
+		}
+		position += includedBytes;
+	}
+}
+
+RecordId PostingPage::first() const
+{
+	//the first record id is stored whole rather than as a delta
+	std::uint64_t value = 0;
+	int shift = 0;
+	int position = 0;
+	unsigned char byte;
+	do {
+		byte = data[position++];
+		value |= (std::uint64_t) (byte & 0x7F) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+	return valueRid(value);
+}
+
+int PostingPage::encode(const RecordId *rids, const char *included, const int count)
+{
+	std::uint64_t previous = 0;
+	int position = 0;
+	int written = 0;
+	for (; written < count; written++) {
+		std::uint64_t value = ridValue(rids[written]);
+		std::uint64_t delta = (written == 0) ? value : value - previous;
+		if (position + varintLength(delta) + includedBytes > POSTINGDATASIZE) {
+			break;
+		}
+		while (delta >= 0x80) {
+			data[position++] = (unsigned char) (delta | 0x80);
+			delta >>= 7;
+		}
+		data[position++] = (unsigned char) delta;
+		std::copy_n(included + written * includedBytes, includedBytes, data + position);
+		position += includedBytes;
+		previous = value;
+	}
+	header.keyCount = written;
+	usedBytes = position;
+	return written;
+}
+
+}
@@ -0,0 +1,112 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/**
+ * Microbenchmark for the search inside B+ tree nodes. Times the linear loop the index used to walk
+ * keyArray with against every lower bound kernel, on nodes as full as a leaf and a non leaf can get.
+ *
+ * Build and run with:
+ *   $ make bench
+ *   $ ./src/search_bench
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include "btree.h"
+#include "key_search.h"
+
+using namespace badgerdb;
+
+/**
+ * Number of distinct nodes searched, enough to spill out of the L1 cache like a real buffer pool does.
+ */
+const int NODES = 512;
+
+/**
+ * Number of searches timed for each kernel.
+ */
+const int SEARCHES = 2000000;
+
+/**
+ * The loop find_next_nonleaf_node used before the kernels: walk left from the end while the key is not larger.
+ */
+static int linearSearch(const int *keys, const int n, const int key)
+{
+	int q = n;
+	while (q > 0 && keys[q - 1] >= key) {
+		q--;
+	}
+	return q;
+}
+
+static void runBench(const char *name, LowerBoundFunc search, const std::vector<int> &nodes,
+		const int nodeSize, const std::vector<int> &probes, const std::vector<int> &expected)
+{
+	int check = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < SEARCHES; i++) {
+		const int *keys = &nodes[(size_t) (i % NODES) * nodeSize];
+		check += search(keys, nodeSize, probes[i]);
+	}
+	auto stop = std::chrono::steady_clock::now();
+	double ns = std::chrono::duration<double, std::nano>(stop - start).count() / SEARCHES;
+
+	//every kernel has to agree with the linear loop
+	for (int i = 0; i < NODES; i++) {
+		const int *keys = &nodes[(size_t) (i % NODES) * nodeSize];
+		if (search(keys, nodeSize, probes[i]) != expected[i]) {
+			std::cout << name << " returned a wrong position" << std::endl;
+			exit(1);
+		}
+	}
+	std::cout << "  " << std::left << std::setw(10) << name << std::fixed << std::setprecision(1)
+		<< ns << " ns/search  (checksum " << check << ")" << std::endl;
+}
+
+static void benchNodeSize(const char *label, const int nodeSize)
+{
+	std::vector<int> nodes((size_t) NODES * nodeSize);
+	for (int i = 0; i < NODES; i++) {
+		//sorted keys with gaps, so probes hit both present and absent keys
+		int key = -(rand() % 1000);
+		for (int j = 0; j < nodeSize; j++) {
+			key += 1 + rand() % 4;
+			nodes[(size_t) i * nodeSize + j] = key;
+		}
+	}
+	std::vector<int> probes(SEARCHES);
+	std::vector<int> expected(NODES);
+	for (int i = 0; i < SEARCHES; i++) {
+		probes[i] = rand() % (nodeSize * 3) - 1000;
+	}
+	for (int i = 0; i < NODES; i++) {
+		expected[i] = linearSearch(&nodes[(size_t) i * nodeSize], nodeSize, probes[i]);
+	}
+
+	std::cout << label << " (" << nodeSize << " keys)" << std::endl;
+	runBench("linear", linearSearch, nodes, nodeSize, probes, expected);
+	runBench("scalar", lowerBoundScalar, nodes, nodeSize, probes, expected);
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.1")) {
+		runBench("sse4.1", lowerBoundSSE4, nodes, nodeSize, probes, expected);
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		runBench("avx2", lowerBoundAVX2, nodes, nodeSize, probes, expected);
+	}
+	runBench("selected", lowerBoundKernel(), nodes, nodeSize, probes, expected);
+}
+
+int main()
+{
+	srand(1);
+	benchNodeSize("leaf", INTARRAYLEAFSIZE);
+	benchNodeSize("non-leaf", INTARRAYNONLEAFSIZE);
+	return 0;
+}
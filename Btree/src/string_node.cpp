@@ -0,0 +1,472 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "btree.h"
+
+namespace badgerdb
+{
+
+// -----------------------------------------------------------------------------
+// compareBytes:
+// orders two strings given as characters and length. A string that is a
+// prefix of the other comes first, the same as comparing the zero padded keys.
+// -----------------------------------------------------------------------------
+static inline int compareBytes(const char *a, const int aLength, const char *b, const int bLength)
+{
+	int result = memcmp(a, b, std::min(aLength, bLength));
+	return (result != 0) ? result : aLength - bLength;
+}
+
+static inline int commonPrefixLength(const StringKey &a, const StringKey &b)
+{
+	int length = std::min(a.length(), b.length());
+	int shared = 0;
+	while (shared < length && a.data[shared] == b.data[shared]) {
+		shared++;
+	}
+	return shared;
+}
+
+StringKey shortestSeparator(const StringKey &left, const StringKey &right)
+{
+	//one character past the common prefix is enough to be greater than left
+	StringKey separator;
+	memset(separator.data, 0, STRINGSIZE);
+	int length = std::min(commonPrefixLength(left, right) + 1, right.length());
+	memcpy(separator.data, right.data, length);
+	return separator;
+}
+
+// -----------------------------------------------------------------------------
+// NonLeafNode<StringKey>
+// -----------------------------------------------------------------------------
+
+int NonLeafNode<StringKey>::usedBytes() const
+{
+	return header.keyCount * sizeof(StringNonLeafSlot) + heapBytes;
+}
+
+int NonLeafNode<StringKey>::compareSeparator(const int i, const StringKey &key, const int keyLength) const
+{
+	const StringNonLeafSlot &slot = slots()[i];
+	return compareBytes(key.data, keyLength, data + slot.offset, slot.length);
+}
+
+int NonLeafNode<StringKey>::lowerBound(const StringKey &key) const
+{
+	int keyLength = key.length();
+	int low = 0;
+	int high = header.keyCount;
+	while (low < high) {
+		int middle = (low + high) / 2;
+		if (compareSeparator(middle, key, keyLength) > 0) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	return low;
+}
+
+int NonLeafNode<StringKey>::upperBound(const StringKey &key) const
+{
+	int keyLength = key.length();
+	int low = 0;
+	int high = header.keyCount;
+	while (low < high) {
+		int middle = (low + high) / 2;
+		if (compareSeparator(middle, key, keyLength) >= 0) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	return low;
+}
+
+StringKey NonLeafNode<StringKey>::keyAt(const int i) const
+{
+	StringKey key;
+	memset(key.data, 0, STRINGSIZE);
+	memcpy(key.data, data + slots()[i].offset, slots()[i].length);
+	return key;
+}
+
+PageId NonLeafNode<StringKey>::childAt(const int i) const
+{
+	return (i == 0) ? firstPageNo : slots()[i - 1].pageNo;
+}
+
+std::uint32_t NonLeafNode<StringKey>::countAt(const int i) const
+{
+	return (i == 0) ? firstCount : slots()[i - 1].count;
+}
+
+void NonLeafNode<StringKey>::setCountAt(const int i, const std::uint32_t count)
+{
+	if (i == 0) {
+		firstCount = count;
+	} else {
+		slots()[i - 1].count = count;
+	}
+}
+
+void NonLeafNode<StringKey>::reset(const PageId firstChild)
+{
+	header.keyCount = 0;
+	heapBytes = 0;
+	firstPageNo = firstChild;
+	firstCount = 0;
+}
+
+bool NonLeafNode<StringKey>::insertAt(const int i, const StringKey &key, const PageId rightChild, const std::uint32_t rightCount)
+{
+	int length = key.length();
+	if (usedBytes() + (int) sizeof(StringNonLeafSlot) + length > STRINGNONLEAFDATASIZE) {
+		return false;
+	}
+	heapBytes += length;
+	int offset = STRINGNONLEAFDATASIZE - heapBytes;
+	memcpy(data + offset, key.data, length);
+	StringNonLeafSlot *slot = slots();
+	memmove((void *) (slot + i + 1), slot + i, (header.keyCount - i) * sizeof(StringNonLeafSlot));
+	slot[i].pageNo = rightChild;
+	slot[i].count = rightCount;
+	slot[i].offset = offset;
+	slot[i].length = length;
+	header.keyCount++;
+	return true;
+}
+
+bool NonLeafNode<StringKey>::append(const StringKey &key, const PageId rightChild, const double fillFactor)
+{
+	//a node always takes a second child, whatever the fill factor
+	int limit = (int) (STRINGNONLEAFDATASIZE * fillFactor);
+	if (header.keyCount > 0 && usedBytes() + (int) sizeof(StringNonLeafSlot) + key.length() > limit) {
+		return false;
+	}
+	return insertAt(header.keyCount, key, rightChild, 0);
+}
+
+void NonLeafNode<StringKey>::popBack()
+{
+	//separators are appended from the back, so the last one is usually the first in the heap
+	const StringNonLeafSlot &slot = slots()[header.keyCount - 1];
+	if (slot.offset == STRINGNONLEAFDATASIZE - heapBytes) {
+		heapBytes -= slot.length;
+	}
+	header.keyCount--;
+}
+
+void NonLeafNode<StringKey>::gather(std::vector<StringKey> &keys, std::vector<PageId> &children,
+		std::vector<std::uint32_t> &counts) const
+{
+	int count = header.keyCount;
+	keys.resize(count);
+	children.resize(count + 1);
+	counts.resize(count + 1);
+	children[0] = firstPageNo;
+	counts[0] = firstCount;
+	for (int i = 0; i < count; i++) {
+		keys[i] = keyAt(i);
+		children[i + 1] = slots()[i].pageNo;
+		counts[i + 1] = slots()[i].count;
+	}
+}
+
+void NonLeafNode<StringKey>::removeAt(const int i)
+{
+	//rebuilding the node also gives back the bytes of the separator
+	std::vector<StringKey> keys;
+	std::vector<PageId> children;
+	std::vector<std::uint32_t> counts;
+	gather(keys, children, counts);
+	keys.erase(keys.begin() + i);
+	children.erase(children.begin() + i + 1);
+	counts.erase(counts.begin() + i + 1);
+	load(keys.data(), children.data(), counts.data(), keys.size());
+}
+
+bool NonLeafNode<StringKey>::replaceKeyAt(const int i, const StringKey &key)
+{
+	std::vector<StringKey> keys;
+	std::vector<PageId> children;
+	std::vector<std::uint32_t> counts;
+	gather(keys, children, counts);
+	keys[i] = key;
+	if (!fits(keys.data(), keys.size())) {
+		return false;
+	}
+	load(keys.data(), children.data(), counts.data(), keys.size());
+	return true;
+}
+
+double NonLeafNode<StringKey>::occupancy() const
+{
+	return (double) usedBytes() / STRINGNONLEAFDATASIZE;
+}
+
+bool NonLeafNode<StringKey>::fits(const StringKey *keys, const int count)
+{
+	int size = count * sizeof(StringNonLeafSlot);
+	for (int i = 0; i < count; i++) {
+		size += keys[i].length();
+	}
+	return size <= STRINGNONLEAFDATASIZE;
+}
+
+void NonLeafNode<StringKey>::load(const StringKey *keys, const PageId *children, const std::uint32_t *counts, const int count)
+{
+	reset(children[0]);
+	firstCount = counts[0];
+	for (int i = 0; i < count; i++) {
+		insertAt(i, keys[i], children[i + 1], counts[i + 1]);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// LeafNode<StringKey>
+// -----------------------------------------------------------------------------
+
+void LeafNode<StringKey>::format(const int bytes)
+{
+	header.keyCount = 0;
+	prefixLength = 0;
+	heapBytes = 0;
+	includedBytes = bytes;
+}
+
+int LeafNode<StringKey>::usedBytes() const
+{
+	return header.keyCount * sizeof(StringLeafSlot) + heapBytes;
+}
+
+int LeafNode<StringKey>::compareSuffix(const int i, const char *rest, const int restLength) const
+{
+	const StringLeafSlot &slot = slots()[i];
+	return compareBytes(rest, restLength, data + slot.offset, slot.length);
+}
+
+int LeafNode<StringKey>::lowerBound(const StringKey &key) const
+{
+	int count = header.keyCount;
+	if (count == 0) {
+		return 0;
+	}
+	//The prefix is compared once, after that only the suffixes that tell the entries apart are looked at
+	int keyLength = key.length();
+	int result = memcmp(key.data, prefix, std::min(keyLength, (int) prefixLength));
+	if (result < 0 || (result == 0 && keyLength < prefixLength)) {
+		return 0;
+	}
+	if (result > 0) {
+		return count;
+	}
+	const char *rest = key.data + prefixLength;
+	int restLength = keyLength - prefixLength;
+	int low = 0;
+	int high = count;
+	while (low < high) {
+		int middle = (low + high) / 2;
+		if (compareSuffix(middle, rest, restLength) > 0) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	return low;
+}
+
+int LeafNode<StringKey>::upperBound(const StringKey &key) const
+{
+	int count = header.keyCount;
+	if (count == 0) {
+		return 0;
+	}
+	int keyLength = key.length();
+	int result = memcmp(key.data, prefix, std::min(keyLength, (int) prefixLength));
+	if (result < 0 || (result == 0 && keyLength < prefixLength)) {
+		return 0;
+	}
+	if (result > 0) {
+		return count;
+	}
+	const char *rest = key.data + prefixLength;
+	int restLength = keyLength - prefixLength;
+	int low = 0;
+	int high = count;
+	while (low < high) {
+		int middle = (low + high) / 2;
+		if (compareSuffix(middle, rest, restLength) >= 0) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	return low;
+}
+
+StringKey LeafNode<StringKey>::keyAt(const int i) const
+{
+	StringKey key;
+	memset(key.data, 0, STRINGSIZE);
+	memcpy(key.data, prefix, prefixLength);
+	memcpy(key.data + prefixLength, data + slots()[i].offset, slots()[i].length);
+	return key;
+}
+
+RecordId LeafNode<StringKey>::ridAt(const int i) const
+{
+	return slots()[i].rid;
+}
+
+void LeafNode<StringKey>::setRidAt(const int i, const RecordId rid)
+{
+	slots()[i].rid = rid;
+}
+
+const char *LeafNode<StringKey>::includedAt(const int i) const
+{
+	return data + slots()[i].offset + slots()[i].length;
+}
+
+void LeafNode<StringKey>::setIncludedAt(const int i, const char *included)
+{
+	std::copy_n(included, includedBytes, data + slots()[i].offset + slots()[i].length);
+}
+
+bool LeafNode<StringKey>::insertAt(const int i, const StringKey &key, const RecordId rid, const char *included)
+{
+	return insertWithin(i, key, rid, included, STRINGLEAFDATASIZE);
+}
+
+bool LeafNode<StringKey>::append(const StringKey &key, const RecordId rid, const char *included, const double fillFactor)
+{
+	//a leaf always takes its first entry, whatever the fill factor
+	int limit = (header.keyCount == 0) ? STRINGLEAFDATASIZE : (int) (STRINGLEAFDATASIZE * fillFactor);
+	return insertWithin(header.keyCount, key, rid, included, limit);
+}
+
+void LeafNode<StringKey>::removeAt(const int i)
+{
+	//without the entry the remaining keys may share a longer prefix
+	int count = header.keyCount;
+	std::vector<StringKey> keys(count - 1);
+	std::vector<RecordId> rids(count - 1);
+	std::vector<char> included((count - 1) * includedBytes);
+	for (int j = 0, k = 0; j < count; j++) {
+		if (j != i) {
+			keys[k] = keyAt(j);
+			rids[k] = ridAt(j);
+			std::copy_n(includedAt(j), includedBytes, included.begin() + k * includedBytes);
+			k++;
+		}
+	}
+	load(keys.data(), rids.data(), included.data(), count - 1);
+}
+
+double LeafNode<StringKey>::occupancy() const
+{
+	return (double) usedBytes() / STRINGLEAFDATASIZE;
+}
+
+bool LeafNode<StringKey>::fits(const StringKey *keys, const int count) const
+{
+	return encodedSize(keys, count) <= STRINGLEAFDATASIZE;
+}
+
+int LeafNode<StringKey>::encodedSize(const StringKey *keys, const int count) const
+{
+	if (count == 0) {
+		return 0;
+	}
+	int shared = commonPrefixLength(keys[0], keys[count - 1]);
+	int size = count * (sizeof(StringLeafSlot) + includedBytes);
+	for (int i = 0; i < count; i++) {
+		size += keys[i].length() - shared;
+	}
+	return size;
+}
+
+void LeafNode<StringKey>::load(const StringKey *keys, const RecordId *rids, const char *included, const int count)
+{
+	//the keys are sorted, so what the first and last share is shared by all of them
+	prefixLength = 0;
+	if (count > 0) {
+		prefixLength = commonPrefixLength(keys[0], keys[count - 1]);
+		memcpy(prefix, keys[0].data, prefixLength);
+	}
+	heapBytes = 0;
+	StringLeafSlot *slot = slots();
+	for (int i = 0; i < count; i++) {
+		int length = keys[i].length() - prefixLength;
+		heapBytes += length + includedBytes;
+		slot[i].rid = rids[i];
+		slot[i].offset = STRINGLEAFDATASIZE - heapBytes;
+		slot[i].length = length;
+		memcpy(data + slot[i].offset, keys[i].data + prefixLength, length);
+		std::copy_n(included + i * includedBytes, includedBytes, data + slot[i].offset + length);
+	}
+	header.keyCount = count;
+}
+
+bool LeafNode<StringKey>::insertWithin(const int i, const StringKey &key, const RecordId rid, const char *included,
+		const int limit)
+{
+	int keyLength = key.length();
+	if (header.keyCount == 0 || keyLength < prefixLength || memcmp(key.data, prefix, prefixLength) != 0) {
+		//Case: the key does not start with the prefix, which has to shrink
+		return reencode(i, key, rid, included, limit);
+	}
+
+	//Case: only the suffix of the new key is stored
+	int length = keyLength - prefixLength;
+	if (usedBytes() + (int) sizeof(StringLeafSlot) + length + includedBytes > limit) {
+		return false;
+	}
+	heapBytes += length + includedBytes;
+	int offset = STRINGLEAFDATASIZE - heapBytes;
+	memcpy(data + offset, key.data + prefixLength, length);
+	std::copy_n(included, includedBytes, data + offset + length);
+	StringLeafSlot *slot = slots();
+	memmove((void *) (slot + i + 1), slot + i, (header.keyCount - i) * sizeof(StringLeafSlot));
+	slot[i].rid = rid;
+	slot[i].offset = offset;
+	slot[i].length = length;
+	header.keyCount++;
+	return true;
+}
+
+bool LeafNode<StringKey>::reencode(const int i, const StringKey &key, const RecordId rid, const char *included,
+		const int limit)
+{
+	int count = header.keyCount;
+	std::vector<StringKey> keys(count + 1);
+	std::vector<RecordId> rids(count + 1);
+	std::vector<char> columns((count + 1) * includedBytes);
+	for (int j = 0, k = 0; j <= count; j++) {
+		if (j == i) {
+			keys[j] = key;
+			rids[j] = rid;
+			std::copy_n(included, includedBytes, columns.begin() + j * includedBytes);
+		} else {
+			keys[j] = keyAt(k);
+			rids[j] = ridAt(k);
+			std::copy_n(includedAt(k), includedBytes, columns.begin() + j * includedBytes);
+			k++;
+		}
+	}
+
+	//every stored suffix grows by the characters the prefix loses
+	if (encodedSize(keys.data(), count + 1) > limit) {
+		return false;
+	}
+	load(keys.data(), rids.data(), columns.data(), count + 1);
+	return true;
+}
+
+}